@@ -0,0 +1,27 @@
+// bindings shared by the colorize pipelines, which only ever see the compute engine's output
+
+#define PARAMS_WITHOUT_DOUBLES
+#include "params.glsl"
+
+layout (set=0, binding=1, rgba8) uniform writeonly image2D outImage;
+
+layout (set=0, binding=2, std430) readonly buffer IterationBuffer {
+	uint iterations[];
+};
+
+layout (set=0, binding=3, std430) readonly buffer MagnitudeBuffer {
+	float magnitudes[];
+};
+
+// one palette per row, sampled with repeat along u so cycling wraps around
+layout (set=0, binding=4) uniform sampler2D palettes;
+
+// escaped pixels per iteration count
+layout (set=0, binding=5, std430) buffer Histogram {
+	uint histogram[];
+};
+
+// fraction of escaped pixels at or below each iteration count
+layout (set=0, binding=6, std430) buffer Cumulative {
+	float cumulative[];
+};
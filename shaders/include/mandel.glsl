@@ -0,0 +1,294 @@
+// shared by shader.frag and mandel.comp, which the Makefile builds once per precision tier:
+// PRECISION_F32, PRECISION_DS (float-float pairs) or, with neither defined, native fp64.
+// Float-only modules must not mention doubles at all, or devices without shaderFloat64 reject them.
+// Includers enable GL_EXT_buffer_reference and GL_EXT_buffer_reference_uvec2 for the work counter.
+
+#include "params.glsl"
+
+// specialization constants, mirrored by KernelConstants in src/mandel.h. A pipeline built with an iteration
+// cap, escape radius and unroll factor baked in gets them folded into its loop by the driver's compiler.
+layout (constant_id = 10) const uint SPEC_MAX_ITERATIONS = 0;
+// squared, since that is what the loop compares |z|^2 against
+layout (constant_id = 11) const float SPEC_ESCAPE_RADIUS2 = 4.0;
+// iterations between escape checks
+layout (constant_id = 12) const uint SPEC_UNROLL = 1;
+// the fragment engine's palette, see Palette in src/mandel.h
+layout (constant_id = 13) const uint SPEC_PALETTE = 0;
+
+// iterations done, as 64-bit counts split over WORK_BUCKETS words pairs so the atomics don't all land on one
+// address; mirrors WorkCounter in src/profiler.h
+const uint WORK_BUCKETS = 64;
+layout (buffer_reference, std430, buffer_reference_align = 8) buffer WorkCounter {
+	uvec2 buckets[WORK_BUCKETS];
+};
+
+// the baked in cap, or the uniform buffer's for pipelines that leave it at 0
+uint iterationCap() {
+	return (SPEC_MAX_ITERATIONS != 0) ? SPEC_MAX_ITERATIONS : maxIterations;
+}
+
+#if defined(PRECISION_F32)
+
+#define real float
+
+real realAdd(real a, real b) { return a + b; }
+real realSub(real a, real b) { return a - b; }
+real realMul(real a, real b) { return a * b; }
+bool realEscaped(real len) { return len >= SPEC_ESCAPE_RADIUS2; }
+bool realInside(real len) { return len < SPEC_ESCAPE_RADIUS2; }
+bool realLessEqual(real a, real b) { return a <= b; }
+float realToFloat(real a) { return a; }
+real realFromFloat(float a) { return a; }
+real realFromParts(uvec2 bits, vec2 ds) { return ds.x; }
+
+real pixelCoord(int axis, float pixelCentre) {
+	return originDS[axis * 2] + stepDS[axis * 2] * pixelCentre;
+}
+
+#elif defined(PRECISION_DS)
+
+// about 48 bits of mantissa out of fp32 arithmetic. Every step is precise: the error terms are
+// exactly the parts a compiler would otherwise reassociate or fuse away.
+#define real vec2
+
+vec2 quickTwoSum(float a, float b) {
+	precise float s = a + b;
+	precise float e = b - (s - a);
+	return vec2(s, e);
+}
+
+vec2 twoSum(float a, float b) {
+	precise float s = a + b;
+	precise float bb = s - a;
+	precise float e = (a - (s - bb)) + (b - bb);
+	return vec2(s, e);
+}
+
+// Veltkamp's split into two 12-bit halves whose products are exact; GLSL's fma() isn't guaranteed
+// to round only once, so Dekker's product can't lean on it
+vec2 split(float a) {
+	precise float t = 4097.0 * a;
+	precise float hi = t - (t - a);
+	precise float lo = a - hi;
+	return vec2(hi, lo);
+}
+
+vec2 twoProd(float a, float b) {
+	precise float p = a * b;
+	vec2 as = split(a);
+	vec2 bs = split(b);
+	precise float e = (((as.x * bs.x) - p) + (as.x * bs.y) + (as.y * bs.x)) + (as.y * bs.y);
+	return vec2(p, e);
+}
+
+real realAdd(real a, real b) {
+	vec2 s = twoSum(a.x, b.x);
+	precise float lo = s.y + (a.y + b.y);
+	return quickTwoSum(s.x, lo);
+}
+
+real realSub(real a, real b) {
+	return realAdd(a, -b);
+}
+
+real realMul(real a, real b) {
+	vec2 p = twoProd(a.x, b.x);
+	precise float lo = p.y + ((a.x * b.y) + (a.y * b.x));
+	return quickTwoSum(p.x, lo);
+}
+
+bool realEscaped(real len) { return len.x >= SPEC_ESCAPE_RADIUS2; }
+bool realInside(real len) { return len.x < SPEC_ESCAPE_RADIUS2; }
+bool realLessEqual(real a, real b) { return a.x < b.x || (a.x == b.x && a.y <= b.y); }
+float realToFloat(real a) { return a.x; }
+real realFromFloat(float a) { return vec2(a, 0.0); }
+real realFromParts(uvec2 bits, vec2 ds) { return ds; }
+
+real pixelCoord(int axis, float pixelCentre) {
+	vec2 origin = vec2(originDS[axis * 2], originDS[axis * 2 + 1]);
+	vec2 step = vec2(stepDS[axis * 2], stepDS[axis * 2 + 1]);
+	return realAdd(origin, realMul(step, vec2(pixelCentre, 0.0)));
+}
+
+#else
+
+// precise so the driver can't fuse anything into FMAs and the counts match the CPU engine bit for bit
+#define real double
+
+real realAdd(real a, real b) { precise double r = a + b; return r; }
+real realSub(real a, real b) { precise double r = a - b; return r; }
+real realMul(real a, real b) { precise double r = a * b; return r; }
+bool realEscaped(real len) { return len >= double(SPEC_ESCAPE_RADIUS2); }
+bool realInside(real len) { return len < double(SPEC_ESCAPE_RADIUS2); }
+bool realLessEqual(real a, real b) { return a <= b; }
+float realToFloat(real a) { return float(a); }
+real realFromFloat(float a) { return double(a); }
+real realFromParts(uvec2 bits, vec2 ds) { return packDouble2x32(bits); }
+
+// pixelCentre is a whole number plus a half, exact in a float
+real pixelCoord(int axis, float pixelCentre) {
+	precise double c = data[axis] + pixelStep[axis] * double(pixelCentre);
+	return c;
+}
+
+#endif
+
+// realFromParts takes a value passed both as a double's raw bits (low word first) and as a hi/lo float
+// pair, and keeps whichever form this tier iterates in. realInside is not just !realEscaped: it is false
+// for the NaNs an unrolled block can run into after escaping.
+
+// inside the main cardioid or the period-2 bulb, where every orbit stays bounded; same operation order as
+// known_interior in src/mandel.cpp
+bool knownInterior(real cx, real cy) {
+	real xq = realSub(cx, realFromFloat(0.25));
+	real y2 = realMul(cy, cy);
+	real q = realAdd(realMul(xq, xq), y2);
+	if (realLessEqual(realMul(q, realAdd(q, xq)), realMul(realFromFloat(0.25), y2)))
+		return true;
+	real xb = realAdd(cx, realFromFloat(1.0));
+	return realLessEqual(realAdd(realMul(xb, xb), y2), realFromFloat(0.0625));
+}
+
+// z = z^2 + c
+void mandelStep(real cx, real cy, inout real x, inout real y) {
+	real re = realSub(realMul(x, x), realMul(y, y));
+	real im = realMul(realAdd(x, x), y);
+	x = realAdd(re, cx);
+	y = realAdd(im, cy);
+}
+
+// Brent's cycle detection: whether z came back to exactly the copy saved at the last doubling interval
+bool cycled(real x, real y, inout real savedX, inout real savedY, inout uint window, inout uint seen) {
+	if (x == savedX && y == savedY)
+		return true;
+	if (++seen == window) {
+		savedX = x;
+		savedY = y;
+		seen = 0;
+		window *= 2;
+	}
+	return false;
+}
+
+// adds the steps one call of iterateSteps took to a bucket picked by its point, when profiling
+void countWork(real cx, real cy, uint steps) {
+	if (workCounter == uvec2(0) || steps == 0)
+		return;
+	uint bucket = ((floatBitsToUint(realToFloat(cx)) * 0x9E3779B1u) ^ floatBitsToUint(realToFloat(cy))) % WORK_BUCKETS;
+	WorkCounter counter = WorkCounter(workCounter);
+	uint before = atomicAdd(counter.buckets[bucket].x, steps);
+	if (before + steps < before)
+		atomicAdd(counter.buckets[bucket].y, 1);
+}
+
+// advances z = x + iy from iteration n until it escapes (returning true, with n the iteration it escaped on
+// and magnitude |z|^2) or n reaches limit. Resumable, so progressive passes can stop and carry on.
+// With FLAG_EARLY_OUT, points known to be interior and orbits that come back to exactly a z they had before
+// (Brent's cycle detection, against a copy saved at doubling intervals) jump straight to n = iterationCap(),
+// which is what iterating them out would have given anyway.
+// With SPEC_UNROLL above 1 the loop runs blocks of that many steps between escape checks. A block that ends
+// outside the radius is rolled back and redone one checked step at a time: past a radius of 2 or more an
+// orbit never comes back inside, so that finds the same n as checking every step would have.
+bool iterateSteps(real cx, real cy, inout real x, inout real y, inout uint n, uint limit, out float magnitude) {
+	magnitude = 0.0;
+	uint cap = iterationCap();
+	bool earlyOut = (flags & FLAG_EARLY_OUT) != 0;
+	if (earlyOut && n == 0 && knownInterior(cx, cy)) {
+		n = cap;
+		return false;
+	}
+
+	uint start = n;
+	real savedX = x;
+	real savedY = y;
+	uint window = 1;
+	uint seen = 0;
+	// checked steps left before going back to blocks
+	uint careful = 0;
+	while (n < limit) {
+		if (SPEC_UNROLL > 1 && careful == 0 && limit - n >= SPEC_UNROLL) {
+			real blockX = x;
+			real blockY = y;
+			for (uint i = 0; i < SPEC_UNROLL; i++)
+				mandelStep(cx, cy, x, y);
+			if (realInside(realAdd(realMul(x, x), realMul(y, y)))) {
+				n += SPEC_UNROLL;
+				if (earlyOut && cycled(x, y, savedX, savedY, window, seen)) {
+					countWork(cx, cy, n - start);
+					n = cap;
+					return false;
+				}
+				continue;
+			}
+			x = blockX;
+			y = blockY;
+			careful = SPEC_UNROLL;
+		}
+
+		mandelStep(cx, cy, x, y);
+		real len = realAdd(realMul(x, x), realMul(y, y));
+		if (realEscaped(len)) {
+			magnitude = realToFloat(len);
+			countWork(cx, cy, n + 1 - start);
+			return true;
+		}
+		n++;
+		if (careful > 0)
+			careful--;
+		if (earlyOut && cycled(x, y, savedX, savedY, window, seen)) {
+			countWork(cx, cy, n - start);
+			n = cap;
+			return false;
+		}
+	}
+	countWork(cx, cy, n - start);
+	return false;
+}
+
+// the iteration the point escapes on, or iterationCap() if it never does, in the same operation order as
+// iterate_mandelbrot in src/mandel.cpp; magnitude gets |z|^2 at escape for smooth shading
+uint iterateMandelbrot(real cx, real cy, out float magnitude) {
+	real x = real(0);
+	real y = real(0);
+	uint n = 0;
+	uint cap = iterationCap();
+	if (iterateSteps(cx, cy, x, y, n, cap, magnitude))
+		return n;
+	return cap;
+}
+
+// z as raw bits, so one state buffer layout serves every tier
+#if defined(PRECISION_F32)
+uvec4 packState(real x, real y) { return uvec4(floatBitsToUint(x), floatBitsToUint(y), 0, 0); }
+void unpackState(uvec4 s, out real x, out real y) { x = uintBitsToFloat(s.x); y = uintBitsToFloat(s.y); }
+#elif defined(PRECISION_DS)
+uvec4 packState(real x, real y) { return uvec4(floatBitsToUint(x), floatBitsToUint(y)); }
+void unpackState(uvec4 s, out real x, out real y) { x = uintBitsToFloat(s.xy); y = uintBitsToFloat(s.zw); }
+#else
+uvec4 packState(real x, real y) { return uvec4(unpackDouble2x32(x), unpackDouble2x32(y)); }
+void unpackState(uvec4 s, out real x, out real y) { x = packDouble2x32(s.xy); y = packDouble2x32(s.zw); }
+#endif
+
+// the fragment engine's palette, the same curves fill_palette_lut in src/mandel.cpp samples for
+// colorize.comp; points that never escape come out black
+vec4 fragmentPalette(uint n) {
+	uint cap = iterationCap();
+	if (n >= cap)
+		return vec4(0.0, 0.0, 0.0, 1.0);
+
+	float it = float(n) / cap;
+	vec3 c;
+	if (SPEC_PALETTE == 1)
+		c = vec3(3.0 * it, 3.0 * it - 1.0, 3.0 * it - 2.0);
+	else if (SPEC_PALETTE == 2)
+		c = 0.5 + 0.5 * cos(6.28318531 * (it + vec3(0.0, 0.1, 0.2)));
+	else if (SPEC_PALETTE == 3)
+		c = vec3(it);
+	else
+		c = vec3(
+			pow(it, 3.0),
+			(it - pow(it * 0.9, 3.0) - pow(it * 0.88, 10.0)) * 0.75,
+			(pow(it, 1.0/2) - pow(it, 3.0) - pow(it, 10.0)) * 0.5
+		);
+	return vec4(clamp(c, 0.0, 1.0), 1.0);
+}
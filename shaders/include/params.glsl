@@ -0,0 +1,32 @@
+// the UniformBufferObject block, mirroring MandelParams in src/mandel.h. Modules built without fp64
+// (the f32 and ds tiers, or anything defining PARAMS_WITHOUT_DOUBLES) see the double fields as raw bits.
+
+layout (set=0, binding=0) uniform UniformBufferObject {
+#if defined(PRECISION_F32) || defined(PRECISION_DS) || defined(PARAMS_WITHOUT_DOUBLES)
+	// data and pixelStep, as raw bits
+	uvec4 doubleData[2];
+	uvec4 doublePixelStep;
+#else
+	dvec4 data;
+	dvec2 pixelStep;
+#endif
+	uvec2 extent;
+	uint maxIterations;
+	uint flags;
+	// data.xy and pixelStep as hi/lo float pairs: x hi, x lo, y hi, y lo
+	vec4 originDS;
+	vec4 stepDS;
+	// colorize.comp's settings, see ColorSettings
+	uint palette;
+	float paletteOffset;
+	float paletteScale;
+	// the iteration pipelines' SPEC_ESCAPE_RADIUS2, for smooth shading
+	float escapeRadius2;
+	// device address of the profiler's WorkCounter buckets, 0 when not profiling
+	uvec2 workCounter;
+};
+
+const uint FLAG_EQUALIZE = 1;
+const uint FLAG_SMOOTH = 2;
+const uint FLAG_EARLY_OUT = 4;
+
@@ -0,0 +1,319 @@
+#include <stdio.h>
+
+#include <algorithm>
+#include <iterator>
+#include <iostream>
+
+#include "render.h"
+#include "allocator.h"
+
+// small enough that the 256MB host visible device local heap some discrete GPUs have still fits a few
+static const VkDeviceSize BLOCK_SIZE = 64ull << 20;
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static VkDeviceSize block_size(const Allocator& allocator, uint32_t type) {
+	VkDeviceSize heap = allocator.properties.memoryHeaps[allocator.properties.memoryTypes[type].heapIndex].size;
+	return std::min(BLOCK_SIZE, align_up(heap / 8, allocator.non_coherent_atom));
+}
+
+void create_allocator(Init& init, bool memory_budget) {
+	Allocator& allocator = init.allocator;
+	vkGetPhysicalDeviceMemoryProperties(init.physical_device, &allocator.properties);
+	allocator.non_coherent_atom = init.physical_device.properties.limits.nonCoherentAtomSize;
+	allocator.max_allocations = init.physical_device.properties.limits.maxMemoryAllocationCount;
+	allocator.budget = memory_budget;
+}
+
+void destroy_allocator(Init& init) {
+	for (MemoryBlock& block : init.allocator.blocks) {
+		if (block.memory != VK_NULL_HANDLE)
+			init.disp.freeMemory(block.memory, nullptr);
+	}
+	init.allocator.blocks.clear();
+	init.allocator.live_blocks = 0;
+}
+
+static int new_block(Init& init, uint32_t type, bool image, bool dedicated, VkDeviceSize size, uint32_t& index) {
+	Allocator& allocator = init.allocator;
+	if (allocator.live_blocks >= allocator.max_allocations)
+		return -1;
+
+	// the profiler hands the shaders a device address of its counters, and any buffer might be next
+	VkMemoryAllocateFlagsInfo flags = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+		.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+	};
+	VkMemoryAllocateInfo alloc_info = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.pNext = image ? nullptr : &flags,
+		.allocationSize = size,
+		.memoryTypeIndex = type,
+	};
+	VkDeviceMemory memory;
+	if (init.disp.allocateMemory(&alloc_info, nullptr, &memory) != VK_SUCCESS)
+		return -1;
+
+	void* mapped = nullptr;
+	if ((allocator.properties.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+			init.disp.mapMemory(memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+		init.disp.freeMemory(memory, nullptr);
+		return -1;
+	}
+
+	index = 0;
+	while (index < allocator.blocks.size() && allocator.blocks[index].memory != VK_NULL_HANDLE)
+		index++;
+	if (index == allocator.blocks.size())
+		allocator.blocks.emplace_back();
+
+	MemoryBlock& block = allocator.blocks[index];
+	block.memory = memory;
+	block.type = type;
+	block.image = image;
+	block.dedicated = dedicated;
+	block.size = size;
+	block.used = 0;
+	block.mapped = mapped;
+	block.free_ranges.clear();
+	block.free_ranges[0] = size;
+	allocator.live_blocks++;
+	return 0;
+}
+
+// first fit; the range's leading padding stays free on its own
+static bool take_range(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) {
+	for (auto range = block.free_ranges.begin(); range != block.free_ranges.end(); ++range) {
+		VkDeviceSize start = range->first;
+		VkDeviceSize end = start + range->second;
+		VkDeviceSize aligned = align_up(start, alignment);
+		if (aligned + size > end)
+			continue;
+
+		block.free_ranges.erase(range);
+		if (aligned > start)
+			block.free_ranges[start] = aligned - start;
+		if (aligned + size < end)
+			block.free_ranges[aligned + size] = end - aligned - size;
+		block.used += size;
+		offset = aligned;
+		return true;
+	}
+	return false;
+}
+
+static int find_type(const Allocator& allocator, uint32_t type_bits, VkMemoryPropertyFlags properties, uint32_t& type) {
+	for (type = 0; type < allocator.properties.memoryTypeCount; type++) {
+		if ((type_bits & (1u << type)) && (allocator.properties.memoryTypes[type].propertyFlags & properties) == properties)
+			return 0;
+	}
+	return -1;
+}
+
+int allocate_memory(Init& init, const VkMemoryRequirements& memreq, VkMemoryPropertyFlags properties, bool image, Allocation& allocation) {
+	Allocator& allocator = init.allocator;
+	uint32_t type;
+	if (0 != find_type(allocator, memreq.memoryTypeBits, properties, type))
+		return -1;
+
+	VkMemoryPropertyFlags flags = allocator.properties.memoryTypes[type].propertyFlags;
+	bool coherent = !(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) || (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	// invalidating one allocation must not reach into its neighbours' atoms
+	VkDeviceSize alignment = memreq.alignment;
+	VkDeviceSize size = memreq.size;
+	if (!coherent) {
+		alignment = std::max(alignment, allocator.non_coherent_atom);
+		size = align_up(size, allocator.non_coherent_atom);
+	}
+
+	uint32_t index = UINT32_MAX;
+	VkDeviceSize offset = 0;
+	if (size > block_size(allocator, type)) {
+		if (0 != new_block(init, type, image, true, size, index))
+			return -1;
+		take_range(allocator.blocks[index], size, alignment, offset);
+	} else {
+		for (uint32_t i = 0; i < allocator.blocks.size(); i++) {
+			MemoryBlock& block = allocator.blocks[i];
+			if (block.memory != VK_NULL_HANDLE && !block.dedicated && block.type == type && block.image == image &&
+					take_range(block, size, alignment, offset)) {
+				index = i;
+				break;
+			}
+		}
+		if (index == UINT32_MAX) {
+			if (0 != new_block(init, type, image, false, block_size(allocator, type), index))
+				return -1;
+			take_range(allocator.blocks[index], size, alignment, offset);
+		}
+	}
+
+	const MemoryBlock& block = allocator.blocks[index];
+	allocation.memory = block.memory;
+	allocation.offset = offset;
+	allocation.size = size;
+	allocation.mapped = block.mapped == nullptr ? nullptr : (char*) block.mapped + offset;
+	allocation.coherent = coherent;
+	allocation.block = index;
+	return 0;
+}
+
+int allocate_buffer_memory(Init& init, VkBuffer buffer, VkMemoryPropertyFlags properties, Allocation& allocation) {
+	VkMemoryRequirements memreq;
+	init.disp.getBufferMemoryRequirements(buffer, &memreq);
+	if (0 != allocate_memory(init, memreq, properties, false, allocation))
+		return -1;
+	if (init.disp.bindBufferMemory(buffer, allocation.memory, allocation.offset) != VK_SUCCESS) {
+		free_memory(init, allocation);
+		return -1;
+	}
+	return 0;
+}
+
+int allocate_image_memory(Init& init, VkImage image, VkMemoryPropertyFlags properties, Allocation& allocation) {
+	VkMemoryRequirements memreq;
+	init.disp.getImageMemoryRequirements(image, &memreq);
+	if (0 != allocate_memory(init, memreq, properties, true, allocation))
+		return -1;
+	if (init.disp.bindImageMemory(image, allocation.memory, allocation.offset) != VK_SUCCESS) {
+		free_memory(init, allocation);
+		return -1;
+	}
+	return 0;
+}
+
+static void free_block(Init& init, MemoryBlock& block) {
+	init.disp.freeMemory(block.memory, nullptr);
+	block.memory = VK_NULL_HANDLE;
+	block.free_ranges.clear();
+	init.allocator.live_blocks--;
+}
+
+void free_memory(Init& init, Allocation& allocation) {
+	if (allocation.memory == VK_NULL_HANDLE)
+		return;
+	Allocator& allocator = init.allocator;
+	MemoryBlock& block = allocator.blocks[allocation.block];
+	block.used -= allocation.size;
+
+	// merge with the free ranges either side
+	VkDeviceSize start = allocation.offset;
+	VkDeviceSize size = allocation.size;
+	auto next = block.free_ranges.lower_bound(start);
+	if (next != block.free_ranges.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == start) {
+			start = prev->first;
+			size += prev->second;
+			block.free_ranges.erase(prev);
+		}
+	}
+	if (next != block.free_ranges.end() && start + size == next->first) {
+		size += next->second;
+		block.free_ranges.erase(next);
+	}
+	block.free_ranges[start] = size;
+	allocation = {};
+
+	if (block.used != 0)
+		return;
+	if (block.dedicated) {
+		free_block(init, block);
+		return;
+	}
+	// one empty block per type and kind stays, for whatever a resize allocates next
+	for (const MemoryBlock& other : allocator.blocks) {
+		if (&other != &block && other.memory != VK_NULL_HANDLE && !other.dedicated && other.used == 0 &&
+				other.type == block.type && other.image == block.image) {
+			free_block(init, block);
+			return;
+		}
+	}
+}
+
+void invalidate_allocation(Init& init, const Allocation& allocation) {
+	if (allocation.coherent || allocation.mapped == nullptr)
+		return;
+	// allocate_memory keeps non-coherent allocations to whole atoms
+	VkMappedMemoryRange range = {
+		.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+		.memory = allocation.memory,
+		.offset = allocation.offset,
+		.size = allocation.size,
+	};
+	init.disp.invalidateMappedMemoryRanges(1, &range);
+}
+
+int create_uniform_ring(Init& init, UniformRing& ring, VkDeviceSize range, uint32_t count) {
+	VkDeviceSize alignment = init.physical_device.properties.limits.minUniformBufferOffsetAlignment;
+	ring.stride = align_up(range, alignment);
+	ring.range = range;
+	ring.count = count;
+
+	VkBufferCreateInfo buffer_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = ring.stride * count,
+		.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	if (init.disp.createBuffer(&buffer_info, nullptr, &ring.buffer) != VK_SUCCESS) {
+		std::cout << "failed to create the uniform buffer\n";
+		return -1;
+	}
+	if (0 != allocate_buffer_memory(init, ring.buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, ring.memory)) {
+		std::cout << "failed to allocate memory for the uniform buffer\n";
+		return -1;
+	}
+	// a command buffer can read a slot before draw_frame first fills it, and a stray work_counter would be
+	// written through
+	memset(ring.memory.mapped, 0, ring.stride * count);
+	return 0;
+}
+
+void destroy_uniform_ring(Init& init, UniformRing& ring) {
+	init.disp.destroyBuffer(ring.buffer, nullptr);
+	ring.buffer = VK_NULL_HANDLE;
+	free_memory(init, ring.memory);
+}
+
+static double megabytes(VkDeviceSize bytes) {
+	return (double) bytes / (1 << 20);
+}
+
+void report_memory(Init& init, const char* title) {
+	const Allocator& allocator = init.allocator;
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+	};
+	VkPhysicalDeviceMemoryProperties2 properties = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+		.pNext = &budget,
+	};
+	if (allocator.budget)
+		init.inst_disp.getPhysicalDeviceMemoryProperties2(init.physical_device, &properties);
+
+	printf("%s memory: %u of %u allocations\n", title, allocator.live_blocks, allocator.max_allocations);
+	for (uint32_t heap = 0; heap < allocator.properties.memoryHeapCount; heap++) {
+		uint32_t blocks = 0;
+		VkDeviceSize allocated = 0, used = 0;
+		for (const MemoryBlock& block : allocator.blocks) {
+			if (block.memory == VK_NULL_HANDLE || allocator.properties.memoryTypes[block.type].heapIndex != heap)
+				continue;
+			blocks++;
+			allocated += block.size;
+			used += block.used;
+		}
+
+		bool device_local = allocator.properties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+		printf("  heap %u%s: %u blocks, %.1fMB allocated, %.1fMB used", heap, device_local ? " (device local)" : "",
+			blocks, megabytes(allocated), megabytes(used));
+		if (allocator.budget)
+			printf(", process usage %.1fMB of %.1fMB budget", megabytes(budget.heapUsage[heap]), megabytes(budget.heapBudget[heap]));
+		else
+			printf(", heap %.1fMB", megabytes(allocator.properties.memoryHeaps[heap].size));
+		printf("\n");
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+struct Init;
+
+// a range of one of the allocator's VkDeviceMemory blocks, bound like any other memory at offset
+struct Allocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	// host visible memory stays mapped for as long as its block lives; nullptr otherwise
+	void* mapped = nullptr;
+	// host visible without HOST_COHERENT, so reads need invalidate_allocation first
+	bool coherent = true;
+	uint32_t block = 0;
+};
+
+// one vkAllocateMemory, carved up first fit. Buffers and images keep to separate blocks, so
+// bufferImageGranularity never comes into it.
+struct MemoryBlock {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	uint32_t type;
+	bool image;
+	// one allocation too big for a shared block, freed with it
+	bool dedicated;
+	VkDeviceSize size;
+	VkDeviceSize used;
+	void* mapped;
+	// offset to size, merged with their neighbours as they come back
+	std::map<VkDeviceSize, VkDeviceSize> free_ranges;
+};
+
+// suballocates everything the renderer needs from a handful of large blocks per memory type, rather than one
+// vkAllocateMemory per buffer, which maxMemoryAllocationCount caps at as few as 4096. Freed ranges go back
+// to their block and an empty block is kept per type and kind, so resizes reuse the same memory.
+struct Allocator {
+	VkPhysicalDeviceMemoryProperties properties;
+	VkDeviceSize non_coherent_atom;
+	uint32_t max_allocations;
+	// VK_EXT_memory_budget, for report_memory
+	bool budget = false;
+
+	// freed blocks leave VK_NULL_HANDLE slots, which new ones reuse so Allocation::block stays valid
+	std::vector<MemoryBlock> blocks;
+	uint32_t live_blocks = 0;
+};
+
+void create_allocator(Init& init, bool memory_budget);
+// frees every block, whether or not everything in it was freed
+void destroy_allocator(Init& init);
+
+// memory of the first type with every one of properties; -1 without printing anything when there is no such
+// type or no memory left, so callers can fall back to other properties
+int allocate_memory(Init& init, const VkMemoryRequirements& memreq, VkMemoryPropertyFlags properties, bool image, Allocation& allocation);
+// the same for a buffer or image, bound to it
+int allocate_buffer_memory(Init& init, VkBuffer buffer, VkMemoryPropertyFlags properties, Allocation& allocation);
+int allocate_image_memory(Init& init, VkImage image, VkMemoryPropertyFlags properties, Allocation& allocation);
+// returns the range to its block and clears allocation; does nothing for an empty one
+void free_memory(Init& init, Allocation& allocation);
+
+// the per frame in flight uniform data, in slots of one persistently mapped buffer
+struct UniformRing {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	Allocation memory;
+	// the uniform data's size, rounded up to minUniformBufferOffsetAlignment
+	VkDeviceSize stride = 0;
+	VkDeviceSize range = 0;
+	uint32_t count = 0;
+};
+
+// count slots of range bytes each, zeroed; -1 with a message when there is no host visible memory for them
+int create_uniform_ring(Init& init, UniformRing& ring, VkDeviceSize range, uint32_t count);
+void destroy_uniform_ring(Init& init, UniformRing& ring);
+
+inline VkDescriptorBufferInfo uniform_descriptor(const UniformRing& ring, uint32_t slot) {
+	return { ring.buffer, slot * ring.stride, ring.range };
+}
+
+inline void* uniform_mapped(const UniformRing& ring, uint32_t slot) {
+	return (char*) ring.memory.mapped + slot * ring.stride;
+}
+
+// makes device writes to a non-coherent allocation visible to the host
+void invalidate_allocation(Init& init, const Allocation& allocation);
+
+// blocks, allocated and used bytes per heap, against the heap budget when VK_EXT_memory_budget is there
+void report_memory(Init& init, const char* title);
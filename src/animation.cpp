@@ -0,0 +1,179 @@
+#include <math.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "animation.h"
+#include "headless.h"
+#include "readback.h"
+#include "image_write.h"
+#include "cpu_engine.h"
+
+View animation_view(const std::vector<Keyframe>& keyframes, uint32_t frame) {
+	size_t k = 0;
+	while (k + 1 < keyframes.size() && keyframes[k + 1].frame <= frame)
+		k++;
+	const View& a = keyframes[k].view;
+	if (k + 1 == keyframes.size() || frame <= keyframes[k].frame)
+		return a;
+	const View& b = keyframes[k + 1].view;
+
+	double u = (double) (frame - keyframes[k].frame) / (keyframes[k + 1].frame - keyframes[k].frame);
+	View view;
+	view.size = a.size * pow(b.size / a.size, u);
+	// how much of the way the size has come; a keyframe pair of one size is a plain pan
+	double t = a.size != b.size ? (a.size - view.size) / (a.size - b.size) : u;
+	for (int axis = 0; axis < 2; axis++)
+		view.center[axis] = a.center[axis] + (b.center[axis] - a.center[axis]) * t;
+	return view;
+}
+
+static void animation_edges(const Options& options, uint32_t frame, double edges[4]) {
+	view_edges(animation_view(options.keyframes, frame), options.width, options.height, edges);
+}
+
+static void print_animation(const VideoSink& sink, const Options& options, double ms) {
+	printf("%s: %u frames of %ux%u in %.2fms, %.1f per second\n", sink.filename.c_str(), sink.frames,
+		options.width, options.height, ms, sink.frames * 1000.0 / ms);
+}
+
+int run_animation(Init& init, RenderData& data, const Options& options) {
+	uint32_t first = options.keyframes.front().frame;
+	uint32_t count = options.keyframes.back().frame - first + 1;
+	VkExtent2D extent = { options.width, options.height };
+
+	Engine engine = options.engine;
+	if (engine == ENGINE_AUTO) {
+		double edges[4];
+		animation_edges(options, first, edges);
+		engine = pick_engine(init, data, OFFSCREEN_FORMAT, extent, edges);
+	}
+	data.engine = engine;
+
+	Readback readback;
+	if (0 != create_readback(init, data, readback, extent)) {
+		destroy_readback(init, data, readback);
+		return -1;
+	}
+	readback.cached = engine == ENGINE_COMPUTE && data.tile_cache.capacity > 0;
+
+	VideoSink sink;
+	if (0 != open_video_sink(sink, options.output, options.width, options.height, options.fps)) {
+		destroy_readback(init, data, readback);
+		return -1;
+	}
+
+	// the same ring as a batch of views: frame i is written once frame i + READBACK_SLOTS - 1 is submitted
+	int res = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < count + READBACK_SLOTS - 1 && res == 0; i++) {
+		if (i < count) {
+			double edges[4];
+			animation_edges(options, first + (uint32_t) i, edges);
+			res = readback_submit(init, data, readback, (uint32_t) (i % READBACK_SLOTS), engine, edges);
+		}
+		if (res != 0 || i < READBACK_SLOTS - 1 || i - (READBACK_SLOTS - 1) >= count)
+			continue;
+
+		size_t done = i - (READBACK_SLOTS - 1);
+		uint32_t slot = (uint32_t) (done % READBACK_SLOTS);
+		if (0 != readback_wait(init, readback, slot) ||
+				0 != write_video_frame(sink, (const uint8_t*) readback.slots[slot].staging_memory.mapped)) {
+			res = -1;
+			break;
+		}
+		if ((done + 1) % options.fps == 0)
+			printf("frame %zu of %u\n", done + 1, count);
+	}
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	destroy_readback(init, data, readback);
+	if (0 != close_video_sink(sink))
+		res = -1;
+	if (res != 0)
+		return -1;
+
+	print_animation(sink, options, elapsed.count());
+	if (readback.cached) {
+		TileCache& cache = data.tile_cache;
+		printf("tile cache: %llu tiles iterated, %llu reused\n", (unsigned long long) cache.misses, (unsigned long long) cache.hits);
+		if (!cache.store.dir.empty()) {
+			flush_tile_store(init, cache);
+			printf("tile store: %llu tiles loaded, %llu saved, %zu left unsaved\n", (unsigned long long) cache.store.loads,
+				(unsigned long long) cache.store.saves, cache.store_backlog.size());
+		}
+	}
+	return 0;
+}
+
+int run_animation_cpu(const Options& options) {
+	CpuEngine cpu;
+	if (0 != cpu_engine_init(cpu, options)) return -1;
+	std::cout << "Using " << cpu.threads << " threads with " << cpu_isa_name(cpu.isa) << " kernels" << std::endl;
+
+	uint32_t first = options.keyframes.front().frame;
+	uint32_t count = options.keyframes.back().frame - first + 1;
+	size_t pixels = (size_t) options.width * options.height;
+	CpuFrame frames[2];
+	// one frame is written out while the next renders
+	std::vector<uint8_t> rgba[2] = { std::vector<uint8_t>(pixels * 4), std::vector<uint8_t>(pixels * 4) };
+	std::vector<uint32_t> palette;
+	build_palette(options.max_iterations, options.color.palette, palette);
+
+	VideoSink sink;
+	if (0 != open_video_sink(sink, options.output, options.width, options.height, options.fps))
+		return -1;
+
+	int res = 0;
+	int written = 0;
+	std::thread writer;
+	uint64_t iterated = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < count; i++) {
+		double edges[4];
+		animation_edges(options, first + i, edges);
+		MandelParams params;
+		fill_params(params, edges, options.width, options.height, options.max_iterations);
+		if (options.early_out)
+			params.flags |= MANDEL_FLAG_EARLY_OUT;
+
+		CpuFrame& current = frames[i % 2];
+		if (options.reproject) {
+			iterated += cpu_render_reprojected(cpu, params, frames[(i + 1) % 2], current);
+		} else {
+			current.iterations.resize(pixels);
+			cpu_render(cpu, params, current.iterations.data());
+			iterated += pixels;
+		}
+		std::vector<uint8_t>& frame = rgba[i % 2];
+		colorize(current.iterations.data(), pixels, palette, frame.data());
+
+		if (writer.joinable())
+			writer.join();
+		if (written != 0) {
+			res = -1;
+			break;
+		}
+		writer = std::thread([&sink, &frame, &written]() { written = write_video_frame(sink, frame.data()); });
+		if ((i + 1) % options.fps == 0)
+			printf("frame %u of %u\n", i + 1, count);
+	}
+	if (writer.joinable())
+		writer.join();
+	if (written != 0)
+		res = -1;
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	if (0 != close_video_sink(sink))
+		res = -1;
+	if (res != 0)
+		return -1;
+
+	print_animation(sink, options, elapsed.count());
+	if (options.reproject)
+		printf("iterated %.1f%% of the pixels, the rest were reprojected from the frame before\n", 100.0 * iterated / ((double) pixels * count));
+	return 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "options.h"
+
+struct Init;
+struct RenderData;
+
+// the view on frame: the size changes exponentially between keyframes, so the zoom looks steady, and the centre
+// moves in step with it, so the one point that sits at the same place on screen at both keyframes holds still
+View animation_view(const std::vector<Keyframe>& keyframes, uint32_t frame);
+
+// renders every frame of options.keyframes through the readback ring and streams them to options.output. The
+// compute engine draws frames from the tile cache, when --cache-mb leaves it one, which iterates each zoom level
+// once for all the frames that pass through it.
+int run_animation(Init& init, RenderData& data, const Options& options);
+// the same on the cpu engine, reprojecting each frame from the one before, without initialising Vulkan
+int run_animation_cpu(const Options& options);
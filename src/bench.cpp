@@ -0,0 +1,317 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "headless.h"
+#include "cpu_engine.h"
+#include "bench.h"
+
+struct NamedView {
+	const char* name;
+	const char* center[2];
+	double size;
+};
+
+// all inside double precision, so the f64 tier and the cpu engine draw every one of them exactly
+static const NamedView NAMED_VIEWS[] = {
+	{ "full",      { "-0.5", "0" }, 3.0 },
+	{ "seahorse",  { "-0.745", "0.113" }, 0.01 },
+	{ "elephant",  { "0.285", "0.0113" }, 0.012 },
+	// the period 13 minibrot on the real axis near the tip, about 2^-23 wide
+	{ "minibrot",  { "-1.9999027031450523", "0" }, 1e-7 },
+	// almost all main cardioid, which the early outs skip and plain iteration runs to the cap
+	{ "interior",  { "-0.2", "0" }, 0.6 },
+};
+
+std::vector<View> bench_views(const Options& options) {
+	std::vector<View> views = options.views;
+	for (size_t i = 0; i < views.size(); i++) {
+		if (views[i].name.empty())
+			views[i].name = "view" + std::to_string(i);
+	}
+	if (!views.empty())
+		return views;
+
+	for (const NamedView& named : NAMED_VIEWS) {
+		View view;
+		view.center[0] = strtod(named.center[0], nullptr);
+		view.center[1] = strtod(named.center[1], nullptr);
+		view.size = named.size;
+		view.center_text[0] = named.center[0];
+		view.center_text[1] = named.center[1];
+		view.name = named.name;
+		views.push_back(view);
+	}
+	return views;
+}
+
+static std::string nominal_key(const View& view, uint32_t width, uint32_t height, uint32_t max_iterations) {
+	return view.name + "@" + std::to_string(width) + "x" + std::to_string(height) + "/" + std::to_string(max_iterations);
+}
+
+static void bench_params(const Options& options, const View& view, uint32_t width, uint32_t height, uint32_t max_iterations, MandelParams& params) {
+	double edges[4];
+	view_edges(view, width, height, edges);
+	fill_params(params, edges, width, height, max_iterations);
+	apply_color(params, options.color);
+	if (options.early_out)
+		params.flags |= MANDEL_FLAG_EARLY_OUT;
+}
+
+static uint64_t sum_iterations(const std::vector<uint32_t>& iterations) {
+	uint64_t sum = 0;
+	for (uint32_t n : iterations)
+		sum += n;
+	return sum;
+}
+
+// one untimed render first, for page faults, pipeline warm-up and the like
+template <typename Render>
+static int time_runs(uint32_t runs, BenchResult& result, Render render) {
+	if (0 != render())
+		return -1;
+	for (uint32_t i = 0; i < runs; i++) {
+		auto start = std::chrono::steady_clock::now();
+		if (0 != render())
+			return -1;
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		result.ms.push_back(elapsed.count());
+	}
+	std::sort(result.ms.begin(), result.ms.end());
+	return 0;
+}
+
+static void print_result(const BenchResult& result) {
+	double median = result.ms[result.ms.size() / 2];
+	printf("%-9s %4ux%-4u %6u  %-8s %-6s %9.2fms %9.1f Mpix/s %8.3f Giter/s%s\n",
+		result.view.c_str(), result.width, result.height, result.max_iterations, result.engine, result.variant,
+		median, (double) result.width * result.height / (median * 1000.0), (double) result.iterations / (median * 1e6),
+		result.exact ? "" : " (inexact)");
+}
+
+int bench_cpu(const Options& options, BenchReport& report) {
+	if (options.engine != ENGINE_CPU && options.engine != ENGINE_AUTO)
+		return 0;
+
+	std::vector<CpuIsa> isas;
+	if (options.cpu_isa == CPU_ISA_AUTO) {
+		for (int isa = CPU_ISA_SCALAR; isa <= cpu_best_isa(); isa++)
+			isas.push_back((CpuIsa) isa);
+	} else {
+		isas.push_back(options.cpu_isa);
+	}
+
+	std::vector<View> views = bench_views(options);
+	for (CpuIsa isa : isas) {
+		Options isa_options = options;
+		isa_options.cpu_isa = isa;
+		CpuEngine cpu;
+		if (0 != cpu_engine_init(cpu, isa_options))
+			return -1;
+		report.cpu_threads = cpu.threads;
+
+		for (const BenchSize& size : options.bench_sizes) {
+			size_t pixels = (size_t) size.width * size.height;
+			std::vector<uint32_t> iterations(pixels);
+			std::vector<uint8_t> rgba(pixels * 4);
+
+			for (uint32_t max_iterations : options.bench_iterations) {
+				std::vector<uint32_t> palette;
+				build_palette(max_iterations, options.color.palette, palette);
+
+				for (const View& view : views) {
+					MandelParams params;
+					bench_params(options, view, size.width, size.height, max_iterations, params);
+
+					BenchResult result = { view.name, engine_name(ENGINE_CPU), cpu_isa_name(isa), size.width, size.height, max_iterations, true };
+					int res = time_runs(options.bench_runs, result, [&]() {
+						cpu_render(cpu, params, iterations.data());
+						colorize(iterations.data(), pixels, palette, rgba.data());
+						return 0;
+					});
+					if (res != 0)
+						return -1;
+
+					std::string key = nominal_key(view, size.width, size.height, max_iterations);
+					if (report.nominal.count(key) == 0)
+						report.nominal[key] = sum_iterations(iterations);
+					result.iterations = report.nominal[key];
+					print_result(result);
+					report.results.push_back(result);
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+// the cpu engine's count when it ran, otherwise one untimed render of its own
+static uint64_t nominal_iterations(BenchReport& report, const CpuEngine& cpu, const MandelParams& params, const std::string& key) {
+	auto found = report.nominal.find(key);
+	if (found != report.nominal.end())
+		return found->second;
+
+	std::vector<uint32_t> iterations((size_t) params.extent[0] * params.extent[1]);
+	cpu_render(cpu, params, iterations.data());
+	uint64_t sum = sum_iterations(iterations);
+	report.nominal[key] = sum;
+	return sum;
+}
+
+int bench_gpu(Init& init, RenderData& data, const Options& options, BenchReport& report) {
+	std::vector<Engine> engines;
+	if (options.engine == ENGINE_AUTO) {
+		engines = { ENGINE_FRAGMENT, ENGINE_COMPUTE };
+		// the deep engine iterates double deltas
+		if (init.shader_float64)
+			engines.push_back(ENGINE_DEEP);
+	} else if (options.engine != ENGINE_CPU) {
+		engines.push_back(options.engine);
+	}
+	if (engines.empty())
+		return 0;
+	report.device = init.physical_device.name;
+
+	std::vector<Precision> tiers;
+	for (int p = 0; p < PRECISION_COUNT; p++) {
+		if ((options.precision == PRECISION_AUTO || options.precision == p) && (p != PRECISION_F64 || init.shader_float64))
+			tiers.push_back((Precision) p);
+	}
+
+	CpuEngine cpu;
+	if (0 != cpu_engine_init(cpu, options))
+		return -1;
+
+	std::vector<View> views = bench_views(options);
+	int res = 0;
+	for (const BenchSize& size : options.bench_sizes) {
+		VkExtent2D extent = { size.width, size.height };
+
+		// the compute engine's targets, and so the deep engine's bindings to them, have to match the render size
+		destroy_deep_pipeline(init, data.deep);
+		destroy_compute_targets(init, data.compute);
+		if (0 != create_compute_targets(init, data.compute, extent)) return -1;
+		bind_colorizer_targets(init, data.colorizer, data.compute);
+		if (std::find(engines.begin(), engines.end(), ENGINE_DEEP) != engines.end() &&
+				0 != create_deep_pipeline(init, data.deep, options, data.compute))
+			return -1;
+
+		Offscreen target;
+		if (0 != create_offscreen(init, data, target, size.width, size.height, OFFSCREEN_FORMAT)) {
+			destroy_offscreen(init, target);
+			return -1;
+		}
+
+		for (uint32_t max_iterations : options.bench_iterations) {
+			data.max_iterations = max_iterations;
+
+			for (const View& view : views) {
+				MandelParams params;
+				bench_params(options, view, size.width, size.height, max_iterations, params);
+				std::string key = nominal_key(view, size.width, size.height, max_iterations);
+				uint64_t iterations = nominal_iterations(report, cpu, params, key);
+				double edges[4];
+				view_edges(view, size.width, size.height, edges);
+
+				for (Engine engine : engines) {
+					// the deep engine has one tier of its own
+					std::vector<Precision> engine_tiers = tiers;
+					if (engine == ENGINE_DEEP)
+						engine_tiers = { PRECISION_F64 };
+
+					for (Precision tier : engine_tiers) {
+						data.precision_mode = tier;
+						data.precision = tier;
+						if (0 != set_offscreen_engine(init, data, target, engine)) {
+							res = -1;
+							break;
+						}
+
+						bool exact = engine == ENGINE_DEEP || precision_bits_needed(params) <= precision_bits(tier);
+						BenchResult result = { view.name, engine_name(engine), precision_name(tier), size.width, size.height, max_iterations, exact };
+						result.iterations = iterations;
+						res = time_runs(options.bench_runs, result, [&]() {
+							if (engine == ENGINE_DEEP && 0 != render_deep(init, data, view))
+								return -1;
+							return render_offscreen(init, data, target, edges);
+						});
+						if (res != 0)
+							break;
+						print_result(result);
+						report.results.push_back(result);
+					}
+					if (res != 0)
+						break;
+				}
+				if (res != 0)
+					break;
+			}
+			if (res != 0)
+				break;
+		}
+
+		destroy_offscreen(init, target);
+		if (res != 0)
+			return -1;
+	}
+	return 0;
+}
+
+// nearest rank
+static double percentile(const std::vector<double>& sorted, double p) {
+	size_t rank = (size_t) ceil(p / 100.0 * sorted.size());
+	return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+static void write_string(FILE* file, const std::string& text) {
+	fputc('"', file);
+	for (char c : text) {
+		if (c == '"' || c == '\\')
+			fputc('\\', file);
+		fputc(c, file);
+	}
+	fputc('"', file);
+}
+
+int write_bench(const BenchReport& report, const Options& options) {
+	FILE* file = fopen(options.bench_output.c_str(), "w");
+	if (file == nullptr) {
+		std::cout << "could not open " << options.bench_output << " for writing\n";
+		return -1;
+	}
+
+	fprintf(file, "{\n  \"device\": ");
+	write_string(file, report.device);
+	fprintf(file, ",\n  \"cpu_threads\": %u,\n  \"runs\": %u,\n  \"early_out\": %s,\n  \"results\": [",
+		report.cpu_threads, options.bench_runs, options.early_out ? "true" : "false");
+	for (size_t i = 0; i < report.results.size(); i++) {
+		const BenchResult& result = report.results[i];
+		double mean = 0;
+		for (double ms : result.ms)
+			mean += ms;
+		mean /= result.ms.size();
+		double median = percentile(result.ms, 50);
+		double pixels = (double) result.width * result.height;
+
+		fprintf(file, "%s\n    { \"view\": ", i == 0 ? "" : ",");
+		write_string(file, result.view);
+		fprintf(file, ", \"engine\": \"%s\", \"variant\": \"%s\", \"width\": %u, \"height\": %u, \"max_iterations\": %u, \"exact\": %s,"
+			" \"iterations\": %llu, \"ms\": { \"min\": %.4f, \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f },"
+			" \"mpix_per_s\": %.3f, \"giter_per_s\": %.6f }",
+			result.engine, result.variant, result.width, result.height, result.max_iterations, result.exact ? "true" : "false",
+			(unsigned long long) result.iterations, result.ms.front(), mean, median, percentile(result.ms, 90), percentile(result.ms, 99),
+			result.ms.back(), pixels / (median * 1000.0), (double) result.iterations / (median * 1e6));
+	}
+	fprintf(file, "\n  ]\n}\n");
+
+	if (fclose(file) != 0) {
+		std::cout << "failed writing " << options.bench_output << "\n";
+		return -1;
+	}
+	printf("wrote %zu results to %s\n", report.results.size(), options.bench_output.c_str());
+	return 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "options.h"
+
+struct Init;
+struct RenderData;
+
+// one engine, in one tier or instruction set, on one view at one size and cap
+struct BenchResult {
+	std::string view;
+	const char* engine;
+	// the precision tier for the GPU engines, the instruction set for cpu
+	const char* variant;
+	uint32_t width;
+	uint32_t height;
+	uint32_t max_iterations;
+	// whether the tier gives every pixel its own coordinate; f32 on a deep view still gets timed, but draws blocks
+	bool exact;
+	// milliseconds per timed render, sorted
+	std::vector<double> ms;
+	// the view's escape counts summed, see BenchReport::nominal
+	uint64_t iterations;
+};
+
+struct BenchReport {
+	// the GPU, empty when only the cpu engine ran
+	std::string device;
+	unsigned cpu_threads = 0;
+	std::vector<BenchResult> results;
+	// escape counts summed per view, size and cap, as the cpu engine finds them. What a plain loop would
+	// iterate, so Giter/s compares engines on the same work whatever their early outs skip.
+	std::map<std::string, uint64_t> nominal;
+};
+
+// options.views, or the named set: full, seahorse valley, elephant valley, a deep minibrot and an interior view
+std::vector<View> bench_views(const Options& options);
+
+// every case the cpu engine runs; needs no Vulkan, so CPU-only nodes get a report too
+int bench_cpu(const Options& options, BenchReport& report);
+// every case for the GPU engines, against the headless setup main() makes
+int bench_gpu(Init& init, RenderData& data, const Options& options, BenchReport& report);
+
+// the results with Mpix/s, Giter/s and frame time percentiles, as JSON
+int write_bench(const BenchReport& report, const Options& options);
@@ -0,0 +1,461 @@
+#include <string.h>
+
+#include <iostream>
+
+#include "render.h"
+#include "colorize.h"
+
+static int create_device_buffer(Init& init, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, Allocation& memory) {
+	VkBufferCreateInfo buffer_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = usage,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	if (init.disp.createBuffer(&buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+		std::cout << "failed to create colorize buffer\n";
+		return -1;
+	}
+
+	if (0 != allocate_buffer_memory(init, buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memory)) {
+		std::cout << "failed to allocate colorize buffer memory\n";
+		return -1;
+	}
+	return 0;
+}
+
+static int create_palette_image(Init& init, Colorizer& colorizer) {
+	VkImageCreateInfo image_info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = VK_FORMAT_R8G8B8A8_UNORM,
+		.extent = { PALETTE_LUT_WIDTH, PALETTE_COUNT, 1 },
+		.mipLevels = 1,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+	if (init.disp.createImage(&image_info, nullptr, &colorizer.palettes) != VK_SUCCESS) {
+		std::cout << "failed to create palette image\n";
+		return -1;
+	}
+
+	if (0 != allocate_image_memory(init, colorizer.palettes, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorizer.palettes_memory)) {
+		std::cout << "failed to allocate palette image memory\n";
+		return -1;
+	}
+
+	VkImageViewCreateInfo view_info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = colorizer.palettes,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = VK_FORMAT_R8G8B8A8_UNORM,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+	};
+	if (init.disp.createImageView(&view_info, nullptr, &colorizer.palettes_view) != VK_SUCCESS) {
+		std::cout << "failed to create palette image view\n";
+		return -1;
+	}
+
+	// linear along a palette so smooth shading blends between texels, but never between palettes
+	VkSamplerCreateInfo sampler_info = {
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		.magFilter = VK_FILTER_LINEAR,
+		.minFilter = VK_FILTER_LINEAR,
+		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+		.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+		.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.maxLod = 0.0f,
+	};
+	if (init.disp.createSampler(&sampler_info, nullptr, &colorizer.sampler) != VK_SUCCESS) {
+		std::cout << "failed to create palette sampler\n";
+		return -1;
+	}
+	return 0;
+}
+
+static VkPipeline create_colorize_stage(Init& init, Colorizer& colorizer, const char* name, const VkSpecializationInfo* spec_info) {
+	VkShaderModule comp_module = createShaderModule(init, std::string(EXAMPLE_BUILD_DIRECTORY) + "/" + name + ".spv");
+	if (comp_module == VK_NULL_HANDLE) {
+		std::cout << "failed to create shader module\n";
+		return VK_NULL_HANDLE;
+	}
+
+	VkComputePipelineCreateInfo pipeline_info = {
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = comp_module,
+			.pName = "main",
+			.pSpecializationInfo = spec_info,
+		},
+		.layout = colorizer.pipeline_layout,
+	};
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult res = init.disp.createComputePipelines(init.pipeline_cache, 1, &pipeline_info, nullptr, &pipeline);
+	init.disp.destroyShaderModule(comp_module, nullptr);
+	if (res != VK_SUCCESS) {
+		std::cout << "failed to create " << name << " pipeline\n";
+		return VK_NULL_HANDLE;
+	}
+	return pipeline;
+}
+
+int create_colorizer(Init& init, Colorizer& colorizer, const Options& options, const ComputeEngine& compute, const UniformRing& uniforms) {
+	VkDescriptorSetLayoutBinding bindings[7] = {};
+	VkDescriptorType types[7] = {
+		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+	};
+	for (uint32_t i = 0; i < 7; i++) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = types[i];
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = 7,
+		.pBindings = bindings
+	};
+	if (init.disp.createDescriptorSetLayout(&setLayoutCreateInfo, nullptr, &colorizer.set_layout) != VK_SUCCESS) {
+		std::cout << "failed to create colorize descriptor set layout\n";
+		return -1;
+	}
+
+	uint32_t set_count = uniforms.count;
+	VkDescriptorPoolSize poolSizes[4] = {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, set_count },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, set_count },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * set_count },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, set_count },
+	};
+	VkDescriptorPoolCreateInfo poolInfo {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.maxSets = set_count,
+		.poolSizeCount = 4,
+		.pPoolSizes = poolSizes,
+	};
+	if (init.disp.createDescriptorPool(&poolInfo, nullptr, &colorizer.descriptor_pool) != VK_SUCCESS) {
+		std::cout << "failed to create colorize descriptor pool\n";
+		return -1;
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(set_count, colorizer.set_layout);
+	VkDescriptorSetAllocateInfo allocInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = colorizer.descriptor_pool,
+		.descriptorSetCount = set_count,
+		.pSetLayouts = layouts.data(),
+	};
+	colorizer.descriptor_sets.resize(set_count);
+	if (init.disp.allocateDescriptorSets(&allocInfo, colorizer.descriptor_sets.data()) != VK_SUCCESS) {
+		std::cout << "failed to allocate colorize descriptor sets\n";
+		return -1;
+	}
+
+	if (0 != create_palette_image(init, colorizer)) return -1;
+
+	// counts 0..max_iterations - 1; pixels that never escape stay black and aren't counted
+	colorizer.bins = options.max_iterations;
+	VkDeviceSize bins_size = (VkDeviceSize) colorizer.bins * sizeof(uint32_t);
+	if (0 != create_device_buffer(init, bins_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, colorizer.histogram, colorizer.histogram_memory)) return -1;
+	if (0 != create_device_buffer(init, bins_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, colorizer.cumulative, colorizer.cumulative_memory)) return -1;
+
+	// the output image and compute buffers are written in bind_colorizer_targets
+	VkDescriptorImageInfo paletteInfo = {
+		.sampler = colorizer.sampler,
+		.imageView = colorizer.palettes_view,
+		.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	};
+	VkDescriptorBufferInfo histogramInfo = { colorizer.histogram, 0, VK_WHOLE_SIZE };
+	VkDescriptorBufferInfo cumulativeInfo = { colorizer.cumulative, 0, VK_WHOLE_SIZE };
+	for (uint32_t i = 0; i < set_count; i++) {
+		VkDescriptorBufferInfo uniformInfo = uniform_descriptor(uniforms, i);
+		VkWriteDescriptorSet writes[4] = {
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = colorizer.descriptor_sets[i],
+				.dstBinding = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				.pBufferInfo = &uniformInfo,
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = colorizer.descriptor_sets[i],
+				.dstBinding = 4,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.pImageInfo = &paletteInfo,
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = colorizer.descriptor_sets[i],
+				.dstBinding = 5,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &histogramInfo,
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = colorizer.descriptor_sets[i],
+				.dstBinding = 6,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &cumulativeInfo,
+			},
+		};
+		init.disp.updateDescriptorSets(4, writes, 0, nullptr);
+	}
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &colorizer.set_layout,
+	};
+	if (init.disp.createPipelineLayout(&pipeline_layout_info, nullptr, &colorizer.pipeline_layout) != VK_SUCCESS) {
+		std::cout << "failed to create colorize pipeline layout\n";
+		return -1;
+	}
+
+	// the per-pixel passes share the iteration pass's workgroup shape
+	VkSpecializationMapEntry spec_entries[2] = {
+		{ 0, 0, sizeof(uint32_t) },
+		{ 1, sizeof(uint32_t), sizeof(uint32_t) },
+	};
+	VkSpecializationInfo spec_info = {
+		.mapEntryCount = 2,
+		.pMapEntries = spec_entries,
+		.dataSize = sizeof(compute.local_size),
+		.pData = compute.local_size,
+	};
+	colorizer.histogram_pipeline = create_colorize_stage(init, colorizer, "histogram.comp", &spec_info);
+	colorizer.scan_pipeline = create_colorize_stage(init, colorizer, "histogram_scan.comp", nullptr);
+	colorizer.colorize_pipeline = create_colorize_stage(init, colorizer, "colorize.comp", &spec_info);
+	if (colorizer.histogram_pipeline == VK_NULL_HANDLE || colorizer.scan_pipeline == VK_NULL_HANDLE || colorizer.colorize_pipeline == VK_NULL_HANDLE)
+		return -1;
+	return 0;
+}
+
+int upload_palettes(Init& init, RenderData& data, Colorizer& colorizer) {
+	VkDeviceSize size = (VkDeviceSize) PALETTE_LUT_WIDTH * PALETTE_COUNT * 4;
+
+	VkBufferCreateInfo buffer_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	VkBuffer staging;
+	if (init.disp.createBuffer(&buffer_info, nullptr, &staging) != VK_SUCCESS) {
+		std::cout << "failed to create palette staging buffer\n";
+		return -1;
+	}
+
+	Allocation staging_memory;
+	if (0 != allocate_buffer_memory(init, staging, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_memory)) {
+		std::cout << "failed to allocate palette staging memory\n";
+		init.disp.destroyBuffer(staging, nullptr);
+		return -1;
+	}
+
+	for (uint32_t p = 0; p < PALETTE_COUNT; p++)
+		fill_palette_lut(p, PALETTE_LUT_WIDTH, (uint8_t*) staging_memory.mapped + (size_t) p * PALETTE_LUT_WIDTH * 4);
+
+	VkCommandBufferAllocateInfo allocInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = data.command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+	VkCommandBuffer cmd;
+	if (init.disp.allocateCommandBuffers(&allocInfo, &cmd) != VK_SUCCESS) {
+		std::cout << "failed to allocate palette upload command buffer\n";
+		return -1;
+	}
+
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	init.disp.beginCommandBuffer(cmd, &begin_info);
+
+	VkImageMemoryBarrier to_dst = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = 0,
+		.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = colorizer.palettes,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &to_dst);
+
+	VkBufferImageCopy region = {
+		.bufferOffset = 0,
+		.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+		.imageOffset = { 0, 0, 0 },
+		.imageExtent = { PALETTE_LUT_WIDTH, PALETTE_COUNT, 1 },
+	};
+	init.disp.cmdCopyBufferToImage(cmd, staging, colorizer.palettes, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+	VkImageMemoryBarrier to_read = to_dst;
+	to_read.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	to_read.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	to_read.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	to_read.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &to_read);
+	init.disp.endCommandBuffer(cmd);
+
+	VkSubmitInfo submitInfo = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &cmd,
+	};
+	int res = 0;
+	if (init.disp.queueSubmit(data.graphics_queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS || init.disp.queueWaitIdle(data.graphics_queue) != VK_SUCCESS) {
+		std::cout << "failed to upload palettes\n";
+		res = -1;
+	}
+
+	init.disp.freeCommandBuffers(data.command_pool, 1, &cmd);
+	init.disp.destroyBuffer(staging, nullptr);
+	free_memory(init, staging_memory);
+	return res;
+}
+
+void bind_colorizer_targets(Init& init, Colorizer& colorizer, const ComputeEngine& compute) {
+	VkDescriptorImageInfo imageInfo = {
+		.sampler = VK_NULL_HANDLE,
+		.imageView = compute.image_view,
+		.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+	};
+	VkDescriptorBufferInfo iterationsInfo = { compute.iterations, 0, VK_WHOLE_SIZE };
+	VkDescriptorBufferInfo magnitudesInfo = { compute.magnitudes, 0, VK_WHOLE_SIZE };
+	for (auto set : colorizer.descriptor_sets) {
+		VkWriteDescriptorSet writes[3] = {
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = set,
+				.dstBinding = 1,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.pImageInfo = &imageInfo,
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = set,
+				.dstBinding = 2,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &iterationsInfo,
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = set,
+				.dstBinding = 3,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &magnitudesInfo,
+			},
+		};
+		init.disp.updateDescriptorSets(3, writes, 0, nullptr);
+	}
+}
+
+void destroy_colorizer(Init& init, Colorizer& colorizer) {
+	init.disp.destroyPipeline(colorizer.histogram_pipeline, nullptr);
+	init.disp.destroyPipeline(colorizer.scan_pipeline, nullptr);
+	init.disp.destroyPipeline(colorizer.colorize_pipeline, nullptr);
+	init.disp.destroyPipelineLayout(colorizer.pipeline_layout, nullptr);
+	// descriptor sets go with the pool
+	init.disp.destroyDescriptorPool(colorizer.descriptor_pool, nullptr);
+	init.disp.destroyDescriptorSetLayout(colorizer.set_layout, nullptr);
+
+	init.disp.destroySampler(colorizer.sampler, nullptr);
+	init.disp.destroyImageView(colorizer.palettes_view, nullptr);
+	init.disp.destroyImage(colorizer.palettes, nullptr);
+	free_memory(init, colorizer.palettes_memory);
+	init.disp.destroyBuffer(colorizer.histogram, nullptr);
+	free_memory(init, colorizer.histogram_memory);
+	init.disp.destroyBuffer(colorizer.cumulative, nullptr);
+	free_memory(init, colorizer.cumulative_memory);
+}
+
+void record_colorize(Init& init, Colorizer& colorizer, const ComputeEngine& compute, VkCommandBuffer cmd, size_t set_index, bool histogram) {
+	VkDescriptorSet set = colorizer.descriptor_sets[set_index];
+	init.disp.cmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, colorizer.pipeline_layout, 0, 1, &set, 0, nullptr);
+
+	uint32_t groups_x = (compute.extent.width + compute.local_size[0] - 1) / compute.local_size[0];
+	uint32_t groups_y = (compute.extent.height + compute.local_size[1] - 1) / compute.local_size[1];
+
+	if (histogram) {
+		// the previous frame's scan and colorize passes may still be reading what gets cleared here
+		init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+		init.disp.cmdFillBuffer(cmd, colorizer.histogram, 0, VK_WHOLE_SIZE, 0);
+
+		VkMemoryBarrier cleared = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		};
+		init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &cleared, 0, nullptr, 0, nullptr);
+
+		init.disp.cmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, colorizer.histogram_pipeline);
+		init.disp.cmdDispatch(cmd, groups_x, groups_y, 1);
+
+		VkMemoryBarrier counted = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		};
+		init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &counted, 0, nullptr, 0, nullptr);
+
+		init.disp.cmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, colorizer.scan_pipeline);
+		init.disp.cmdDispatch(cmd, 1, 1, 1);
+	}
+
+	// every pixel is rewritten so the previous contents can be discarded; the source stage covers the
+	// previous frame's blit reading from the same image, and the scan's writes when there was one
+	VkImageMemoryBarrier to_general = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = 0,
+		.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout = VK_IMAGE_LAYOUT_GENERAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = compute.image,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+	};
+	VkMemoryBarrier scanned = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &scanned, 0, nullptr, 1, &to_general);
+
+	init.disp.cmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, colorizer.colorize_pipeline);
+	init.disp.cmdDispatch(cmd, groups_x, groups_y, 1);
+
+	VkImageMemoryBarrier to_transfer = to_general;
+	to_transfer.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	to_transfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	to_transfer.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	to_transfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &to_transfer);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include "allocator.h"
+
+struct Init;
+struct Options;
+struct ComputeEngine;
+struct RenderData;
+
+// texels per palette row
+const uint32_t PALETTE_LUT_WIDTH = 1024;
+
+// turns the compute engine's iteration counts into its storage image: an optional histogram pass for
+// equalisation, then one palette texture lookup per pixel. Palette switches, cycling and toggling
+// smooth shading only rerun this, never the iteration.
+struct Colorizer {
+	VkDescriptorSetLayout set_layout;
+	VkPipelineLayout pipeline_layout;
+	VkPipeline histogram_pipeline;
+	VkPipeline scan_pipeline;
+	VkPipeline colorize_pipeline;
+
+	VkDescriptorPool descriptor_pool;
+	std::vector<VkDescriptorSet> descriptor_sets;
+
+	// every palette is one row, so switching palettes is only a uniform change
+	VkImage palettes;
+	Allocation palettes_memory;
+	VkImageView palettes_view;
+	VkSampler sampler;
+
+	// escaped pixels per iteration count, and their normalised running total
+	uint32_t bins;
+	VkBuffer histogram;
+	Allocation histogram_memory;
+	VkBuffer cumulative;
+	Allocation cumulative_memory;
+};
+
+// one descriptor set per uniform slot, like the compute engine's
+int create_colorizer(Init& init, Colorizer& colorizer, const Options& options, const ComputeEngine& compute, const UniformRing& uniforms);
+// fills the palette texture, waiting for the upload on the graphics queue
+int upload_palettes(Init& init, RenderData& data, Colorizer& colorizer);
+// points the descriptor sets at the compute engine's current targets, so it has to follow every create_compute_targets
+void bind_colorizer_targets(Init& init, Colorizer& colorizer, const ComputeEngine& compute);
+void destroy_colorizer(Init& init, Colorizer& colorizer);
+
+// colours compute's iteration buffers into its storage image, leaving the image in TRANSFER_SRC_OPTIMAL.
+// The histogram only needs rebuilding when the iteration counts changed and equalisation is on.
+void record_colorize(Init& init, Colorizer& colorizer, const ComputeEngine& compute, VkCommandBuffer cmd, size_t set_index, bool histogram);
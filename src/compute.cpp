@@ -0,0 +1,542 @@
+#include <stddef.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include "render.h"
+#include "compute.h"
+
+void kernel_constant_entries(uint32_t offset, std::vector<VkSpecializationMapEntry>& entries) {
+	entries.push_back({ KERNEL_CONSTANT_ID, offset + (uint32_t) offsetof(KernelConstants, max_iterations), sizeof(uint32_t) });
+	entries.push_back({ KERNEL_CONSTANT_ID + 1, offset + (uint32_t) offsetof(KernelConstants, escape_radius2), sizeof(float) });
+	entries.push_back({ KERNEL_CONSTANT_ID + 2, offset + (uint32_t) offsetof(KernelConstants, unroll), sizeof(uint32_t) });
+	entries.push_back({ KERNEL_CONSTANT_ID + 3, offset + (uint32_t) offsetof(KernelConstants, palette), sizeof(uint32_t) });
+}
+
+int create_compute_pipeline(Init& init, ComputeEngine& compute, const Options& options, const UniformRing& uniforms) {
+	compute.local_size[0] = options.workgroup[0];
+	compute.local_size[1] = options.workgroup[1];
+	compute.tile_size = options.tile_size;
+	compute.progressive_budget = options.progressive;
+	compute.subdivide = options.subdivide;
+	compute.constants = kernel_constants(options);
+
+	const VkPhysicalDeviceLimits& limits = init.physical_device.properties.limits;
+	if (compute.local_size[0] * compute.local_size[1] > limits.maxComputeWorkGroupInvocations ||
+		compute.local_size[0] > limits.maxComputeWorkGroupSize[0] ||
+		compute.local_size[1] > limits.maxComputeWorkGroupSize[1]) {
+		std::cout << "workgroup " << compute.local_size[0] << "x" << compute.local_size[1] << " exceeds device limits\n";
+		return -1;
+	}
+
+	// iteration counts and |z|^2 at escape only, colorize.cpp turns them into the storage image; plus the
+	// progressive pass's state and the subdivision's rectangle lists, which mandel.comp leaves alone and so
+	// may stay unwritten
+	VkDescriptorSetLayoutBinding bindings[5] = {};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding = 2;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[2].binding = 3;
+	bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[2].descriptorCount = 1;
+	bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[3].binding = 4;
+	bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[3].descriptorCount = 1;
+	bindings[3].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[4].binding = 5;
+	bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[4].descriptorCount = 1;
+	bindings[4].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = 5,
+		.pBindings = bindings
+	};
+	if (init.disp.createDescriptorSetLayout(&setLayoutCreateInfo, nullptr, &compute.set_layout) != VK_SUCCESS) {
+		std::cout << "failed to create compute descriptor set layout\n";
+		return -1;
+	}
+
+	uint32_t set_count = uniforms.count;
+	VkDescriptorPoolSize poolSizes[2] = {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, set_count },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * set_count },
+	};
+	VkDescriptorPoolCreateInfo poolInfo {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.maxSets = set_count,
+		.poolSizeCount = 2,
+		.pPoolSizes = poolSizes,
+	};
+	if (init.disp.createDescriptorPool(&poolInfo, nullptr, &compute.descriptor_pool) != VK_SUCCESS) {
+		std::cout << "failed to create compute descriptor pool\n";
+		return -1;
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(set_count, compute.set_layout);
+	VkDescriptorSetAllocateInfo allocInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = compute.descriptor_pool,
+		.descriptorSetCount = set_count,
+		.pSetLayouts = layouts.data(),
+	};
+	compute.descriptor_sets.resize(set_count);
+	if (init.disp.allocateDescriptorSets(&allocInfo, compute.descriptor_sets.data()) != VK_SUCCESS) {
+		std::cout << "failed to allocate compute descriptor sets\n";
+		return -1;
+	}
+
+	// the iteration and magnitude buffers are written in create_compute_targets
+	for (uint32_t i = 0; i < set_count; i++) {
+		VkDescriptorBufferInfo bufferInfo = uniform_descriptor(uniforms, i);
+		VkWriteDescriptorSet descriptorWrite = {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = compute.descriptor_sets[i],
+			.dstBinding = 0,
+			.dstArrayElement = 0,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+			.pBufferInfo = &bufferInfo,
+		};
+		init.disp.updateDescriptorSets(1, &descriptorWrite, 0, nullptr);
+	}
+
+	VkPushConstantRange pushRange = {
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = (uint32_t) std::max(sizeof(ProgressPush), sizeof(SubdividePush)),
+	};
+	VkPipelineLayoutCreateInfo pipeline_layout_info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &compute.set_layout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &pushRange,
+	};
+	if (init.disp.createPipelineLayout(&pipeline_layout_info, nullptr, &compute.pipeline_layout) != VK_SUCCESS) {
+		std::cout << "failed to create compute pipeline layout\n";
+		return -1;
+	}
+
+	struct {
+		uint32_t local_size[2];
+		KernelConstants constants;
+	} spec_data = { { compute.local_size[0], compute.local_size[1] }, compute.constants };
+	std::vector<VkSpecializationMapEntry> spec_entries = {
+		{ 0, 0, sizeof(uint32_t) },
+		{ 1, sizeof(uint32_t), sizeof(uint32_t) },
+	};
+	kernel_constant_entries(offsetof(decltype(spec_data), constants), spec_entries);
+	VkSpecializationInfo spec_info = {
+		.mapEntryCount = (uint32_t) spec_entries.size(),
+		.pMapEntries = spec_entries.data(),
+		.dataSize = sizeof(spec_data),
+		.pData = &spec_data,
+	};
+
+	for (int p = 0; p < PRECISION_COUNT; p++) {
+		compute.pipelines[p] = VK_NULL_HANDLE;
+		compute.progressive_pipelines[p] = VK_NULL_HANDLE;
+		compute.subdivide_pipelines[p] = VK_NULL_HANDLE;
+		if (p == PRECISION_F64 && !init.shader_float64)
+			continue;
+
+		const char* names[3] = { "mandel.comp", "mandel_progressive.comp", "mandel_subdivide.comp" };
+		VkPipeline* targets[3] = { &compute.pipelines[p], &compute.progressive_pipelines[p], &compute.subdivide_pipelines[p] };
+		bool wanted[3] = { true, compute.progressive_budget > 0, compute.subdivide };
+		for (int s = 0; s < 3; s++) {
+			const char* name = names[s];
+			if (!wanted[s])
+				continue;
+
+			VkShaderModule comp_module = createShaderModule(init, shader_path(name, (Precision) p));
+			if (comp_module == VK_NULL_HANDLE) {
+				std::cout << "failed to create shader module\n";
+				return -1;
+			}
+
+			VkComputePipelineCreateInfo pipeline_info = {
+				.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+				.stage = {
+					.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+					.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+					.module = comp_module,
+					.pName = "main",
+					.pSpecializationInfo = &spec_info,
+				},
+				.layout = compute.pipeline_layout,
+			};
+			VkResult res = init.disp.createComputePipelines(init.pipeline_cache, 1, &pipeline_info, nullptr, targets[s]);
+			init.disp.destroyShaderModule(comp_module, nullptr);
+			if (res != VK_SUCCESS) {
+				std::cout << "failed to create " << precision_name((Precision) p) << " " << name << " pipeline\n";
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+int create_compute_targets(Init& init, ComputeEngine& compute, VkExtent2D extent) {
+	compute.extent = extent;
+
+	VkImageCreateInfo image_info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = VK_FORMAT_R8G8B8A8_UNORM,
+		.extent = { extent.width, extent.height, 1 },
+		.mipLevels = 1,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+	if (init.disp.createImage(&image_info, nullptr, &compute.image) != VK_SUCCESS) {
+		std::cout << "failed to create compute storage image\n";
+		return -1;
+	}
+
+	if (0 != allocate_image_memory(init, compute.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, compute.image_memory)) {
+		std::cout << "failed to allocate compute storage image memory\n";
+		return -1;
+	}
+
+	VkImageViewCreateInfo view_info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = compute.image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = VK_FORMAT_R8G8B8A8_UNORM,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+	};
+	if (init.disp.createImageView(&view_info, nullptr, &compute.image_view) != VK_SUCCESS) {
+		std::cout << "failed to create compute storage image view\n";
+		return -1;
+	}
+
+	VkBufferCreateInfo buffer_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = (VkDeviceSize) extent.width * extent.height * sizeof(uint32_t),
+		// hybrid frames upload the cpu engine's rows into the iteration buffer
+		.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	if (init.disp.createBuffer(&buffer_info, nullptr, &compute.iterations) != VK_SUCCESS) {
+		std::cout << "failed to create iteration buffer\n";
+		return -1;
+	}
+
+	if (0 != allocate_buffer_memory(init, compute.iterations, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, compute.iterations_memory)) {
+		std::cout << "failed to allocate iteration buffer memory\n";
+		return -1;
+	}
+
+	buffer_info.size = (VkDeviceSize) extent.width * extent.height * sizeof(float);
+	if (init.disp.createBuffer(&buffer_info, nullptr, &compute.magnitudes) != VK_SUCCESS) {
+		std::cout << "failed to create magnitude buffer\n";
+		return -1;
+	}
+
+	if (0 != allocate_buffer_memory(init, compute.magnitudes, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, compute.magnitudes_memory)) {
+		std::cout << "failed to allocate magnitude buffer memory\n";
+		return -1;
+	}
+
+	if (compute.progressive_budget > 0) {
+		buffer_info.size = (VkDeviceSize) extent.width * extent.height * sizeof(PixelState);
+		buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		if (init.disp.createBuffer(&buffer_info, nullptr, &compute.states) != VK_SUCCESS) {
+			std::cout << "failed to create progressive state buffer\n";
+			return -1;
+		}
+
+		if (0 != allocate_buffer_memory(init, compute.states, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, compute.states_memory)) {
+			std::cout << "failed to allocate progressive state memory\n";
+			return -1;
+		}
+	}
+
+	if (compute.subdivide) {
+		// the first level is a plain grid of squares, and each level after it at most quarters every
+		// rectangle of the one before; spans halve, rounding up, until they're narrow enough to iterate
+		uint32_t count = ((extent.width + SUBDIVIDE_SIZE - 1) / SUBDIVIDE_SIZE) * ((extent.height + SUBDIVIDE_SIZE - 1) / SUBDIVIDE_SIZE);
+		uint32_t words = 0;
+		compute.subdivide_lists.assign(1, SUBDIVIDE_NO_LIST);
+		for (uint32_t span = SUBDIVIDE_SIZE - 1; span > SUBDIVIDE_MIN_SIZE; span = (span + 1) / 2) {
+			count *= 4;
+			compute.subdivide_lists.push_back(words);
+			words += 3 + 2 * count;
+		}
+
+		buffer_info.size = (VkDeviceSize) words * sizeof(uint32_t);
+		buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		if (init.disp.createBuffer(&buffer_info, nullptr, &compute.rects) != VK_SUCCESS) {
+			std::cout << "failed to create subdivision rectangle buffer\n";
+			return -1;
+		}
+
+		if (0 != allocate_buffer_memory(init, compute.rects, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, compute.rects_memory)) {
+			std::cout << "failed to allocate subdivision rectangle memory\n";
+			return -1;
+		}
+	}
+
+	VkDescriptorBufferInfo iterationsInfo = {
+		.buffer = compute.iterations,
+		.offset = 0,
+		.range = VK_WHOLE_SIZE,
+	};
+	VkDescriptorBufferInfo magnitudesInfo = {
+		.buffer = compute.magnitudes,
+		.offset = 0,
+		.range = VK_WHOLE_SIZE,
+	};
+	VkDescriptorBufferInfo statesInfo = {
+		.buffer = compute.states,
+		.offset = 0,
+		.range = VK_WHOLE_SIZE,
+	};
+	VkDescriptorBufferInfo rectsInfo = {
+		.buffer = compute.rects,
+		.offset = 0,
+		.range = VK_WHOLE_SIZE,
+	};
+	for (auto set : compute.descriptor_sets) {
+		VkWriteDescriptorSet writes[4] = {
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = set,
+				.dstBinding = 2,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &iterationsInfo,
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = set,
+				.dstBinding = 3,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &magnitudesInfo,
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = set,
+				.dstBinding = 4,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &statesInfo,
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = set,
+				.dstBinding = 5,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &rectsInfo,
+			},
+		};
+		// the optional buffers only get written when they exist
+		init.disp.updateDescriptorSets(2, writes, 0, nullptr);
+		if (compute.progressive_budget > 0)
+			init.disp.updateDescriptorSets(1, &writes[2], 0, nullptr);
+		if (compute.subdivide)
+			init.disp.updateDescriptorSets(1, &writes[3], 0, nullptr);
+	}
+	return 0;
+}
+
+void destroy_compute_targets(Init& init, ComputeEngine& compute) {
+	init.disp.destroyImageView(compute.image_view, nullptr);
+	init.disp.destroyImage(compute.image, nullptr);
+	free_memory(init, compute.image_memory);
+	init.disp.destroyBuffer(compute.iterations, nullptr);
+	free_memory(init, compute.iterations_memory);
+	init.disp.destroyBuffer(compute.magnitudes, nullptr);
+	free_memory(init, compute.magnitudes_memory);
+	init.disp.destroyBuffer(compute.states, nullptr);
+	free_memory(init, compute.states_memory);
+	init.disp.destroyBuffer(compute.rects, nullptr);
+	free_memory(init, compute.rects_memory);
+
+	compute.image_view = VK_NULL_HANDLE;
+	compute.image = VK_NULL_HANDLE;
+	compute.iterations = VK_NULL_HANDLE;
+	compute.magnitudes = VK_NULL_HANDLE;
+	compute.states = VK_NULL_HANDLE;
+	compute.rects = VK_NULL_HANDLE;
+}
+
+void destroy_compute_pipeline(Init& init, ComputeEngine& compute) {
+	destroy_compute_targets(init, compute);
+
+	for (auto pipeline : compute.pipelines)
+		init.disp.destroyPipeline(pipeline, nullptr);
+	for (auto pipeline : compute.progressive_pipelines)
+		init.disp.destroyPipeline(pipeline, nullptr);
+	for (auto pipeline : compute.subdivide_pipelines)
+		init.disp.destroyPipeline(pipeline, nullptr);
+	init.disp.destroyPipelineLayout(compute.pipeline_layout, nullptr);
+	// descriptor sets go with the pool
+	init.disp.destroyDescriptorPool(compute.descriptor_pool, nullptr);
+	init.disp.destroyDescriptorSetLayout(compute.set_layout, nullptr);
+}
+
+// the tiled dispatch shared by the full and progressive passes, with push's offset set per tile, over the top rows
+// of the targets; the last tile row stops at the first workgroup row past them
+static void record_tiles(Init& init, ComputeEngine& compute, VkCommandBuffer cmd, VkDescriptorSet set, VkPipeline pipeline, ProgressPush push, uint32_t push_size, uint32_t rows) {
+	// the output buffers are shared by all frames in flight, so order against the last frame's writes and
+	// wait out its colorize pass and readback
+	VkMemoryBarrier previous_writes = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &previous_writes, 0, nullptr, 0, nullptr);
+
+	init.disp.cmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	init.disp.cmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline_layout, 0, 1, &set, 0, nullptr);
+
+	// tiles keep each dispatch short enough not to trip GPU watchdogs on slow devices
+	uint32_t tile = compute.tile_size;
+	uint32_t groups_x = (tile + compute.local_size[0] - 1) / compute.local_size[0];
+	uint32_t groups_y = (tile + compute.local_size[1] - 1) / compute.local_size[1];
+	for (uint32_t y = 0; y < rows; y += tile) {
+		uint32_t tile_groups_y = std::min(groups_y, (rows - y + compute.local_size[1] - 1) / compute.local_size[1]);
+		for (uint32_t x = 0; x < compute.extent.width; x += tile) {
+			push.offset[0] = (int32_t) x;
+			push.offset[1] = (int32_t) y;
+			init.disp.cmdPushConstants(cmd, compute.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, push_size, &push);
+			init.disp.cmdDispatch(cmd, groups_x, tile_groups_y, 1);
+		}
+	}
+
+	VkMemoryBarrier outputs_ready = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &outputs_ready, 0, nullptr, 0, nullptr);
+}
+
+// one dispatch per subdivision level, each after the first sized by the rectangles the level before queued
+static void record_subdivide(Init& init, ComputeEngine& compute, VkCommandBuffer cmd, VkDescriptorSet set, Precision precision) {
+	// like record_tiles, but the rectangle lists' headers get reset first, once the last frame is done with them
+	VkMemoryBarrier previous_writes = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &previous_writes, 0, nullptr, 0, nullptr);
+
+	// no rectangles yet, in a VkDispatchIndirectCommand's x
+	const uint32_t empty[3] = { 0, 1, 1 };
+	for (size_t level = 1; level < compute.subdivide_lists.size(); level++)
+		init.disp.cmdUpdateBuffer(cmd, compute.rects, compute.subdivide_lists[level] * sizeof(uint32_t), sizeof(empty), empty);
+
+	VkMemoryBarrier lists_ready = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &lists_ready, 0, nullptr, 0, nullptr);
+
+	init.disp.cmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, compute.subdivide_pipelines[precision]);
+	init.disp.cmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline_layout, 0, 1, &set, 0, nullptr);
+
+	size_t levels = compute.subdivide_lists.size();
+	for (size_t level = 0; level < levels; level++) {
+		SubdividePush push = {
+			.square_size = SUBDIVIDE_SIZE,
+			.list = compute.subdivide_lists[level],
+			.next = (level + 1 < levels) ? compute.subdivide_lists[level + 1] : SUBDIVIDE_NO_LIST,
+			.min_size = SUBDIVIDE_MIN_SIZE,
+		};
+		init.disp.cmdPushConstants(cmd, compute.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+		if (level == 0) {
+			uint32_t squares_x = (compute.extent.width + SUBDIVIDE_SIZE - 1) / SUBDIVIDE_SIZE;
+			uint32_t squares_y = (compute.extent.height + SUBDIVIDE_SIZE - 1) / SUBDIVIDE_SIZE;
+			init.disp.cmdDispatch(cmd, squares_x, squares_y, 1);
+		} else {
+			init.disp.cmdDispatchIndirect(cmd, compute.rects, compute.subdivide_lists[level] * sizeof(uint32_t));
+		}
+
+		// the next level reads the borders and crosses this one iterated, and dispatches what it queued
+		if (level + 1 < levels)
+			init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &lists_ready, 0, nullptr, 0, nullptr);
+	}
+
+	VkMemoryBarrier outputs_ready = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &outputs_ready, 0, nullptr, 0, nullptr);
+}
+
+void record_compute(Init& init, ComputeEngine& compute, VkCommandBuffer cmd, VkDescriptorSet set, Precision precision) {
+	if (compute.subdivide) {
+		record_subdivide(init, compute, cmd, set, precision);
+		return;
+	}
+	record_tiles(init, compute, cmd, set, compute.pipelines[precision], {}, sizeof(TilePush), compute.extent.height);
+}
+
+void record_compute_rows(Init& init, ComputeEngine& compute, VkCommandBuffer cmd, VkDescriptorSet set, Precision precision, uint32_t rows) {
+	record_tiles(init, compute, cmd, set, compute.pipelines[precision], {}, sizeof(TilePush), rows);
+}
+
+void record_progressive(Init& init, ComputeEngine& compute, VkCommandBuffer cmd, VkDescriptorSet set, Precision precision, bool restart) {
+	ProgressPush push = {
+		.budget = compute.progressive_budget,
+		.restart = restart ? 1u : 0u,
+	};
+	record_tiles(init, compute, cmd, set, compute.progressive_pipelines[precision], push, sizeof(push), compute.extent.height);
+}
+
+void record_compute_blit(Init& init, ComputeEngine& compute, VkCommandBuffer cmd, VkImage dst, VkExtent2D dst_extent, VkImageLayout final_layout) {
+	VkImageMemoryBarrier to_dst = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = 0,
+		.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = dst,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &to_dst);
+
+	// a blit rather than a copy so the UNORM storage image can land in an sRGB or BGRA target
+	VkImageBlit region = {
+		.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+		.srcOffsets = { { 0, 0, 0 }, { (int32_t) compute.extent.width, (int32_t) compute.extent.height, 1 } },
+		.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+		.dstOffsets = { { 0, 0, 0 }, { (int32_t) dst_extent.width, (int32_t) dst_extent.height, 1 } },
+	};
+	init.disp.cmdBlitImage(cmd, compute.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_NEAREST);
+
+	VkImageMemoryBarrier to_final = to_dst;
+	to_final.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	to_final.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	to_final.newLayout = final_layout;
+
+	VkPipelineStageFlags dst_stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	if (final_layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+		to_final.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		dst_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	} else {
+		to_final.dstAccessMask = 0;
+	}
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &to_final);
+}
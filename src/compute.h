@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include "mandel.h"
+#include "allocator.h"
+
+struct Init;
+struct Options;
+
+// mirrors the TileParams push constant block in mandel.comp
+struct TilePush {
+	int32_t offset[2];
+};
+
+// mirrors the ProgressParams push constant block in mandel_progressive.comp, which starts like TilePush
+struct ProgressPush {
+	int32_t offset[2];
+	uint32_t budget;
+	uint32_t restart;
+};
+
+// mirrors PixelState in mandel_progressive.comp, std430 padding included
+struct PixelState {
+	uint32_t z[4];
+	uint32_t n;
+	uint32_t done;
+	uint32_t pad[2];
+};
+
+// mirrors the SubdivideParams push constant block in mandel_subdivide.comp
+struct SubdividePush {
+	uint32_t square_size;
+	uint32_t list;
+	uint32_t next;
+	uint32_t min_size;
+};
+
+// SubdividePush::list on the first level and ::next on the last
+const uint32_t SUBDIVIDE_NO_LIST = 0xFFFFFFFF;
+
+struct ComputeEngine {
+	uint32_t local_size[2] = { 16, 16 };
+	uint32_t tile_size = 256;
+	// iterations per pixel per progressive pass, 0 when progressive mode is off
+	uint32_t progressive_budget = 0;
+	// Mariani-Silver instead of iterating every pixel, see mandel_subdivide.comp
+	bool subdivide = false;
+	// baked into every iteration pipeline, the tile cache's included; the cap stays in the uniform buffer so
+	// changing it needs no new pipelines
+	KernelConstants constants;
+
+	VkDescriptorSetLayout set_layout;
+	VkPipelineLayout pipeline_layout;
+	// one per precision tier, VK_NULL_HANDLE for f64 on devices without shaderFloat64
+	VkPipeline pipelines[PRECISION_COUNT];
+	// the same per tier for mandel_progressive.comp, only created in progressive mode
+	VkPipeline progressive_pipelines[PRECISION_COUNT];
+	// and for mandel_subdivide.comp, only created with subdivide set
+	VkPipeline subdivide_pipelines[PRECISION_COUNT];
+
+	VkDescriptorPool descriptor_pool;
+	std::vector<VkDescriptorSet> descriptor_sets;
+
+	// colour output that gets blitted to the swapchain, plus the raw iteration count and |z|^2 at
+	// escape per pixel that colorize.comp builds it from
+	VkExtent2D extent;
+	VkImage image;
+	Allocation image_memory;
+	VkImageView image_view;
+	VkBuffer iterations;
+	Allocation iterations_memory;
+	VkBuffer magnitudes;
+	Allocation magnitudes_memory;
+	// progressive mode's per-pixel z, iteration count and done flag
+	VkBuffer states;
+	Allocation states_memory;
+	// subdivide's rectangle lists, one per level after the first, each an indirect dispatch header and
+	// room for every rectangle that level could get; subdivide_lists has their offsets in words
+	std::vector<uint32_t> subdivide_lists;
+	VkBuffer rects;
+	Allocation rects_memory;
+};
+
+// map entries for a KernelConstants that sits offset bytes into a pipeline's specialization data
+void kernel_constant_entries(uint32_t offset, std::vector<VkSpecializationMapEntry>& entries);
+
+// one descriptor set per uniform slot, bound to the same iteration and magnitude buffers
+int create_compute_pipeline(Init& init, ComputeEngine& compute, const Options& options, const UniformRing& uniforms);
+int create_compute_targets(Init& init, ComputeEngine& compute, VkExtent2D extent);
+void destroy_compute_targets(Init& init, ComputeEngine& compute);
+void destroy_compute_pipeline(Init& init, ComputeEngine& compute);
+
+// dispatches every tile in the given precision, or the subdivision levels with subdivide set, leaving the iteration and magnitude buffers ready for
+// record_colorize and transfer reads
+void record_compute(Init& init, ComputeEngine& compute, VkCommandBuffer cmd, VkDescriptorSet set, Precision precision);
+// the same without subdivision over only the top rows, which hybrid frames round to whole workgroup rows
+void record_compute_rows(Init& init, ComputeEngine& compute, VkCommandBuffer cmd, VkDescriptorSet set, Precision precision, uint32_t rows);
+// one progressive pass: every unfinished pixel advances by up to compute.progressive_budget iterations,
+// from z = 0 when restart is set. Leaves the buffers like record_compute does.
+void record_progressive(Init& init, ComputeEngine& compute, VkCommandBuffer cmd, VkDescriptorSet set, Precision precision, bool restart);
+// blits the storage image into dst, which may be in any layout and ends up in final_layout
+void record_compute_blit(Init& init, ComputeEngine& compute, VkCommandBuffer cmd, VkImage dst, VkExtent2D dst_extent, VkImageLayout final_layout);
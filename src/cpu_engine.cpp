@@ -0,0 +1,534 @@
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+#include "cpu_engine.h"
+#include "tile_scheduler.h"
+
+// every row kernel renders pixels [x0, x1) of row y, every column kernel rows [y0, y1) of column x, and all
+// must match iterate_mandelbrot bit for bit: same operation order, no FMA (the Makefile turns contraction
+// off), escape tested after the update
+
+static bool early_out(const MandelParams& p) {
+	return (p.flags & MANDEL_FLAG_EARLY_OUT) != 0;
+}
+
+static void row_scalar(const MandelParams& p, uint32_t y, uint32_t x0, uint32_t x1, uint32_t* out) {
+	double cy = pixel_coord(p.edges[1], p.step[1], y);
+	for (uint32_t x = x0; x < x1; x++)
+		out[x] = iterate_mandelbrot(pixel_coord(p.edges[0], p.step[0], x), cy, p.max_iterations, early_out(p));
+}
+
+static void column_scalar(const MandelParams& p, uint32_t x, uint32_t y0, uint32_t y1, uint32_t* out) {
+	double cx = pixel_coord(p.edges[0], p.step[0], x);
+	for (uint32_t y = y0; y < y1; y++)
+		out[(size_t) y * p.extent[0] + x] = iterate_mandelbrot(cx, pixel_coord(p.edges[1], p.step[1], y), p.max_iterations, early_out(p));
+}
+
+// point kernels iterate any pixels, out[pixels[i]] for i in [0, count), so scattered ones still fill every lane
+static void points_scalar(const MandelParams& p, const uint32_t* pixels, uint32_t count, uint32_t* out) {
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t x = pixels[i] % p.extent[0];
+		uint32_t y = pixels[i] / p.extent[0];
+		out[pixels[i]] = iterate_mandelbrot(pixel_coord(p.edges[0], p.step[0], x), pixel_coord(p.edges[1], p.step[1], y), p.max_iterations, early_out(p));
+	}
+}
+
+// lane l of a batch starting at i, the last point again past the end so every lane has something to iterate
+static inline void point_coords(const MandelParams& p, const uint32_t* pixels, uint32_t count, uint32_t i, uint32_t l, double& cx, double& cy) {
+	uint32_t pixel = pixels[std::min(i + l, count - 1)];
+	cx = pixel_coord(p.edges[0], p.step[0], pixel % p.extent[0]);
+	cy = pixel_coord(p.edges[1], p.step[1], pixel / p.extent[0]);
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// escape counts for four points at once, early outs included. Every lane runs the same Brent schedule, since
+// they all start together, and lanes found cycling only drop out when the saved z moves on: they can't escape
+// in the meantime, and keeping the comparison out of the mask the next update waits on keeps it nearly free.
+__attribute__((target("avx2")))
+static inline void iterate_avx2(__m256d cx, __m256d cy, const MandelParams& p, uint32_t counts[4]) {
+	const __m256d two = _mm256_set1_pd(2.0);
+	const __m256d four = _mm256_set1_pd(4.0);
+	const __m256d quarter = _mm256_set1_pd(0.25);
+	bool check = early_out(p);
+
+	__m256d zr = _mm256_setzero_pd();
+	__m256d zi = _mm256_setzero_pd();
+	__m256d result = _mm256_set1_pd((double) p.max_iterations);
+	__m256d active = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+
+	if (check) {
+		// known_interior, lane by lane; those lanes keep max_iterations
+		__m256d xq = _mm256_sub_pd(cx, quarter);
+		__m256d y2 = _mm256_mul_pd(cy, cy);
+		__m256d q = _mm256_add_pd(_mm256_mul_pd(xq, xq), y2);
+		__m256d cardioid = _mm256_cmp_pd(_mm256_mul_pd(q, _mm256_add_pd(q, xq)), _mm256_mul_pd(quarter, y2), _CMP_LE_OQ);
+		__m256d xb = _mm256_add_pd(cx, _mm256_set1_pd(1.0));
+		__m256d bulb = _mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(xb, xb), y2), _mm256_set1_pd(0.0625), _CMP_LE_OQ);
+		active = _mm256_andnot_pd(_mm256_or_pd(cardioid, bulb), active);
+	}
+	__m256d saved_r = zr;
+	__m256d saved_i = zi;
+	__m256d cycled = _mm256_setzero_pd();
+	uint32_t window = 1, seen = 0;
+
+	for (uint32_t i = 0; i < p.max_iterations && _mm256_movemask_pd(active) != 0; i++) {
+		__m256d re = _mm256_sub_pd(_mm256_mul_pd(zr, zr), _mm256_mul_pd(zi, zi));
+		__m256d im = _mm256_mul_pd(_mm256_mul_pd(two, zr), zi);
+		// escaped lanes keep their last z so they never run off to inf/nan
+		zr = _mm256_blendv_pd(zr, _mm256_add_pd(re, cx), active);
+		zi = _mm256_blendv_pd(zi, _mm256_add_pd(im, cy), active);
+
+		__m256d len = _mm256_add_pd(_mm256_mul_pd(zr, zr), _mm256_mul_pd(zi, zi));
+		__m256d escaped = _mm256_and_pd(_mm256_cmp_pd(len, four, _CMP_GE_OQ), active);
+		result = _mm256_blendv_pd(result, _mm256_set1_pd((double) i), escaped);
+		active = _mm256_andnot_pd(escaped, active);
+
+		if (check) {
+			cycled = _mm256_or_pd(cycled, _mm256_and_pd(_mm256_cmp_pd(zr, saved_r, _CMP_EQ_OQ), _mm256_cmp_pd(zi, saved_i, _CMP_EQ_OQ)));
+			if (++seen == window) {
+				active = _mm256_andnot_pd(cycled, active);
+				saved_r = zr;
+				saved_i = zi;
+				seen = 0;
+				window *= 2;
+			}
+		}
+	}
+
+	// there is no unsigned conversion before AVX-512, so counts of 2^31 and up go through the signed one shifted
+	__m128i shifted = _mm256_cvttpd_epi32(_mm256_sub_pd(result, _mm256_set1_pd(2147483648.0)));
+	_mm_storeu_si128((__m128i*) counts, _mm_xor_si128(shifted, _mm_set1_epi32(INT32_MIN)));
+}
+
+__attribute__((target("avx2")))
+static void row_avx2(const MandelParams& p, uint32_t y, uint32_t x0, uint32_t x1, uint32_t* out) {
+	const __m256d lane = _mm256_set_pd(3.5, 2.5, 1.5, 0.5);
+	const __m256d cy = _mm256_set1_pd(pixel_coord(p.edges[1], p.step[1], y));
+
+	for (uint32_t x = x0; x < x1; x += 4) {
+		// (x + lane) + 0.5 is exact, so this is the same coordinate pixel_coord gives each lane
+		__m256d px = _mm256_add_pd(_mm256_set1_pd((double) x), lane);
+		__m256d cx = _mm256_add_pd(_mm256_set1_pd(p.edges[0]), _mm256_mul_pd(_mm256_set1_pd(p.step[0]), px));
+
+		uint32_t counts[4];
+		iterate_avx2(cx, cy, p, counts);
+		for (uint32_t l = 0; l < 4 && x + l < x1; l++)
+			out[x + l] = counts[l];
+	}
+}
+
+__attribute__((target("avx2")))
+static void column_avx2(const MandelParams& p, uint32_t x, uint32_t y0, uint32_t y1, uint32_t* out) {
+	const __m256d lane = _mm256_set_pd(3.5, 2.5, 1.5, 0.5);
+	const __m256d cx = _mm256_set1_pd(pixel_coord(p.edges[0], p.step[0], x));
+
+	for (uint32_t y = y0; y < y1; y += 4) {
+		__m256d py = _mm256_add_pd(_mm256_set1_pd((double) y), lane);
+		__m256d cy = _mm256_add_pd(_mm256_set1_pd(p.edges[1]), _mm256_mul_pd(_mm256_set1_pd(p.step[1]), py));
+
+		uint32_t counts[4];
+		iterate_avx2(cx, cy, p, counts);
+		for (uint32_t l = 0; l < 4 && y + l < y1; l++)
+			out[(size_t) (y + l) * p.extent[0] + x] = counts[l];
+	}
+}
+
+__attribute__((target("avx2")))
+static void points_avx2(const MandelParams& p, const uint32_t* pixels, uint32_t count, uint32_t* out) {
+	for (uint32_t i = 0; i < count; i += 4) {
+		double cx[4], cy[4];
+		for (uint32_t l = 0; l < 4; l++)
+			point_coords(p, pixels, count, i, l, cx[l], cy[l]);
+
+		uint32_t counts[4];
+		iterate_avx2(_mm256_loadu_pd(cx), _mm256_loadu_pd(cy), p, counts);
+		for (uint32_t l = 0; l < 4 && i + l < count; l++)
+			out[pixels[i + l]] = counts[l];
+	}
+}
+
+__attribute__((target("avx512f")))
+static inline void iterate_avx512(__m512d cx, __m512d cy, const MandelParams& p, uint32_t counts[8]) {
+	const __m512d two = _mm512_set1_pd(2.0);
+	const __m512d four = _mm512_set1_pd(4.0);
+	const __m512d quarter = _mm512_set1_pd(0.25);
+	bool check = early_out(p);
+
+	__m512d zr = _mm512_setzero_pd();
+	__m512d zi = _mm512_setzero_pd();
+	__m512d result = _mm512_set1_pd((double) p.max_iterations);
+	__mmask8 active = 0xFF;
+
+	if (check) {
+		__m512d xq = _mm512_sub_pd(cx, quarter);
+		__m512d y2 = _mm512_mul_pd(cy, cy);
+		__m512d q = _mm512_add_pd(_mm512_mul_pd(xq, xq), y2);
+		__mmask8 cardioid = _mm512_cmp_pd_mask(_mm512_mul_pd(q, _mm512_add_pd(q, xq)), _mm512_mul_pd(quarter, y2), _CMP_LE_OQ);
+		__m512d xb = _mm512_add_pd(cx, _mm512_set1_pd(1.0));
+		__mmask8 bulb = _mm512_cmp_pd_mask(_mm512_add_pd(_mm512_mul_pd(xb, xb), y2), _mm512_set1_pd(0.0625), _CMP_LE_OQ);
+		active &= ~(cardioid | bulb);
+	}
+	__m512d saved_r = zr;
+	__m512d saved_i = zi;
+	__mmask8 cycled = 0;
+	uint32_t window = 1, seen = 0;
+
+	for (uint32_t i = 0; i < p.max_iterations && active != 0; i++) {
+		__m512d re = _mm512_sub_pd(_mm512_mul_pd(zr, zr), _mm512_mul_pd(zi, zi));
+		__m512d im = _mm512_mul_pd(_mm512_mul_pd(two, zr), zi);
+		zr = _mm512_mask_add_pd(zr, active, re, cx);
+		zi = _mm512_mask_add_pd(zi, active, im, cy);
+
+		__m512d len = _mm512_add_pd(_mm512_mul_pd(zr, zr), _mm512_mul_pd(zi, zi));
+		__mmask8 escaped = _mm512_mask_cmp_pd_mask(active, len, four, _CMP_GE_OQ);
+		result = _mm512_mask_mov_pd(result, escaped, _mm512_set1_pd((double) i));
+		active &= ~escaped;
+
+		if (check) {
+			cycled |= _mm512_cmp_pd_mask(zr, saved_r, _CMP_EQ_OQ) & _mm512_cmp_pd_mask(zi, saved_i, _CMP_EQ_OQ);
+			if (++seen == window) {
+				active &= ~cycled;
+				saved_r = zr;
+				saved_i = zi;
+				seen = 0;
+				window *= 2;
+			}
+		}
+	}
+
+	// the maskz form sidesteps a gcc 12 -Wmaybe-uninitialized false positive in the plain intrinsic
+	_mm256_storeu_si256((__m256i*) counts, _mm512_maskz_cvttpd_epu32(0xFF, result));
+}
+
+__attribute__((target("avx512f")))
+static void row_avx512(const MandelParams& p, uint32_t y, uint32_t x0, uint32_t x1, uint32_t* out) {
+	const __m512d lane = _mm512_set_pd(7.5, 6.5, 5.5, 4.5, 3.5, 2.5, 1.5, 0.5);
+	const __m512d cy = _mm512_set1_pd(pixel_coord(p.edges[1], p.step[1], y));
+
+	for (uint32_t x = x0; x < x1; x += 8) {
+		__m512d px = _mm512_add_pd(_mm512_set1_pd((double) x), lane);
+		__m512d cx = _mm512_add_pd(_mm512_set1_pd(p.edges[0]), _mm512_mul_pd(_mm512_set1_pd(p.step[0]), px));
+
+		uint32_t counts[8];
+		iterate_avx512(cx, cy, p, counts);
+		for (uint32_t l = 0; l < 8 && x + l < x1; l++)
+			out[x + l] = counts[l];
+	}
+}
+
+__attribute__((target("avx512f")))
+static void column_avx512(const MandelParams& p, uint32_t x, uint32_t y0, uint32_t y1, uint32_t* out) {
+	const __m512d lane = _mm512_set_pd(7.5, 6.5, 5.5, 4.5, 3.5, 2.5, 1.5, 0.5);
+	const __m512d cx = _mm512_set1_pd(pixel_coord(p.edges[0], p.step[0], x));
+
+	for (uint32_t y = y0; y < y1; y += 8) {
+		__m512d py = _mm512_add_pd(_mm512_set1_pd((double) y), lane);
+		__m512d cy = _mm512_add_pd(_mm512_set1_pd(p.edges[1]), _mm512_mul_pd(_mm512_set1_pd(p.step[1]), py));
+
+		uint32_t counts[8];
+		iterate_avx512(cx, cy, p, counts);
+		for (uint32_t l = 0; l < 8 && y + l < y1; l++)
+			out[(size_t) (y + l) * p.extent[0] + x] = counts[l];
+	}
+}
+
+__attribute__((target("avx512f")))
+static void points_avx512(const MandelParams& p, const uint32_t* pixels, uint32_t count, uint32_t* out) {
+	for (uint32_t i = 0; i < count; i += 8) {
+		double cx[8], cy[8];
+		for (uint32_t l = 0; l < 8; l++)
+			point_coords(p, pixels, count, i, l, cx[l], cy[l]);
+
+		uint32_t counts[8];
+		iterate_avx512(_mm512_loadu_pd(cx), _mm512_loadu_pd(cy), p, counts);
+		for (uint32_t l = 0; l < 8 && i + l < count; l++)
+			out[pixels[i + l]] = counts[l];
+	}
+}
+
+#endif
+
+typedef void (*RowKernel)(const MandelParams& p, uint32_t y, uint32_t x0, uint32_t x1, uint32_t* out);
+typedef void (*ColumnKernel)(const MandelParams& p, uint32_t x, uint32_t y0, uint32_t y1, uint32_t* out);
+typedef void (*PointKernel)(const MandelParams& p, const uint32_t* pixels, uint32_t count, uint32_t* out);
+
+struct Kernels {
+	RowKernel row;
+	ColumnKernel column;
+	PointKernel points;
+};
+
+// Mariani-Silver over the rectangle [x0, x1] x [y0, y1], inclusive, whose border is already iterated: fill the
+// inside when the border escaped on a single count, otherwise iterate the cross through its middle and recurse
+// into the four quarters it borders. The escape count's level sets are simply connected, so a filled inside
+// can only be wrong about features thinner than a pixel. Flat bands aren't filled when smoothing, since their
+// |z| at escape still varies. mandel_subdivide.comp follows the same rectangles and rules.
+static void subdivide_rect(const Kernels& k, const MandelParams& p, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t* out) {
+	if (x1 - x0 < 2 || y1 - y0 < 2)
+		return;
+
+	uint32_t width = p.extent[0];
+	auto at = [&](uint32_t x, uint32_t y) -> uint32_t& { return out[(size_t) y * width + x]; };
+
+	uint32_t lowest = at(x0, y0);
+	uint32_t highest = lowest;
+	for (uint32_t x = x0; x <= x1; x++) {
+		lowest = std::min({ lowest, at(x, y0), at(x, y1) });
+		highest = std::max({ highest, at(x, y0), at(x, y1) });
+	}
+	for (uint32_t y = y0 + 1; y < y1; y++) {
+		lowest = std::min({ lowest, at(x0, y), at(x1, y) });
+		highest = std::max({ highest, at(x0, y), at(x1, y) });
+	}
+
+	bool smooth = (p.flags & MANDEL_FLAG_SMOOTH) != 0;
+	if (lowest == highest && (lowest == p.max_iterations || !smooth)) {
+		for (uint32_t y = y0 + 1; y < y1; y++)
+			std::fill(&at(x0 + 1, y), &at(x1, y), lowest);
+		return;
+	}
+
+	if (std::max(x1 - x0, y1 - y0) <= SUBDIVIDE_MIN_SIZE) {
+		for (uint32_t y = y0 + 1; y < y1; y++)
+			k.row(p, y, x0 + 1, x1, out + (size_t) y * width);
+		return;
+	}
+
+	uint32_t mx = (x0 + x1) / 2;
+	uint32_t my = (y0 + y1) / 2;
+	k.row(p, my, x0 + 1, x1, out + (size_t) my * width);
+	k.column(p, mx, y0 + 1, my, out);
+	k.column(p, mx, my + 1, y1, out);
+
+	subdivide_rect(k, p, x0, y0, mx, my, out);
+	subdivide_rect(k, p, mx, y0, x1, my, out);
+	subdivide_rect(k, p, x0, my, mx, y1, out);
+	subdivide_rect(k, p, mx, my, x1, y1, out);
+}
+
+// one SUBDIVIDE_SIZE square, clipped to the image: its own border, then whatever of the inside needs it
+static void subdivide_square(const Kernels& k, const MandelParams& p, uint32_t x0, uint32_t y0, uint32_t* out) {
+	uint32_t width = p.extent[0];
+	uint32_t x1 = std::min(x0 + SUBDIVIDE_SIZE, p.extent[0]) - 1;
+	uint32_t y1 = std::min(y0 + SUBDIVIDE_SIZE, p.extent[1]) - 1;
+
+	k.row(p, y0, x0, x1 + 1, out + (size_t) y0 * width);
+	if (y1 > y0)
+		k.row(p, y1, x0, x1 + 1, out + (size_t) y1 * width);
+	k.column(p, x0, y0 + 1, y1, out);
+	if (x1 > x0)
+		k.column(p, x1, y0 + 1, y1, out);
+
+	subdivide_rect(k, p, x0, y0, x1, y1, out);
+}
+
+CpuIsa cpu_best_isa() {
+#ifdef HAVE_X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return CPU_ISA_AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return CPU_ISA_AVX2;
+#endif
+	return CPU_ISA_SCALAR;
+}
+
+int cpu_engine_init(CpuEngine& cpu, const Options& options) {
+	CpuIsa best = cpu_best_isa();
+
+	cpu.isa = (options.cpu_isa == CPU_ISA_AUTO) ? best : options.cpu_isa;
+	if (cpu.isa > best) {
+		std::cout << "this CPU can't run " << cpu_isa_name(cpu.isa) << " kernels, best is " << cpu_isa_name(best) << "\n";
+		return -1;
+	}
+
+	cpu.subdivide = options.subdivide;
+	cpu.threads = options.threads;
+	if (cpu.threads == 0)
+		cpu.threads = std::max(1u, std::thread::hardware_concurrency());
+	return 0;
+}
+
+static Kernels pick_kernels(const CpuEngine& cpu) {
+	Kernels k = { row_scalar, column_scalar, points_scalar };
+#ifdef HAVE_X86_KERNELS
+	if (cpu.isa == CPU_ISA_AVX512)
+		k = { row_avx512, column_avx512, points_avx512 };
+	else if (cpu.isa == CPU_ISA_AVX2)
+		k = { row_avx2, column_avx2, points_avx2 };
+#endif
+	return k;
+}
+
+// points along each side of the grid a tile's cost is guessed from: 16 for a 64 pixel tile's 4096
+static const uint32_t COST_PROBE = 4;
+
+static uint64_t probe_cost(const MandelParams& p, const TileRect& tile) {
+	uint64_t cost = 0;
+	for (uint32_t j = 0; j < COST_PROBE; j++) {
+		uint32_t y = tile.y0 + (2 * j + 1) * (tile.y1 - tile.y0) / (2 * COST_PROBE);
+		double cy = pixel_coord(p.edges[1], p.step[1], y);
+		for (uint32_t i = 0; i < COST_PROBE; i++) {
+			uint32_t x = tile.x0 + (2 * i + 1) * (tile.x1 - tile.x0) / (2 * COST_PROBE);
+			// plus one, so the empty outside still costs something
+			cost += iterate_mandelbrot(pixel_coord(p.edges[0], p.step[0], x), cy, p.max_iterations, early_out(p)) + 1;
+		}
+	}
+	return cost;
+}
+
+// tiles rather than rows so neighbouring interior and exterior pixels spread over the threads, the costliest
+// first so the cheap ones fill in at the end
+void cpu_render_rows(const CpuEngine& cpu, const MandelParams& params, uint32_t y0, uint32_t y1, uint32_t* iterations) {
+	Kernels k = pick_kernels(cpu);
+	uint32_t width = params.extent[0];
+
+	std::vector<TileRect> tiles = grid_tiles(width, y1 - y0, cpu.tile_size);
+	for (TileRect& t : tiles) {
+		t.y0 += y0;
+		t.y1 += y0;
+	}
+	TileSchedule schedule = {
+		.threads = cpu.threads,
+		.cost = [&](const TileRect& t) { return probe_cost(params, t); },
+	};
+	schedule_tiles(schedule, tiles, [&](const TileRect& t) {
+		for (uint32_t y = t.y0; y < t.y1; y++)
+			k.row(params, y, t.x0, t.x1, iterations + (size_t) (y - y0) * width);
+	});
+}
+
+// subdivision squares sit on a fixed grid, so those stay whole
+void cpu_render(const CpuEngine& cpu, const MandelParams& params, uint32_t* iterations) {
+	if (!cpu.subdivide) {
+		cpu_render_rows(cpu, params, 0, params.extent[1], iterations);
+		return;
+	}
+
+	Kernels k = pick_kernels(cpu);
+	TileSchedule schedule = {
+		.threads = cpu.threads,
+		.split = false,
+		.cost = [&](const TileRect& t) { return probe_cost(params, t); },
+	};
+	schedule_tiles(schedule, grid_tiles(params.extent[0], params.extent[1], SUBDIVIDE_SIZE), [&](const TileRect& t) {
+		subdivide_square(k, params, t.x0, t.y0, iterations);
+	});
+}
+
+uint64_t cpu_render_reprojected(const CpuEngine& cpu, const MandelParams& params, const CpuFrame& previous, CpuFrame& frame) {
+	uint32_t width = params.extent[0];
+	uint32_t height = params.extent[1];
+	size_t pixels = (size_t) width * height;
+	frame.params = params;
+	frame.iterations.resize(pixels);
+	frame.offsets.assign(pixels * 2, 0.0f);
+	if (previous.iterations.empty() || previous.params.max_iterations != params.max_iterations || previous.params.flags != params.flags) {
+		cpu_render(cpu, params, frame.iterations.data());
+		return pixels;
+	}
+
+	// where each of the last frame's samples lands, in this frame's pixels
+	const MandelParams& last = previous.params;
+	auto land = [&](size_t source, double& px, double& py) {
+		uint32_t x = (uint32_t) (source % last.extent[0]);
+		uint32_t y = (uint32_t) (source / last.extent[0]);
+		double sx = pixel_coord(last.edges[0], last.step[0], x) + previous.offsets[source * 2] * last.step[0];
+		double sy = pixel_coord(last.edges[1], last.step[1], y) + previous.offsets[source * 2 + 1] * last.step[1];
+		px = (sx - params.edges[0]) / params.step[0];
+		py = (sy - params.edges[1]) / params.step[1];
+		return px >= 0 && px < width && py >= 0 && py < height;
+	};
+
+	// the distance from the centre, in pixels, of the sample each pixel took; EMPTY marks pixels with none yet
+	const float EMPTY = std::numeric_limits<float>::max();
+	std::vector<float> distance(pixels, EMPTY);
+
+	// every sample goes to the pixel its point is in, the nearest to the centre winning where several are;
+	// pixels no sample fell in get iterated rather than borrowing a neighbour's
+	size_t sources = (size_t) last.extent[0] * last.extent[1];
+	for (size_t source = 0; source < sources; source++) {
+		double px, py;
+		if (!land(source, px, py))
+			continue;
+		uint32_t tx = (uint32_t) px;
+		uint32_t ty = (uint32_t) py;
+		float dx = (float) (px - tx - 0.5);
+		float dy = (float) (py - ty - 0.5);
+		size_t target = (size_t) ty * width + tx;
+		if (std::max(fabsf(dx), fabsf(dy)) < distance[target]) {
+			distance[target] = std::max(fabsf(dx), fabsf(dy));
+			frame.iterations[target] = previous.iterations[source];
+			frame.offsets[target * 2] = dx;
+			frame.offsets[target * 2 + 1] = dy;
+		}
+	}
+
+	// a count only stands for its pixel where the plane is flat all round it: its sample within half a pixel of
+	// the centre, and all eight neighbours reused and no more than REPROJECT_MAX_DELTA away. A pixel on the edge,
+	// or next to one without a sample, could be anything, so it gets iterated too. Decided on the reused counts
+	// alone, so it doesn't spread.
+	std::vector<uint8_t> doubtful(pixels, 0);
+	auto differ = [&](uint32_t a, uint32_t b) {
+		if ((a == params.max_iterations) != (b == params.max_iterations))
+			return true;
+		return (a > b ? a - b : b - a) > REPROJECT_MAX_DELTA;
+	};
+	for (uint32_t y = 0; y < height; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			size_t pixel = (size_t) y * width + x;
+			if (distance[pixel] == EMPTY)
+				continue;
+			float dx = frame.offsets[pixel * 2];
+			float dy = frame.offsets[pixel * 2 + 1];
+			if (x == 0 || y == 0 || x + 1 == width || y + 1 == height || dx * dx + dy * dy > 0.25f) {
+				doubtful[pixel] = 1;
+				continue;
+			}
+			for (uint32_t ny = y - 1; ny <= y + 1 && !doubtful[pixel]; ny++) {
+				for (uint32_t nx = x - 1; nx <= x + 1; nx++) {
+					size_t other = (size_t) ny * width + nx;
+					if (distance[other] == EMPTY || differ(frame.iterations[pixel], frame.iterations[other])) {
+						doubtful[pixel] = 1;
+						break;
+					}
+				}
+			}
+		}
+	}
+	for (size_t pixel = 0; pixel < pixels; pixel++) {
+		if (doubtful[pixel]) {
+			distance[pixel] = EMPTY;
+			frame.offsets[pixel * 2] = frame.offsets[pixel * 2 + 1] = 0.0f;
+		}
+	}
+
+	// what's left is scattered, so it goes to the point kernel a tile at a time
+	Kernels k = pick_kernels(cpu);
+	std::atomic<uint64_t> iterated { 0 };
+	TileSchedule schedule = { .threads = cpu.threads };
+	schedule_tiles(schedule, grid_tiles(width, height, cpu.tile_size), [&](const TileRect& t) {
+		std::vector<uint32_t> empty;
+		for (uint32_t y = t.y0; y < t.y1; y++) {
+			for (uint32_t x = t.x0; x < t.x1; x++) {
+				if (distance[(size_t) y * width + x] == EMPTY)
+					empty.push_back(y * width + x);
+			}
+		}
+		k.points(params, empty.data(), (uint32_t) empty.size(), frame.iterations.data());
+		iterated += empty.size();
+	});
+	return iterated;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "mandel.h"
+#include "options.h"
+
+struct CpuEngine {
+	CpuIsa isa;
+	unsigned threads;
+	// square tiles handed out to worker threads
+	uint32_t tile_size = 64;
+	// hand out SUBDIVIDE_SIZE squares instead and only iterate their borders where that's enough
+	bool subdivide = false;
+};
+
+// widest instruction set this CPU can run
+CpuIsa cpu_best_isa();
+
+// resolves auto settings and rejects an ISA the CPU lacks
+int cpu_engine_init(CpuEngine& cpu, const Options& options);
+
+// fills width*height iteration counts with exactly the values mandel.comp would produce, or with subdivide
+// set the values mandel_subdivide.comp would
+void cpu_render(const CpuEngine& cpu, const MandelParams& params, uint32_t* iterations);
+// rows [y0, y1) of params' view, into iterations holding just those rows: each pixel's point comes from the
+// view's own edges and its row in the whole view, as the shaders work it out, so the counts are the ones
+// cpu_render gives those rows. Never subdivides.
+void cpu_render_rows(const CpuEngine& cpu, const MandelParams& params, uint32_t y0, uint32_t y1, uint32_t* iterations);
+
+// how far apart, in iterations, a reprojected count and its reprojected neighbours may be for it to be kept;
+// past that its pixel straddles detail the moved point may have missed. Even at 0 a few counts in a million
+// still differ from the pixel centre's own.
+const uint32_t REPROJECT_MAX_DELTA = 0;
+
+// one frame of an animation, kept for the next to reproject from
+struct CpuFrame {
+	MandelParams params;
+	std::vector<uint32_t> iterations;
+	// per pixel, x then y, where the point its count belongs to lies, in pixels from the pixel's centre
+	std::vector<float> offsets;
+};
+
+// the next frame of an animation: each count of the previous frame moves to the pixel its point now falls in, and
+// is kept where all eight reprojected neighbours agree with it (see REPROJECT_MAX_DELTA); the rest are iterated.
+// Points keep their place in the plane from frame to frame, so nothing drifts however long a count is reused.
+// Returns how many pixels were iterated; everything is when previous is empty or has another cap or flags.
+uint64_t cpu_render_reprojected(const CpuEngine& cpu, const MandelParams& params, const CpuFrame& previous, CpuFrame& frame);
@@ -0,0 +1,396 @@
+#include <stdio.h>
+
+#include <iostream>
+#include <vector>
+
+#include "render.h"
+#include "fixed.h"
+#include "deep.h"
+
+static int create_host_buffer(Init& init, VkDeviceSize size, VkBuffer& buffer, Allocation& memory, void*& mapped) {
+	VkBufferCreateInfo buffer_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	if (init.disp.createBuffer(&buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+		std::cout << "failed to create deep engine buffer\n";
+		return -1;
+	}
+
+	if (0 != allocate_buffer_memory(init, buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory)) {
+		std::cout << "failed to allocate deep engine buffer memory\n";
+		return -1;
+	}
+	mapped = memory.mapped;
+	return 0;
+}
+
+int create_deep_pipeline(Init& init, DeepEngine& deep, const Options& options, ComputeEngine& compute) {
+	VkDescriptorSetLayoutBinding bindings[4] = {};
+	bindings[0].binding = 1;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].binding = 2;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[2].binding = 3;
+	bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[3].binding = 4;
+	bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	for (auto& binding : bindings) {
+		binding.descriptorCount = 1;
+		binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = 4,
+		.pBindings = bindings
+	};
+	if (init.disp.createDescriptorSetLayout(&setLayoutCreateInfo, nullptr, &deep.set_layout) != VK_SUCCESS) {
+		std::cout << "failed to create deep descriptor set layout\n";
+		return -1;
+	}
+
+	VkDescriptorPoolSize poolSizes[2] = {
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 },
+	};
+	VkDescriptorPoolCreateInfo poolInfo {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.maxSets = 1,
+		.poolSizeCount = 2,
+		.pPoolSizes = poolSizes,
+	};
+	if (init.disp.createDescriptorPool(&poolInfo, nullptr, &deep.descriptor_pool) != VK_SUCCESS) {
+		std::cout << "failed to create deep descriptor pool\n";
+		return -1;
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = deep.descriptor_pool,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &deep.set_layout,
+	};
+	if (init.disp.allocateDescriptorSets(&allocInfo, &deep.descriptor_set) != VK_SUCCESS) {
+		std::cout << "failed to allocate deep descriptor set\n";
+		return -1;
+	}
+
+	// Z_0 through Z_max_iterations
+	deep.orbit_capacity = options.max_iterations + 1;
+	if (0 != create_host_buffer(init, (VkDeviceSize) deep.orbit_capacity * 2 * sizeof(double), deep.orbit, deep.orbit_memory, deep.orbit_mapped)) return -1;
+	void* glitch_mapped;
+	if (0 != create_host_buffer(init, sizeof(GlitchInfo), deep.glitch, deep.glitch_memory, glitch_mapped)) return -1;
+	deep.glitch_mapped = (GlitchInfo*) glitch_mapped;
+
+	VkDescriptorImageInfo imageInfo = {
+		.sampler = VK_NULL_HANDLE,
+		.imageView = compute.image_view,
+		.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+	};
+	VkDescriptorBufferInfo bufferInfos[3] = {
+		{ compute.iterations, 0, VK_WHOLE_SIZE },
+		{ deep.orbit, 0, VK_WHOLE_SIZE },
+		{ deep.glitch, 0, VK_WHOLE_SIZE },
+	};
+	VkWriteDescriptorSet writes[4];
+	for (uint32_t i = 0; i < 4; i++) {
+		writes[i] = {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = deep.descriptor_set,
+			.dstBinding = bindings[i].binding,
+			.descriptorCount = 1,
+			.descriptorType = bindings[i].descriptorType,
+		};
+		if (i == 0)
+			writes[i].pImageInfo = &imageInfo;
+		else
+			writes[i].pBufferInfo = &bufferInfos[i - 1];
+	}
+	init.disp.updateDescriptorSets(4, writes, 0, nullptr);
+
+	VkPushConstantRange pushRange = {
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(DeepPush),
+	};
+	VkPipelineLayoutCreateInfo pipeline_layout_info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &deep.set_layout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &pushRange,
+	};
+	if (init.disp.createPipelineLayout(&pipeline_layout_info, nullptr, &deep.pipeline_layout) != VK_SUCCESS) {
+		std::cout << "failed to create deep pipeline layout\n";
+		return -1;
+	}
+
+	VkShaderModule comp_module = createShaderModule(init, std::string(EXAMPLE_BUILD_DIRECTORY) + "/mandel_deep.comp.spv");
+	if (comp_module == VK_NULL_HANDLE) {
+		std::cout << "failed to create shader module\n";
+		return -1;
+	}
+
+	// same workgroup shape as the compute engine, whose limits create_compute_pipeline already checked
+	VkSpecializationMapEntry spec_entries[2] = {
+		{ 0, 0, sizeof(uint32_t) },
+		{ 1, sizeof(uint32_t), sizeof(uint32_t) },
+	};
+	VkSpecializationInfo spec_info = {
+		.mapEntryCount = 2,
+		.pMapEntries = spec_entries,
+		.dataSize = sizeof(compute.local_size),
+		.pData = compute.local_size,
+	};
+
+	VkComputePipelineCreateInfo pipeline_info = {
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = comp_module,
+			.pName = "main",
+			.pSpecializationInfo = &spec_info,
+		},
+		.layout = deep.pipeline_layout,
+	};
+	VkResult res = init.disp.createComputePipelines(init.pipeline_cache, 1, &pipeline_info, nullptr, &deep.pipeline);
+	init.disp.destroyShaderModule(comp_module, nullptr);
+	if (res != VK_SUCCESS) {
+		std::cout << "failed to create deep pipeline\n";
+		return -1;
+	}
+
+	VkFenceCreateInfo fence_info = {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	if (init.disp.createFence(&fence_info, nullptr, &deep.fence) != VK_SUCCESS) {
+		std::cout << "failed to create deep fence\n";
+		return -1;
+	}
+	return 0;
+}
+
+void destroy_deep_pipeline(Init& init, DeepEngine& deep) {
+	init.disp.destroyFence(deep.fence, nullptr);
+	init.disp.destroyBuffer(deep.orbit, nullptr);
+	free_memory(init, deep.orbit_memory);
+	init.disp.destroyBuffer(deep.glitch, nullptr);
+	free_memory(init, deep.glitch_memory);
+
+	init.disp.destroyPipeline(deep.pipeline, nullptr);
+	init.disp.destroyPipelineLayout(deep.pipeline_layout, nullptr);
+	init.disp.destroyDescriptorPool(deep.descriptor_pool, nullptr);
+	init.disp.destroyDescriptorSetLayout(deep.set_layout, nullptr);
+	// command buffer goes with the command pool
+	deep = {};
+}
+
+// Z_0 = 0 up to the point the reference escapes or max_iterations, as interleaved re/im doubles.
+// The fixed point values never need more than the few integer bits |Z|^2 + |C| can reach before escape.
+static uint32_t reference_orbit(const Fixed c[2], uint32_t max_iterations, double* orbit) {
+	size_t limbs = c[0].limbs.size();
+	Fixed zr, zi, zr2, zi2, zri;
+	for (Fixed* f : { &zr, &zi, &zr2, &zi2, &zri })
+		fixed_init(*f, limbs);
+
+	orbit[0] = 0;
+	orbit[1] = 0;
+	uint32_t n = 1;
+	while (n <= max_iterations) {
+		fixed_mul(zr2, zr, zr);
+		fixed_mul(zi2, zi, zi);
+		fixed_mul(zri, zr, zi);
+		fixed_sub(zr, zr2, zi2);
+		fixed_add(zr, zr, c[0]);
+		fixed_add(zi, zri, zri);
+		fixed_add(zi, zi, c[1]);
+
+		double x = fixed_to_double(zr);
+		double y = fixed_to_double(zi);
+		orbit[2 * n] = x;
+		orbit[2 * n + 1] = y;
+		n++;
+		if (x * x + y * y >= 4.0)
+			break;
+	}
+	return n;
+}
+
+// offset of a pixel centre from the view centre
+static void pixel_delta(const DeepPush& push, uint32_t x, uint32_t y, double delta[2]) {
+	delta[0] = push.pixel_step[0] * ((double) x + 0.5 - push.extent[0] * 0.5);
+	delta[1] = push.pixel_step[1] * ((double) y + 0.5 - push.extent[1] * 0.5);
+}
+
+static int record_deep_pass(Init& init, RenderData& data, DeepPush push) {
+	DeepEngine& deep = data.deep;
+	ComputeEngine& compute = data.compute;
+
+	if (deep.command_buffer != VK_NULL_HANDLE)
+		init.disp.freeCommandBuffers(data.command_pool, 1, &deep.command_buffer);
+
+	VkCommandBufferAllocateInfo allocInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = data.command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+	if (init.disp.allocateCommandBuffers(&allocInfo, &deep.command_buffer) != VK_SUCCESS) {
+		deep.command_buffer = VK_NULL_HANDLE;
+		return -1;
+	}
+
+	VkCommandBuffer cmd = deep.command_buffer;
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	if (init.disp.beginCommandBuffer(cmd, &begin_info) != VK_SUCCESS)
+		return -1;
+
+	// the first pass overwrites every pixel; glitch passes only touch glitched ones and keep the rest
+	VkImageMemoryBarrier to_general = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = 0,
+		.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.oldLayout = push.glitch_pass ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout = VK_IMAGE_LAYOUT_GENERAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = compute.image,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+	};
+	VkMemoryBarrier previous_writes = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &previous_writes, 0, nullptr, 1, &to_general);
+
+	init.disp.cmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, deep.pipeline);
+	init.disp.cmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, deep.pipeline_layout, 0, 1, &deep.descriptor_set, 0, nullptr);
+
+	uint32_t tile = compute.tile_size;
+	uint32_t groups_x = (tile + compute.local_size[0] - 1) / compute.local_size[0];
+	uint32_t groups_y = (tile + compute.local_size[1] - 1) / compute.local_size[1];
+	for (uint32_t y = 0; y < compute.extent.height; y += tile) {
+		for (uint32_t x = 0; x < compute.extent.width; x += tile) {
+			push.tile_offset[0] = (int32_t) x;
+			push.tile_offset[1] = (int32_t) y;
+			init.disp.cmdPushConstants(cmd, deep.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+			init.disp.cmdDispatch(cmd, groups_x, groups_y, 1);
+		}
+	}
+
+	VkImageMemoryBarrier to_transfer = to_general;
+	to_transfer.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	to_transfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	to_transfer.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	to_transfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+	VkBufferMemoryBarrier buffers_ready[2] = {
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = compute.iterations,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE,
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = deep.glitch,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE,
+		},
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 2, buffers_ready, 1, &to_transfer);
+
+	if (init.disp.endCommandBuffer(cmd) != VK_SUCCESS) {
+		std::cout << "failed to record deep command buffer\n";
+		return -1;
+	}
+	return 0;
+}
+
+int render_deep(Init& init, RenderData& data, const View& view) {
+	DeepEngine& deep = data.deep;
+	ComputeEngine& compute = data.compute;
+
+	DeepPush push = {};
+	push.extent[0] = compute.extent.width;
+	push.extent[1] = compute.extent.height;
+	push.pixel_step[0] = view.size / compute.extent.width;
+	push.pixel_step[1] = push.pixel_step[0];
+	push.max_iterations = data.max_iterations;
+
+	if (push.max_iterations + 1 > deep.orbit_capacity) {
+		std::cout << "deep engine was set up for at most " << deep.orbit_capacity - 1 << " iterations\n";
+		return -1;
+	}
+
+	size_t limbs = fixed_limbs_for(push.pixel_step[0]);
+	Fixed center[2], reference[2], delta;
+	fixed_init(delta, limbs);
+	for (int i = 0; i < 2; i++) {
+		fixed_init(center[i], limbs);
+		fixed_init(reference[i], limbs);
+		if (view.center_text[i].empty())
+			fixed_from_double(center[i], view.center[i]);
+		else if (0 != fixed_parse(center[i], view.center_text[i])) {
+			std::cout << "can't use \"" << view.center_text[i] << "\" as a deep engine centre\n";
+			return -1;
+		}
+	}
+
+	// the first reference is the view centre; every later one sits on a pixel the previous one glitched
+	uint32_t references = 0;
+	uint32_t glitched = 0;
+	for (; references < deep.max_references; references++) {
+		for (int i = 0; i < 2; i++) {
+			fixed_from_double(delta, push.reference_delta[i]);
+			fixed_add(reference[i], center[i], delta);
+		}
+		push.orbit_length = reference_orbit(reference, push.max_iterations, (double*) deep.orbit_mapped);
+		push.glitch_pass = references > 0;
+
+		*deep.glitch_mapped = { 0, 0xFFFFFFFF };
+
+		if (0 != record_deep_pass(init, data, push)) return -1;
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &deep.command_buffer;
+
+		init.disp.resetFences(1, &deep.fence);
+		if (init.disp.queueSubmit(data.graphics_queue, 1, &submitInfo, deep.fence) != VK_SUCCESS) {
+			std::cout << "failed to submit deep command buffer\n";
+			return -1;
+		}
+		if (init.disp.waitForFences(1, &deep.fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+			std::cout << "failed waiting for deep render\n";
+			return -1;
+		}
+
+		glitched = deep.glitch_mapped->count;
+		if (glitched == 0)
+			break;
+
+		uint32_t pixel = deep.glitch_mapped->first_pixel;
+		pixel_delta(push, pixel % push.extent[0], pixel / push.extent[0], push.reference_delta);
+	}
+
+	if (glitched != 0)
+		printf("deep: %u pixels still glitched after %u references\n", glitched, references);
+	return 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vulkan/vulkan_core.h>
+
+#include "allocator.h"
+
+struct Init;
+struct Options;
+struct View;
+struct ComputeEngine;
+struct RenderData;
+
+// iteration count mandel_deep.comp leaves on pixels whose delta lost its precision
+const uint32_t DEEP_GLITCHED = 0xFFFFFFFF;
+
+// mirrors the DeepParams push constant block in mandel_deep.comp
+struct DeepPush {
+	int32_t tile_offset[2];
+	uint32_t extent[2];
+	double pixel_step[2];
+	// reference point minus view centre
+	double reference_delta[2];
+	uint32_t max_iterations;
+	uint32_t orbit_length;
+	// nonzero to only revisit pixels marked DEEP_GLITCHED
+	uint32_t glitch_pass;
+};
+
+// mirrors the GlitchInfo buffer in mandel_deep.comp
+struct GlitchInfo {
+	uint32_t count;
+	uint32_t first_pixel;
+};
+
+// perturbation renderer: one reference orbit per pass is computed on the CPU in fixed point, and the
+// GPU only iterates each pixel's double precision offset from it. Renders into the compute engine's
+// storage image and iteration buffer, so the compute engine's blit and readback work unchanged.
+// Headless only: the window never creates one, and options.cpp turns --engine deep away there.
+struct DeepEngine {
+	// references tried per view before leaving any remaining glitched pixels black
+	uint32_t max_references = 16;
+
+	VkDescriptorSetLayout set_layout;
+	VkPipelineLayout pipeline_layout;
+	VkPipeline pipeline;
+	VkDescriptorPool descriptor_pool;
+	VkDescriptorSet descriptor_set;
+
+	// host visible, so each new reference is a plain memcpy
+	uint32_t orbit_capacity;
+	VkBuffer orbit;
+	Allocation orbit_memory;
+	void* orbit_mapped;
+
+	VkBuffer glitch;
+	Allocation glitch_memory;
+	GlitchInfo* glitch_mapped;
+
+	VkCommandBuffer command_buffer;
+	VkFence fence;
+};
+
+// binds to the compute engine's current targets, so it has to come after create_compute_targets
+int create_deep_pipeline(Init& init, DeepEngine& deep, const Options& options, ComputeEngine& compute);
+void destroy_deep_pipeline(Init& init, DeepEngine& deep);
+
+// renders one view into data.compute's targets and waits for it, leaving the storage image in
+// TRANSFER_SRC_OPTIMAL like record_compute does
+int render_deep(Init& init, RenderData& data, const View& view);
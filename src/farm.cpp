@@ -0,0 +1,545 @@
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "farm.h"
+#include "headless.h"
+#include "image_write.h"
+#include "cpu_engine.h"
+
+// iterations probed per tile on a grid this many points across, to guess how long it will take
+static const uint32_t PROBE_GRID = 8;
+// how long a worker keeps trying to reach a coordinator that isn't listening yet
+static const int CONNECT_SECONDS = 10;
+// a worker that has sent tiles back is given this many times what its own pace says a tile should take, when
+// that's longer than --tile-timeout, before the tile goes to someone else
+static const double STALL_PACE = 8;
+
+static const size_t TILE_BYTES = (size_t) FARM_TILE * FARM_TILE * 4;
+
+// false once the other end has gone; MSG_NOSIGNAL so that doesn't take this process with it
+static bool send_all(int fd, const void* data, size_t size) {
+	const char* p = (const char*) data;
+	while (size > 0) {
+		ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+static bool recv_all(int fd, void* data, size_t size) {
+	char* p = (char*) data;
+	while (size > 0) {
+		ssize_t n = recv(fd, p, size, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+// close on exec, so spawned workers don't hold each other's connections open past their death
+static int farm_socket(const std::string& path, sockaddr_un& address) {
+	address = {};
+	if (path.size() >= sizeof(address.sun_path)) {
+		std::cout << "socket path " << path << " is too long\n";
+		return -1;
+	}
+	address.sun_family = AF_UNIX;
+	memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		std::cout << "failed to create socket: " << strerror(errno) << "\n";
+	return fd;
+}
+
+// one FARM_TILE square of one view, in the order the view's tiles were laid out
+struct FarmTile {
+	uint32_t view;
+	uint32_t x0;
+	uint32_t y0;
+	uint64_t cost;
+	// back from some worker; copies handed out again after a stall are thrown away
+	bool done = false;
+};
+
+// a view being put together, from its first tile going out to its last one coming back
+struct FarmImage {
+	std::vector<uint8_t> rgba;
+	uint32_t remaining;
+	std::chrono::steady_clock::time_point start;
+};
+
+struct FarmWorker {
+	int fd;
+	bool ready = false;
+	FarmHello hello;
+	// sent and not yet back, oldest first, which is the order they come back in
+	std::deque<uint32_t> outstanding;
+	// when the front of outstanding started rendering, as near as the coordinator can tell
+	std::chrono::steady_clock::time_point started;
+	// past its front tile's deadline: everything outstanding has gone to the others as well, and it gets no
+	// more until it sends something back
+	bool stalled = false;
+	uint32_t tiles = 0;
+	double ms = 0;
+	// the estimate_cost of the tiles counted in ms, for its pace
+	uint64_t cost = 0;
+};
+
+// the escape counts of a grid of the tile's pixels, plus one each so the empty outside still costs something
+static uint64_t estimate_cost(const MandelParams& params, uint32_t x0, uint32_t y0, bool early_out) {
+	uint64_t cost = 0;
+	for (uint32_t j = 0; j < PROBE_GRID; j++) {
+		for (uint32_t i = 0; i < PROBE_GRID; i++) {
+			uint32_t x = x0 + (2 * i + 1) * FARM_TILE / (2 * PROBE_GRID);
+			uint32_t y = y0 + (2 * j + 1) * FARM_TILE / (2 * PROBE_GRID);
+			double cx = pixel_coord(params.edges[0], params.step[0], x);
+			double cy = pixel_coord(params.edges[1], params.step[1], y);
+			cost += iterate_mandelbrot(cx, cy, params.max_iterations, early_out) + 1;
+		}
+	}
+	return cost;
+}
+
+// the coordinator's own arguments less the farm's, so every worker renders with the same settings
+static int spawn_workers(const Options& options, int argc, char** argv, std::vector<pid_t>& children) {
+	std::vector<std::string> args = { argv[0] };
+	for (int i = 1; i < argc; i++) {
+		if ((strcmp(argv[i], "--farm") == 0 || strcmp(argv[i], "--spawn") == 0 || strcmp(argv[i], "--tile-timeout") == 0) && i + 1 < argc) {
+			i++;
+			continue;
+		}
+		args.push_back(argv[i]);
+	}
+	// the last --engine wins
+	args.insert(args.end(), { "--worker", options.farm, "--engine", "" });
+
+	// anything still buffered would be written again by every child
+	std::cout.flush();
+	fflush(stdout);
+	for (const SpawnWorkers& spawn : options.spawn) {
+		args.back() = engine_name(spawn.engine);
+		std::vector<char*> child_argv;
+		for (std::string& arg : args)
+			child_argv.push_back(arg.data());
+		child_argv.push_back(nullptr);
+
+		for (uint32_t i = 0; i < spawn.count; i++) {
+			pid_t pid = fork();
+			if (pid < 0) {
+				std::cout << "failed to start a worker: " << strerror(errno) << "\n";
+				return -1;
+			}
+			if (pid == 0) {
+				execv("/proc/self/exe", child_argv.data());
+				fprintf(stdout, "failed to run worker: %s\n", strerror(errno));
+				fflush(stdout);
+				_exit(127);
+			}
+			children.push_back(pid);
+		}
+	}
+	return 0;
+}
+
+static void reap_workers(std::vector<pid_t>& children) {
+	int status;
+	pid_t pid;
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		children.erase(std::remove(children.begin(), children.end(), pid), children.end());
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			printf("worker %d died\n", (int) pid);
+	}
+}
+
+static void print_worker(const FarmWorker& worker) {
+	if (!worker.ready)
+		return;
+	double mpix = worker.ms > 0 ? (double) worker.tiles * FARM_TILE * FARM_TILE / (worker.ms * 1000.0) : 0;
+	printf("worker %u (%s): %u tiles, %.1f Mpix/s while rendering\n", worker.hello.pid,
+		engine_name((Engine) worker.hello.engine), worker.tiles, mpix);
+}
+
+// whatever it still had goes back to the front of the queue, last first, so it keeps its place; a stalled
+// worker's went back already
+static void drop_worker(FarmWorker& worker, std::deque<uint32_t>& queue) {
+	for (auto it = worker.outstanding.rbegin(); it != worker.outstanding.rend() && !worker.stalled; it++)
+		queue.push_front(*it);
+	if (!worker.outstanding.empty() && !worker.stalled)
+		printf("worker %u left with %zu tiles, handing them out again\n", worker.hello.pid, worker.outstanding.size());
+	worker.outstanding.clear();
+	print_worker(worker);
+	close(worker.fd);
+	worker.fd = -1;
+}
+
+static bool receive_hello(const Options& options, FarmWorker& worker) {
+	if (!recv_all(worker.fd, &worker.hello, sizeof(worker.hello)) || worker.hello.magic != FARM_MAGIC)
+		return false;
+	if (worker.hello.max_iterations != options.max_iterations || worker.hello.palette != options.color.palette ||
+			worker.hello.early_out != (uint32_t) options.early_out) {
+		printf("worker %u renders with other --iterations, --palette or --no-early-out, turning it away\n", worker.hello.pid);
+		return false;
+	}
+	// the cpu engine's colours are the fragment engine's, without smoothing
+	if (worker.hello.engine == ENGINE_CPU && options.color.smooth) {
+		printf("worker %u is on the cpu engine, which can't --smooth, turning it away\n", worker.hello.pid);
+		return false;
+	}
+	worker.ready = true;
+	printf("worker %u joined on the %s engine\n", worker.hello.pid, engine_name((Engine) worker.hello.engine));
+	return true;
+}
+
+// when the worker's front tile should be back by
+static std::chrono::steady_clock::time_point tile_deadline(const Options& options, const FarmWorker& worker, const FarmTile& tile) {
+	double ms = options.tile_timeout * 1000.0;
+	if (worker.cost > 0)
+		ms = std::max(ms, STALL_PACE * tile.cost * worker.ms / worker.cost);
+	return worker.started + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(ms));
+}
+
+// a worker that hangs without hanging up would otherwise hold its tiles, and the farm, forever: they go back to
+// the front of the queue, for whoever asks first, while it keeps them too in case it was only slow
+static void stall_worker(FarmWorker& worker, const std::vector<FarmTile>& tiles, std::deque<uint32_t>& queue, double seconds) {
+	worker.stalled = true;
+	size_t handed = 0;
+	for (auto it = worker.outstanding.rbegin(); it != worker.outstanding.rend(); it++) {
+		if (!tiles[*it].done) {
+			queue.push_front(*it);
+			handed++;
+		}
+	}
+	printf("worker %u has had tile %u for %.0fs, handing %zu tiles to the others\n", worker.hello.pid,
+		worker.outstanding.front(), seconds, handed);
+}
+
+int run_farm(const Options& options, int argc, char** argv) {
+	// every view's tiles, most expensive first within each view, so a slow worker's last tile is a cheap one
+	std::vector<FarmTile> tiles;
+	std::deque<uint32_t> queue;
+	std::vector<uint32_t> view_tiles(options.views.size());
+	uint32_t columns = (options.width + FARM_TILE - 1) / FARM_TILE;
+	uint32_t rows = (options.height + FARM_TILE - 1) / FARM_TILE;
+	for (uint32_t v = 0; v < options.views.size(); v++) {
+		double edges[4];
+		view_edges(options.views[v], options.width, options.height, edges);
+		MandelParams params;
+		fill_params(params, edges, options.width, options.height, options.max_iterations);
+
+		size_t first = tiles.size();
+		for (uint32_t y = 0; y < rows; y++) {
+			for (uint32_t x = 0; x < columns; x++)
+				tiles.push_back({ v, x * FARM_TILE, y * FARM_TILE, estimate_cost(params, x * FARM_TILE, y * FARM_TILE, options.early_out) });
+		}
+		std::vector<uint32_t> order;
+		for (size_t t = first; t < tiles.size(); t++)
+			order.push_back((uint32_t) t);
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return tiles[a].cost > tiles[b].cost; });
+		queue.insert(queue.end(), order.begin(), order.end());
+		view_tiles[v] = (uint32_t) (tiles.size() - first);
+	}
+
+	sockaddr_un address;
+	int listener = farm_socket(options.farm, address);
+	if (listener < 0)
+		return -1;
+	unlink(options.farm.c_str());
+	if (bind(listener, (sockaddr*) &address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+		std::cout << "failed to listen on " << options.farm << ": " << strerror(errno) << "\n";
+		close(listener);
+		return -1;
+	}
+
+	std::vector<pid_t> children;
+	int res = spawn_workers(options, argc, argv, children);
+	if (res == 0) {
+		printf("farm: %zu tiles of %zu views on %s\n", tiles.size(), options.views.size(), options.farm.c_str());
+		if (options.spawn.empty())
+			printf("waiting for workers\n");
+	}
+
+	std::vector<FarmWorker> workers;
+	std::map<uint32_t, FarmImage> images;
+	std::vector<uint8_t> pixels(TILE_BYTES);
+	size_t written = 0;
+	bool multiple = options.views.size() > 1;
+	auto start = std::chrono::steady_clock::now();
+	while (res == 0 && written < options.views.size()) {
+		reap_workers(children);
+		if (!options.spawn.empty() && children.empty() && workers.empty()) {
+			std::cout << "every worker has exited with " << queue.size() << " tiles still to render\n";
+			res = -1;
+			break;
+		}
+
+		// wakes up now and then to notice spawned workers that died before connecting, and at the next deadline
+		auto now = std::chrono::steady_clock::now();
+		auto wake = now + std::chrono::seconds(1);
+		std::vector<pollfd> fds = { { listener, POLLIN, 0 } };
+		for (const FarmWorker& worker : workers) {
+			fds.push_back({ worker.fd, POLLIN, 0 });
+			if (!worker.stalled && !worker.outstanding.empty())
+				wake = std::min(wake, tile_deadline(options, worker, tiles[worker.outstanding.front()]));
+		}
+		int timeout = (int) std::chrono::ceil<std::chrono::milliseconds>(std::max(wake - now, std::chrono::steady_clock::duration::zero())).count();
+		if (poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR) {
+			std::cout << "poll failed: " << strerror(errno) << "\n";
+			res = -1;
+			break;
+		}
+
+		for (size_t w = 0; w < workers.size(); w++) {
+			FarmWorker& worker = workers[w];
+			if (fds[w + 1].revents == 0)
+				continue;
+			if (!worker.ready) {
+				if (!receive_hello(options, worker))
+					drop_worker(worker, queue);
+				continue;
+			}
+
+			FarmResult result;
+			if (worker.outstanding.empty() || !recv_all(worker.fd, &result, sizeof(result)) ||
+					result.tile != worker.outstanding.front() || !recv_all(worker.fd, pixels.data(), pixels.size())) {
+				drop_worker(worker, queue);
+				continue;
+			}
+			worker.outstanding.pop_front();
+			worker.started = std::chrono::steady_clock::now();
+			worker.stalled = false;
+			worker.tiles++;
+			worker.ms += result.ms;
+
+			FarmTile& tile = tiles[result.tile];
+			worker.cost += tile.cost;
+			if (tile.done)
+				continue;
+			tile.done = true;
+			FarmImage& image = images[tile.view];
+			uint32_t width = std::min(FARM_TILE, options.width - tile.x0);
+			uint32_t height = std::min(FARM_TILE, options.height - tile.y0);
+			for (uint32_t y = 0; y < height; y++) {
+				memcpy(image.rgba.data() + ((size_t) (tile.y0 + y) * options.width + tile.x0) * 4,
+					pixels.data() + (size_t) y * FARM_TILE * 4, (size_t) width * 4);
+			}
+			if (--image.remaining > 0)
+				continue;
+
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - image.start;
+			const View& view = options.views[tile.view];
+			std::string filename = format_output_name(options.output, (int) tile.view, multiple);
+			if (0 != write_image(filename, options.width, options.height, image.rgba.data())) {
+				res = -1;
+				break;
+			}
+			printf("%s: center %1.17f,%1.17f size %1.17g, %ux%u in %.2fms\n", filename.c_str(), view.center[0], view.center[1], view.size, options.width, options.height, elapsed.count());
+			images.erase(tile.view);
+			written++;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+			if (fd >= 0)
+				workers.push_back({ fd });
+		}
+
+		now = std::chrono::steady_clock::now();
+		for (FarmWorker& worker : workers) {
+			if (worker.fd >= 0 && !worker.stalled && !worker.outstanding.empty() &&
+					now >= tile_deadline(options, worker, tiles[worker.outstanding.front()]))
+				stall_worker(worker, tiles, queue, std::chrono::duration<double>(now - worker.started).count());
+		}
+
+		// views go out in order, so only the one or two with tiles in flight are in memory at once
+		for (FarmWorker& worker : workers) {
+			while (res == 0 && worker.fd >= 0 && worker.ready && !worker.stalled && worker.outstanding.size() < FARM_DEPTH && !queue.empty()) {
+				uint32_t t = queue.front();
+				const FarmTile& tile = tiles[t];
+				// the stalled worker it was taken from got there first
+				if (tile.done) {
+					queue.pop_front();
+					continue;
+				}
+				double edges[4];
+				view_edges(options.views[tile.view], options.width, options.height, edges);
+				FarmRequest request = { t, 0, {} };
+				tile_edges(edges, options.width, options.height, tile.x0, tile.y0, FARM_TILE, FARM_TILE, request.edges);
+				if (!send_all(worker.fd, &request, sizeof(request))) {
+					drop_worker(worker, queue);
+					break;
+				}
+				queue.pop_front();
+				if (worker.outstanding.empty())
+					worker.started = std::chrono::steady_clock::now();
+				worker.outstanding.push_back(t);
+
+				if (images.count(tile.view) == 0) {
+					FarmImage& image = images[tile.view];
+					image.rgba.resize((size_t) options.width * options.height * 4);
+					image.remaining = view_tiles[tile.view];
+					image.start = std::chrono::steady_clock::now();
+				}
+			}
+		}
+		workers.erase(std::remove_if(workers.begin(), workers.end(), [](const FarmWorker& worker) { return worker.fd < 0; }), workers.end());
+	}
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	// hanging up is what tells workers to exit
+	for (FarmWorker& worker : workers) {
+		print_worker(worker);
+		close(worker.fd);
+	}
+	close(listener);
+	unlink(options.farm.c_str());
+	// the rest exit as soon as they notice, but a worker that hung would keep the farm waiting for it
+	auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(options.tile_timeout);
+	while (!children.empty() && std::chrono::steady_clock::now() < give_up) {
+		reap_workers(children);
+		if (!children.empty())
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	for (pid_t pid : children) {
+		printf("worker %d is still running, killing it\n", (int) pid);
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+	}
+
+	if (res == 0)
+		printf("%zu tiles in %.2fms, %.1f Mpix/s\n", tiles.size(), elapsed.count(), (double) options.views.size() * options.width * options.height / (elapsed.count() * 1000.0));
+	return res;
+}
+
+// retries for a while, so workers can be started before the coordinator
+static int connect_farm(const Options& options, Engine engine) {
+	sockaddr_un address;
+	int fd = farm_socket(options.worker, address);
+	if (fd < 0)
+		return -1;
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(CONNECT_SECONDS);
+	while (connect(fd, (sockaddr*) &address, sizeof(address)) != 0) {
+		if ((errno != ENOENT && errno != ECONNREFUSED) || std::chrono::steady_clock::now() > deadline) {
+			std::cout << "failed to connect to " << options.worker << ": " << strerror(errno) << "\n";
+			close(fd);
+			return -1;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	FarmHello hello = {
+		.magic = FARM_MAGIC,
+		.pid = (uint32_t) getpid(),
+		.engine = (uint32_t) engine,
+		.max_iterations = options.max_iterations,
+		.palette = options.color.palette,
+		.early_out = (uint32_t) options.early_out,
+	};
+	if (!send_all(fd, &hello, sizeof(hello))) {
+		std::cout << "lost the farm on " << options.worker << "\n";
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// the coordinator hanging up between tiles is the end of the job, not an error
+template <typename Render>
+static int serve_tiles(int fd, const Options& options, Render render) {
+	FarmRequest request;
+	while (recv_all(fd, &request, sizeof(request))) {
+		auto start = std::chrono::steady_clock::now();
+		const uint8_t* rgba = render(request.edges);
+		if (rgba == nullptr) {
+			close(fd);
+			return -1;
+		}
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		FarmResult result = { request.tile, (float) elapsed.count() };
+		if (!send_all(fd, &result, sizeof(result)) || !send_all(fd, rgba, TILE_BYTES)) {
+			std::cout << "lost the farm on " << options.worker << "\n";
+			close(fd);
+			return -1;
+		}
+	}
+	close(fd);
+	return 0;
+}
+
+int run_farm_worker(Init& init, RenderData& data, const Options& options) {
+	Engine engine = options.engine;
+	if (engine == ENGINE_AUTO) {
+		double edges[4];
+		view_edges(options.views[0], FARM_TILE, FARM_TILE, edges);
+		engine = pick_engine(init, data, OFFSCREEN_FORMAT, { FARM_TILE, FARM_TILE }, edges);
+	}
+	data.engine = engine;
+
+	Offscreen target;
+	if (0 != create_offscreen(init, data, target, FARM_TILE, FARM_TILE, OFFSCREEN_FORMAT) ||
+			0 != set_offscreen_engine(init, data, target, engine)) {
+		destroy_offscreen(init, target);
+		return -1;
+	}
+
+	int res = -1;
+	int fd = connect_farm(options, engine);
+	if (fd >= 0) {
+		res = serve_tiles(fd, options, [&](const double edges[4]) -> const uint8_t* {
+			if (0 != render_offscreen(init, data, target, edges))
+				return nullptr;
+			return (const uint8_t*) target.staging_memory.mapped;
+		});
+	}
+	destroy_offscreen(init, target);
+	return res;
+}
+
+int run_farm_worker_cpu(const Options& options) {
+	CpuEngine cpu;
+	if (0 != cpu_engine_init(cpu, options)) return -1;
+
+	std::vector<uint32_t> iterations((size_t) FARM_TILE * FARM_TILE);
+	std::vector<uint8_t> rgba(TILE_BYTES);
+	std::vector<uint32_t> palette;
+	build_palette(options.max_iterations, options.color.palette, palette);
+
+	int fd = connect_farm(options, ENGINE_CPU);
+	if (fd < 0)
+		return -1;
+	return serve_tiles(fd, options, [&](const double edges[4]) -> const uint8_t* {
+		MandelParams params;
+		fill_params(params, edges, FARM_TILE, FARM_TILE, options.max_iterations);
+		if (options.early_out)
+			params.flags |= MANDEL_FLAG_EARLY_OUT;
+		cpu_render(cpu, params, iterations.data());
+		colorize(iterations.data(), iterations.size(), palette, rgba.data());
+		return rgba.data();
+	});
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "options.h"
+
+struct Init;
+struct RenderData;
+
+// every farm tile is this square whatever the view, so GPU workers size their targets once; tiles along the
+// right and bottom edges render in full and the coordinator crops them
+const uint32_t FARM_TILE = 512;
+// requests a worker has queued at once, so the next tile is already there when it sends one back
+const uint32_t FARM_DEPTH = 2;
+
+// the wire format, in the machine's own byte order: a worker says hello once, then answers each request, in
+// order, with a result followed by FARM_TILE * FARM_TILE RGBA8 pixels. The coordinator hangs up when it's done.
+const uint32_t FARM_MAGIC = 0x6d726166;
+
+struct FarmHello {
+	uint32_t magic;
+	uint32_t pid;
+	// the engine it renders with, auto resolved
+	uint32_t engine;
+	// what the coordinator checks against its own, since they decide the colours
+	uint32_t max_iterations;
+	uint32_t palette;
+	uint32_t early_out;
+};
+
+struct FarmRequest {
+	uint32_t tile;
+	uint32_t reserved;
+	double edges[4];
+};
+
+struct FarmResult {
+	uint32_t tile;
+	float ms;
+};
+
+// coordinates the farm on options.farm, starting the --spawn workers with argv's other options; a worker that
+// holds a tile past options.tile_timeout has its tiles handed to the others, and the first copy back is kept
+int run_farm(const Options& options, int argc, char** argv);
+// renders tiles for the farm on options.worker until the coordinator hangs up
+int run_farm_worker(Init& init, RenderData& data, const Options& options);
+// the same on the cpu engine, without initialising Vulkan
+int run_farm_worker_cpu(const Options& options);
@@ -0,0 +1,198 @@
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "fixed.h"
+
+static bool is_negative(const Fixed& x) {
+	return (x.limbs.back() & 0x80000000u) != 0;
+}
+
+static void negate(Fixed& x) {
+	uint64_t carry = 1;
+	for (auto& limb : x.limbs) {
+		uint64_t t = (uint64_t) (uint32_t) ~limb + carry;
+		limb = (uint32_t) t;
+		carry = t >> 32;
+	}
+}
+
+static void mul_small(Fixed& x, uint32_t m) {
+	uint64_t carry = 0;
+	for (auto& limb : x.limbs) {
+		uint64_t t = (uint64_t) limb * m + carry;
+		limb = (uint32_t) t;
+		carry = t >> 32;
+	}
+}
+
+static void div_small(Fixed& x, uint32_t d) {
+	uint64_t rem = 0;
+	for (size_t i = x.limbs.size(); i-- > 0; ) {
+		uint64_t t = (rem << 32) | x.limbs[i];
+		x.limbs[i] = (uint32_t) (t / d);
+		rem = t % d;
+	}
+}
+
+size_t fixed_limbs_for(double resolution) {
+	int bits = (int) ceil(-log2(resolution)) + 64;
+	return 1 + (size_t) std::max(2, (bits + 31) / 32);
+}
+
+void fixed_init(Fixed& x, size_t limbs) {
+	x.limbs.assign(limbs, 0);
+}
+
+void fixed_from_double(Fixed& x, double value) {
+	bool neg = value < 0;
+	double v = fabs(value);
+	double whole = floor(v);
+	double frac = v - whole;
+
+	size_t n = x.limbs.size();
+	x.limbs[n - 1] = (uint32_t) whole;
+	// a double has at most 53 significant bits, so this runs out long before the limbs do
+	for (size_t i = n - 1; i-- > 0; ) {
+		frac = ldexp(frac, 32);
+		double limb = floor(frac);
+		x.limbs[i] = (uint32_t) limb;
+		frac -= limb;
+	}
+	if (neg)
+		negate(x);
+}
+
+int fixed_parse(Fixed& x, const std::string& text) {
+	const char* p = text.c_str();
+	bool neg = false;
+	if (*p == '-' || *p == '+')
+		neg = (*p++ == '-');
+
+	const char* whole_start = p;
+	while (isdigit((unsigned char) *p)) p++;
+	const char* whole_end = p;
+
+	const char* frac_start = p;
+	const char* frac_end = p;
+	if (*p == '.') {
+		frac_start = ++p;
+		while (isdigit((unsigned char) *p)) p++;
+		frac_end = p;
+	}
+	if (whole_start == whole_end && frac_start == frac_end)
+		return -1;
+
+	long exponent = 0;
+	if (*p == 'e' || *p == 'E') {
+		char* end;
+		exponent = strtol(p + 1, &end, 10);
+		if (end == p + 1)
+			return -1;
+		p = end;
+	}
+	if (*p != '\0')
+		return -1;
+
+	size_t n = x.limbs.size();
+	std::fill(x.limbs.begin(), x.limbs.end(), 0);
+
+	// the fraction from its last digit up, each step being x = (x + digit) / 10
+	for (const char* d = frac_end; d > frac_start; ) {
+		x.limbs[n - 1] = *--d - '0';
+		div_small(x, 10);
+	}
+
+	uint64_t whole = 0;
+	for (const char* d = whole_start; d < whole_end; d++) {
+		whole = whole * 10 + (*d - '0');
+		if (whole > 0x7FFFFFFF)
+			return -1;
+	}
+	x.limbs[n - 1] = (uint32_t) whole;
+
+	for (; exponent > 0; exponent--) {
+		if (x.limbs[n - 1] > 0x7FFFFFFF / 10)
+			return -1;
+		mul_small(x, 10);
+	}
+	for (; exponent < 0; exponent++)
+		div_small(x, 10);
+
+	if (neg)
+		negate(x);
+	return 0;
+}
+
+double fixed_to_double(const Fixed& x) {
+	Fixed m = x;
+	bool neg = is_negative(m);
+	if (neg)
+		negate(m);
+
+	size_t n = m.limbs.size();
+	double value = 0;
+	// most significant first; three limbs already cover a double's mantissa
+	int used = 0;
+	for (size_t i = n; i-- > 0 && used < 3; ) {
+		if (m.limbs[i] == 0 && used == 0)
+			continue;
+		value += ldexp((double) m.limbs[i], 32 * ((int) i - (int) (n - 1)));
+		used++;
+	}
+	return neg ? -value : value;
+}
+
+void fixed_add(Fixed& r, const Fixed& a, const Fixed& b) {
+	uint64_t carry = 0;
+	for (size_t i = 0; i < a.limbs.size(); i++) {
+		uint64_t t = (uint64_t) a.limbs[i] + b.limbs[i] + carry;
+		r.limbs[i] = (uint32_t) t;
+		carry = t >> 32;
+	}
+}
+
+void fixed_sub(Fixed& r, const Fixed& a, const Fixed& b) {
+	// a + ~b + 1
+	uint64_t carry = 1;
+	for (size_t i = 0; i < a.limbs.size(); i++) {
+		uint64_t t = (uint64_t) a.limbs[i] + (uint32_t) ~b.limbs[i] + carry;
+		r.limbs[i] = (uint32_t) t;
+		carry = t >> 32;
+	}
+}
+
+void fixed_mul(Fixed& r, const Fixed& a, const Fixed& b) {
+	// reference orbits call this millions of times, so the scratch space is kept around
+	thread_local Fixed ma, mb;
+	thread_local std::vector<uint32_t> product;
+
+	size_t n = a.limbs.size();
+	ma = a;
+	mb = b;
+	bool neg = is_negative(ma) != is_negative(mb);
+	if (is_negative(ma)) negate(ma);
+	if (is_negative(mb)) negate(mb);
+
+	product.assign(2 * n, 0);
+	for (size_t i = 0; i < n; i++) {
+		uint64_t carry = 0;
+		uint64_t ai = ma.limbs[i];
+		if (ai == 0)
+			continue;
+		for (size_t j = 0; j < n; j++) {
+			uint64_t t = ai * mb.limbs[j] + product[i + j] + carry;
+			product[i + j] = (uint32_t) t;
+			carry = t >> 32;
+		}
+		product[i + n] = (uint32_t) carry;
+	}
+
+	// both operands carry n - 1 fraction limbs, so the product carries 2n - 2 of them
+	for (size_t k = 0; k < n; k++)
+		r.limbs[k] = product[k + n - 1];
+	if (neg)
+		negate(r);
+}
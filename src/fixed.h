@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// arbitrary precision fixed point for the deep engine's reference orbits: little-endian 32-bit limbs in
+// two's complement, the top limb holding the signed integer part and the rest the fraction. Every operand
+// of an operation must have the same limb count, and results are truncated rather than rounded.
+struct Fixed {
+	std::vector<uint32_t> limbs;
+};
+
+// enough limbs to resolve detail `resolution` wide with guard bits to spare over a long orbit
+size_t fixed_limbs_for(double resolution);
+
+void fixed_init(Fixed& x, size_t limbs);
+void fixed_from_double(Fixed& x, double value);
+// decimal with optional sign, fraction and exponent, eg "-0.7436438870371587047521915061147744e-2"
+int fixed_parse(Fixed& x, const std::string& text);
+double fixed_to_double(const Fixed& x);
+
+void fixed_add(Fixed& r, const Fixed& a, const Fixed& b);
+void fixed_sub(Fixed& r, const Fixed& a, const Fixed& b);
+// r must not alias a or b
+void fixed_mul(Fixed& r, const Fixed& a, const Fixed& b);
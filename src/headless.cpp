@@ -0,0 +1,523 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "headless.h"
+#include "readback.h"
+#include "image_write.h"
+#include "cpu_engine.h"
+
+void view_edges(const View& view, uint32_t width, uint32_t height, double edges[4]) {
+	double half_w = view.size * 0.5;
+	double half_h = view.size * 0.5 * height / width;
+
+	edges[0] = view.center[0] - half_w;
+	edges[1] = view.center[1] - half_h;
+	edges[2] = view.center[0] + half_w;
+	edges[3] = view.center[1] + half_h;
+}
+
+void tile_edges(const double edges[4], uint32_t width, uint32_t height, uint32_t x0, uint32_t y0, uint32_t tile_width, uint32_t tile_height, double out[4]) {
+	double step_x = (edges[2] - edges[0]) / width;
+	double step_y = (edges[3] - edges[1]) / height;
+	out[0] = edges[0] + x0 * step_x;
+	out[1] = edges[1] + y0 * step_y;
+	out[2] = edges[0] + (x0 + tile_width) * step_x;
+	out[3] = edges[1] + (y0 + tile_height) * step_y;
+}
+
+static int create_target_image(Init& init, Offscreen& target) {
+	VkImageCreateInfo image_info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = target.format,
+		.extent = { target.extent.width, target.extent.height, 1 },
+		.mipLevels = 1,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+	if (init.disp.createImage(&image_info, nullptr, &target.image) != VK_SUCCESS) {
+		std::cout << "failed to create offscreen image\n";
+		return -1;
+	}
+
+	if (0 != allocate_image_memory(init, target.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, target.image_memory)) {
+		std::cout << "failed to allocate offscreen image memory\n";
+		return -1;
+	}
+
+	VkImageViewCreateInfo view_info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = target.image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = target.format,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+	};
+	if (init.disp.createImageView(&view_info, nullptr, &target.image_view) != VK_SUCCESS) {
+		std::cout << "failed to create offscreen image view\n";
+		return -1;
+	}
+	return 0;
+}
+
+int create_readback_buffer(Init& init, VkDeviceSize size, VkBuffer& buffer, Allocation& memory) {
+	VkBufferCreateInfo buffer_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	if (init.disp.createBuffer(&buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+		std::cout << "failed to create staging buffer\n";
+		return -1;
+	}
+
+	// cached memory makes the CPU side of the readback much faster, but it is not always coherent
+	if (0 != allocate_buffer_memory(init, buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, memory) &&
+			0 != allocate_buffer_memory(init, buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory)) {
+		std::cout << "failed to allocate staging memory\n";
+		return -1;
+	}
+	return 0;
+}
+
+int record_offscreen(Init& init, RenderData& data, VkCommandBuffer cmd, Engine engine, uint32_t slot, VkImage image, VkImageView view, VkExtent2D extent) {
+	if (engine == ENGINE_COMPUTE || engine == ENGINE_DEEP) {
+		// render_deep has already filled the compute targets, colours included, by the time this is submitted,
+		// and so have the progressive passes their iteration buffers
+		if (engine == ENGINE_COMPUTE) {
+			if (data.compute.progressive_budget == 0)
+				record_compute(init, data.compute, cmd, data.compute.descriptor_sets[slot], data.precision);
+			record_colorize(init, data.colorizer, data.compute, cmd, slot, data.color.equalize);
+		}
+		record_compute_blit(init, data.compute, cmd, image, extent, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+		return 0;
+	}
+
+	VkPipeline pipeline = graphics_variant(init, data, fragment_variant(data));
+	if (pipeline == VK_NULL_HANDLE)
+		return -1;
+	record_fragment(init, data, cmd, pipeline, data.descriptorSets[slot], image, view, extent, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	return 0;
+}
+
+// the only per-view state is the uniform buffer, so the command buffer is recorded once and resubmitted
+int set_offscreen_engine(Init& init, RenderData& data, Offscreen& target, Engine engine) {
+	if (target.command_buffer != VK_NULL_HANDLE) {
+		init.disp.freeCommandBuffers(data.command_pool, 1, &target.command_buffer);
+		target.command_buffer = VK_NULL_HANDLE;
+	}
+	if (target.progressive_command_buffers[0] != VK_NULL_HANDLE) {
+		init.disp.freeCommandBuffers(data.command_pool, 2, target.progressive_command_buffers);
+		target.progressive_command_buffers[0] = target.progressive_command_buffers[1] = VK_NULL_HANDLE;
+	}
+
+	VkCommandBufferAllocateInfo allocInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = data.command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+	if (init.disp.allocateCommandBuffers(&allocInfo, &target.command_buffer) != VK_SUCCESS) {
+		return -1; // failed to allocate command buffers;
+	}
+
+	VkCommandBuffer cmd = target.command_buffer;
+	target.engine = engine;
+	target.precision = data.precision;
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+	bool progressive = engine == ENGINE_COMPUTE && data.compute.progressive_budget > 0;
+	if (progressive) {
+		allocInfo.commandBufferCount = 2;
+		if (init.disp.allocateCommandBuffers(&allocInfo, target.progressive_command_buffers) != VK_SUCCESS) {
+			return -1; // failed to allocate command buffers;
+		}
+		for (int i = 0; i < 2; i++) {
+			VkCommandBuffer pass = target.progressive_command_buffers[i];
+			if (init.disp.beginCommandBuffer(pass, &begin_info) != VK_SUCCESS) {
+				return -1; // failed to begin recording command buffer
+			}
+			record_progressive(init, data.compute, pass, data.compute.descriptor_sets[0], data.precision, i == 0);
+			if (init.disp.endCommandBuffer(pass) != VK_SUCCESS) {
+				std::cout << "failed to record command buffer\n";
+				return -1; // failed to record command buffer!
+			}
+		}
+	}
+
+	if (init.disp.beginCommandBuffer(cmd, &begin_info) != VK_SUCCESS) {
+		return -1; // failed to begin recording command buffer
+	}
+	if (0 != record_offscreen(init, data, cmd, engine, 0, target.image, target.image_view, target.extent))
+		return -1;
+
+	VkBufferImageCopy region = {
+		.bufferOffset = 0,
+		.bufferRowLength = 0,
+		.bufferImageHeight = 0,
+		.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+		.imageOffset = { 0, 0, 0 },
+		.imageExtent = { target.extent.width, target.extent.height, 1 },
+	};
+	init.disp.cmdCopyImageToBuffer(cmd, target.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target.staging, 1, &region);
+
+	bool copy_iterations = (engine == ENGINE_COMPUTE || engine == ENGINE_DEEP) && target.iteration_staging != VK_NULL_HANDLE;
+	if (copy_iterations) {
+		VkBufferCopy copy = { 0, 0, (VkDeviceSize) target.extent.width * target.extent.height * sizeof(uint32_t) };
+		init.disp.cmdCopyBuffer(cmd, data.compute.iterations, target.iteration_staging, 1, &copy);
+	}
+
+	VkBufferMemoryBarrier to_host = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer = target.staging,
+		.offset = 0,
+		.size = VK_WHOLE_SIZE,
+	};
+	VkBufferMemoryBarrier iterations_to_host = to_host;
+	iterations_to_host.buffer = target.iteration_staging;
+	VkBufferMemoryBarrier barriers[2] = { to_host, iterations_to_host };
+	uint32_t barrier_count = copy_iterations ? 2 : 1;
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, barrier_count, barriers, 0, nullptr);
+
+	if (init.disp.endCommandBuffer(cmd) != VK_SUCCESS) {
+		std::cout << "failed to record command buffer\n";
+		return -1; // failed to record command buffer!
+	}
+	return 0;
+}
+
+int create_offscreen(Init& init, RenderData& data, Offscreen& target, uint32_t width, uint32_t height, VkFormat format) {
+	target = {};
+
+	uint32_t max_dim = init.physical_device.properties.limits.maxImageDimension2D;
+	if (width > max_dim || height > max_dim) {
+		std::cout << "offscreen size " << width << "x" << height << " exceeds device limit of " << max_dim << "\n";
+		return -1;
+	}
+
+	target.extent = { width, height };
+	target.format = format;
+
+	if (0 != create_target_image(init, target)) return -1;
+	VkDeviceSize size = (VkDeviceSize) width * height * 4;
+	if (0 != create_readback_buffer(init, size, target.staging, target.staging_memory)) return -1;
+
+	VkFenceCreateInfo fence_info = {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	if (init.disp.createFence(&fence_info, nullptr, &target.fence) != VK_SUCCESS) {
+		std::cout << "failed to create offscreen fence\n";
+		return -1;
+	}
+	return 0;
+}
+
+static int submit_and_wait(Init& init, RenderData& data, Offscreen& target, VkCommandBuffer cmd) {
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &cmd;
+
+	init.disp.resetFences(1, &target.fence);
+	if (init.disp.queueSubmit(data.graphics_queue, 1, &submitInfo, target.fence) != VK_SUCCESS) {
+		std::cout << "failed to submit offscreen command buffer\n";
+		return -1;
+	}
+	if (init.disp.waitForFences(1, &target.fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS) {
+		std::cout << "failed waiting for offscreen render\n";
+		return -1;
+	}
+	return 0;
+}
+
+void offscreen_params(const RenderData& data, VkExtent2D extent, const double edges[4], MandelParams& params) {
+	fill_params(params, edges, extent.width, extent.height, data.max_iterations);
+	apply_color(params, data.color);
+	params.escape_radius2 = data.constants.escape_radius2;
+	if (data.early_out)
+		params.flags |= MANDEL_FLAG_EARLY_OUT;
+}
+
+int render_offscreen(Init& init, RenderData& data, Offscreen& target, const double edges[4]) {
+	MandelParams params;
+	offscreen_params(data, target.extent, edges, params);
+	memcpy(uniform_mapped(data.uniforms, 0), &params, sizeof(params));
+
+	// the deep engine's submission is only the blit and readback
+	if (target.engine != ENGINE_DEEP) {
+		data.precision = pick_precision(params, data.precision_mode, init.shader_float64);
+		if (data.precision != target.precision && 0 != set_offscreen_engine(init, data, target, target.engine))
+			return -1;
+	}
+
+	// one submission per progressive pass, so none runs long enough to trip a GPU watchdog
+	if (target.progressive_command_buffers[0] != VK_NULL_HANDLE) {
+		uint32_t budget = data.compute.progressive_budget;
+		for (uint32_t done = 0; done < data.max_iterations; done += std::min(budget, data.max_iterations - done)) {
+			if (0 != submit_and_wait(init, data, target, target.progressive_command_buffers[done == 0 ? 0 : 1]))
+				return -1;
+		}
+	}
+
+	if (0 != submit_and_wait(init, data, target, target.command_buffer))
+		return -1;
+
+	invalidate_allocation(init, target.staging_memory);
+	invalidate_allocation(init, target.iteration_staging_memory);
+	return 0;
+}
+
+void destroy_offscreen(Init& init, Offscreen& target) {
+	init.disp.destroyFence(target.fence, nullptr);
+	init.disp.destroyImageView(target.image_view, nullptr);
+	init.disp.destroyImage(target.image, nullptr);
+	free_memory(init, target.image_memory);
+	init.disp.destroyBuffer(target.staging, nullptr);
+	free_memory(init, target.staging_memory);
+	init.disp.destroyBuffer(target.iteration_staging, nullptr);
+	free_memory(init, target.iteration_staging_memory);
+	// command buffer goes with the command pool
+	target = {};
+}
+
+static int compare_iterations(const uint32_t* gpu, const uint32_t* cpu, uint32_t width, uint32_t height) {
+	size_t mismatches = 0;
+	size_t first = 0;
+	for (size_t i = 0; i < (size_t) width * height; i++) {
+		if (gpu[i] != cpu[i]) {
+			if (mismatches == 0)
+				first = i;
+			mismatches++;
+		}
+	}
+
+	if (mismatches == 0) {
+		std::cout << "validate: all " << (size_t) width * height << " pixels match the cpu engine\n";
+		return 0;
+	}
+	std::cout << "validate: " << mismatches << " pixels differ from the cpu engine, first at "
+		<< first % width << "," << first / width << " (gpu " << gpu[first] << ", cpu " << cpu[first] << ")\n";
+	return -1;
+}
+
+Engine pick_engine(Init& init, RenderData& data, VkFormat format, VkExtent2D extent, const double edges[4]) {
+	const int runs = 3;
+
+	Offscreen target;
+	Engine best = ENGINE_FRAGMENT;
+	double best_ms = 0;
+
+	if (0 != create_offscreen(init, data, target, extent.width, extent.height, format)) {
+		destroy_offscreen(init, target);
+		std::cout << "engine probe failed, using " << engine_name(best) << "\n";
+		return best;
+	}
+
+	for (Engine engine : { ENGINE_FRAGMENT, ENGINE_COMPUTE }) {
+		if (0 != set_offscreen_engine(init, data, target, engine))
+			continue;
+
+		// the first submission pays for pipeline warm-up and page faults, so it is not counted
+		if (0 != render_offscreen(init, data, target, edges))
+			continue;
+
+		auto start = std::chrono::steady_clock::now();
+		int i;
+		for (i = 0; i < runs; i++) {
+			if (0 != render_offscreen(init, data, target, edges))
+				break;
+		}
+		if (i != runs)
+			continue;
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		double ms = elapsed.count() / runs;
+
+		double mpix = (double) extent.width * extent.height / (ms * 1000.0);
+		printf("engine %-8s %8.2fms/frame %8.1f Mpix/s\n", engine_name(engine), ms, mpix);
+		if (best_ms == 0 || ms < best_ms) {
+			best = engine;
+			best_ms = ms;
+		}
+	}
+
+	destroy_offscreen(init, target);
+	std::cout << "using " << engine_name(best) << " engine\n";
+	return best;
+}
+
+// frame i renders into slot i % READBACK_SLOTS and gets encoded once frame i + READBACK_SLOTS - 1 is submitted,
+// so while the CPU encodes one frame the GPU copies the next and renders the one after that
+static int export_pipelined(Init& init, RenderData& data, const Options& options, Engine engine) {
+	Readback readback;
+	if (0 != create_readback(init, data, readback, { options.width, options.height })) {
+		destroy_readback(init, data, readback);
+		return -1;
+	}
+
+	int res = 0;
+	size_t count = options.views.size();
+	bool multiple = count > 1;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < count + READBACK_SLOTS - 1 && res == 0; i++) {
+		if (i < count) {
+			double edges[4];
+			view_edges(options.views[i], options.width, options.height, edges);
+			res = readback_submit(init, data, readback, (uint32_t) (i % READBACK_SLOTS), engine, edges);
+		}
+		if (res != 0 || i < READBACK_SLOTS - 1 || i - (READBACK_SLOTS - 1) >= count)
+			continue;
+
+		size_t done = i - (READBACK_SLOTS - 1);
+		uint32_t slot = (uint32_t) (done % READBACK_SLOTS);
+		if (0 != readback_wait(init, readback, slot)) {
+			res = -1;
+			break;
+		}
+		std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - readback.slots[slot].submitted;
+
+		const View& view = options.views[done];
+		std::string filename = format_output_name(options.output, (int) done, multiple);
+		if (0 != write_image(filename, options.width, options.height, (const uint8_t*) readback.slots[slot].staging_memory.mapped)) {
+			res = -1;
+			break;
+		}
+		printf("%s: center %1.17f,%1.17f size %1.17g, %ux%u in %.2fms\n", filename.c_str(), view.center[0], view.center[1], view.size, options.width, options.height, latency.count());
+	}
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	if (res == 0 && multiple)
+		printf("%zu images in %.2fms, %.1f per second\n", count, elapsed.count(), count * 1000.0 / elapsed.count());
+
+	destroy_readback(init, data, readback);
+	return res;
+}
+
+int run_headless(Init& init, RenderData& data, const Options& options) {
+	Engine engine = options.engine;
+	if (engine == ENGINE_AUTO) {
+		double edges[4];
+		view_edges(options.views[0], options.width, options.height, edges);
+		engine = pick_engine(init, data, OFFSCREEN_FORMAT, { options.width, options.height }, edges);
+	}
+	data.engine = engine;
+
+	CpuEngine cpu;
+	std::vector<uint32_t> reference;
+	if (options.validate) {
+		if (engine != ENGINE_COMPUTE) {
+			std::cout << "--validate needs the compute engine, the " << engine_name(engine) << " engine has no iteration counts\n";
+			return -1;
+		}
+		// only fp64 follows the CPU engine's arithmetic exactly
+		data.precision_mode = PRECISION_F64;
+		if (0 != cpu_engine_init(cpu, options)) return -1;
+		reference.resize((size_t) options.width * options.height);
+	}
+
+	// the deep engine and progressive passes wait on their own submissions, and validation on every frame
+	if ((engine == ENGINE_FRAGMENT || engine == ENGINE_COMPUTE) && data.compute.progressive_budget == 0 && !options.validate)
+		return export_pipelined(init, data, options, engine);
+
+	Offscreen target;
+	int res = create_offscreen(init, data, target, options.width, options.height, OFFSCREEN_FORMAT);
+	if (res == 0 && options.validate) {
+		VkDeviceSize size = (VkDeviceSize) options.width * options.height * sizeof(uint32_t);
+		res = create_readback_buffer(init, size, target.iteration_staging, target.iteration_staging_memory);
+	}
+	if (res == 0)
+		res = set_offscreen_engine(init, data, target, engine);
+	if (res != 0) {
+		destroy_offscreen(init, target);
+		return -1;
+	}
+
+	bool multiple = options.views.size() > 1;
+	for (size_t i = 0; i < options.views.size(); i++) {
+		const View& view = options.views[i];
+
+		double edges[4];
+		view_edges(view, options.width, options.height, edges);
+
+		auto start = std::chrono::steady_clock::now();
+		if (engine == ENGINE_DEEP && 0 != render_deep(init, data, view)) {
+			res = -1;
+			break;
+		}
+		if (0 != render_offscreen(init, data, target, edges)) {
+			res = -1;
+			break;
+		}
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::string filename = format_output_name(options.output, (int) i, multiple);
+		if (0 != write_image(filename, options.width, options.height, (const uint8_t*) target.staging_memory.mapped)) {
+			res = -1;
+			break;
+		}
+
+		printf("%s: center %1.17f,%1.17f size %1.17g, %ux%u in %.2fms\n", filename.c_str(), view.center[0], view.center[1], view.size, options.width, options.height, elapsed.count());
+
+		if (options.validate) {
+			MandelParams params;
+			fill_params(params, edges, options.width, options.height, options.max_iterations);
+			// --subdivide fills differently when smoothing
+			apply_color(params, options.color);
+			if (options.early_out)
+				params.flags |= MANDEL_FLAG_EARLY_OUT;
+			cpu_render(cpu, params, reference.data());
+			if (0 != compare_iterations((const uint32_t*) target.iteration_staging_memory.mapped, reference.data(), options.width, options.height))
+				res = -1;
+		}
+	}
+
+	destroy_offscreen(init, target);
+	return res;
+}
+
+int run_headless_cpu(const Options& options) {
+	CpuEngine cpu;
+	if (0 != cpu_engine_init(cpu, options)) return -1;
+	std::cout << "Using " << cpu.threads << " threads with " << cpu_isa_name(cpu.isa) << " kernels" << std::endl;
+
+	size_t pixels = (size_t) options.width * options.height;
+	std::vector<uint32_t> iterations(pixels);
+	std::vector<uint8_t> rgba(pixels * 4);
+	std::vector<uint32_t> palette;
+	build_palette(options.max_iterations, options.color.palette, palette);
+
+	bool multiple = options.views.size() > 1;
+	for (size_t i = 0; i < options.views.size(); i++) {
+		const View& view = options.views[i];
+
+		double edges[4];
+		view_edges(view, options.width, options.height, edges);
+		MandelParams params;
+		fill_params(params, edges, options.width, options.height, options.max_iterations);
+		if (options.early_out)
+			params.flags |= MANDEL_FLAG_EARLY_OUT;
+
+		auto start = std::chrono::steady_clock::now();
+		cpu_render(cpu, params, iterations.data());
+		colorize(iterations.data(), pixels, palette, rgba.data());
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::string filename = format_output_name(options.output, (int) i, multiple);
+		if (0 != write_image(filename, options.width, options.height, rgba.data()))
+			return -1;
+
+		printf("%s: center %1.17f,%1.17f size %1.17g, %ux%u in %.2fms\n", filename.c_str(), view.center[0], view.center[1], view.size, options.width, options.height, elapsed.count());
+	}
+	return 0;
+}
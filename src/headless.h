@@ -0,0 +1,62 @@
+#pragma once
+
+#include "render.h"
+
+// sRGB so the files look the same as the window does with vk-bootstrap's default swapchain format
+const VkFormat OFFSCREEN_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+// a colour target plus host-visible staging buffer standing in for the swapchain
+struct Offscreen {
+	VkExtent2D extent;
+	VkFormat format;
+
+	// what the command buffer was last recorded for
+	Engine engine;
+	Precision precision;
+
+	VkImage image;
+	Allocation image_memory;
+	VkImageView image_view;
+
+	VkBuffer staging;
+	// persistently mapped
+	Allocation staging_memory;
+
+	// only created for --validate, receives the compute engine's iteration counts
+	VkBuffer iteration_staging;
+	Allocation iteration_staging_memory;
+
+	VkCommandBuffer command_buffer;
+	// progressive mode submits its passes one at a time ahead of command_buffer: the first pass, then the rest
+	VkCommandBuffer progressive_command_buffers[2];
+	VkFence fence;
+};
+
+void view_edges(const View& view, uint32_t width, uint32_t height, double edges[4]);
+// the part of a width x height image's edges that the tile at pixel x0, y0 covers, from the pixel offsets rather
+// than by adding up tiles, so neighbouring tiles meet on the same coordinates
+void tile_edges(const double edges[4], uint32_t width, uint32_t height, uint32_t x0, uint32_t y0, uint32_t tile_width, uint32_t tile_height, double out[4]);
+// the view's MandelParams with data's cap, colours and flags
+void offscreen_params(const RenderData& data, VkExtent2D extent, const double edges[4], MandelParams& params);
+
+// format has to be data.color_format for the fragment engine
+int create_offscreen(Init& init, RenderData& data, Offscreen& target, uint32_t width, uint32_t height, VkFormat format);
+// (re)records the offscreen command buffer for one engine at data.precision; the compute engine's targets must
+// match the offscreen extent
+int set_offscreen_engine(Init& init, RenderData& data, Offscreen& target, Engine engine);
+// the engine's work for one frame that reads uniform slot, at data.precision, leaving image in TRANSFER_SRC_OPTIMAL.
+// The deep engine only blits: render_deep, like the progressive passes, has filled the compute targets already.
+int record_offscreen(Init& init, RenderData& data, VkCommandBuffer cmd, Engine engine, uint32_t slot, VkImage image, VkImageView view, VkExtent2D extent);
+// host visible memory for the GPU to copy into, cached where the device has it
+int create_readback_buffer(Init& init, VkDeviceSize size, VkBuffer& buffer, Allocation& memory);
+// renders one view and waits for it, leaving RGBA8 pixels in target.staging_memory.mapped; re-records first if the
+// view needs a different precision tier
+int render_offscreen(Init& init, RenderData& data, Offscreen& target, const double edges[4]);
+void destroy_offscreen(Init& init, Offscreen& target);
+
+// times the fragment and compute engines on the same view and returns the faster
+Engine pick_engine(Init& init, RenderData& data, VkFormat format, VkExtent2D extent, const double edges[4]);
+
+int run_headless(Init& init, RenderData& data, const Options& options);
+// the same loop on the cpu engine alone, without initialising Vulkan
+int run_headless_cpu(const Options& options);
@@ -0,0 +1,259 @@
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "render.h"
+#include "hybrid.h"
+
+int create_hybrid(Init& init, RenderData& data, const Options& options) {
+	Hybrid& hybrid = data.hybrid;
+	if (!options.hybrid)
+		return 0;
+	if (0 != cpu_engine_init(hybrid.cpu, options)) return -1;
+
+	hybrid.commands.resize(MAX_FRAMES_IN_FLIGHT);
+	VkCommandBufferAllocateInfo alloc_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = data.command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = MAX_FRAMES_IN_FLIGHT,
+	};
+	if (init.disp.allocateCommandBuffers(&alloc_info, hybrid.commands.data()) != VK_SUCCESS) {
+		std::cout << "failed to allocate hybrid command buffers\n";
+		return -1;
+	}
+
+	uint32_t family = init.device.get_queue_index(vkb::QueueType::graphics).value();
+	uint32_t valid_bits = init.device.queue_families[family].timestampValidBits;
+	if (valid_bits > 0) {
+		hybrid.timestamp_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+		hybrid.timestamp_period = init.physical_device.properties.limits.timestampPeriod;
+		VkQueryPoolCreateInfo pool_info = {
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_TIMESTAMP,
+			.queryCount = MAX_FRAMES_IN_FLIGHT * 2,
+		};
+		if (init.disp.createQueryPool(&pool_info, nullptr, &hybrid.timestamps) != VK_SUCCESS) {
+			std::cout << "failed to create hybrid timestamp query pool\n";
+			return -1;
+		}
+	}
+	hybrid.gpu_rows.assign(MAX_FRAMES_IN_FLIGHT, 0);
+
+	VkSemaphoreTypeCreateInfo timeline_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = 0,
+	};
+	VkSemaphoreCreateInfo semaphore_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &timeline_info,
+	};
+	if (init.disp.createSemaphore(&semaphore_info, nullptr, &hybrid.timeline) != VK_SUCCESS) {
+		std::cout << "failed to create hybrid timeline\n";
+		return -1;
+	}
+
+	hybrid.staging.assign(MAX_FRAMES_IN_FLIGHT, VK_NULL_HANDLE);
+	hybrid.staging_memory.resize(MAX_FRAMES_IN_FLIGHT);
+	hybrid.enabled = true;
+	return bind_hybrid_targets(init, hybrid, data.compute);
+}
+
+static void destroy_staging(Init& init, Hybrid& hybrid) {
+	for (size_t i = 0; i < hybrid.staging.size(); i++) {
+		init.disp.destroyBuffer(hybrid.staging[i], nullptr);
+		hybrid.staging[i] = VK_NULL_HANDLE;
+		free_memory(init, hybrid.staging_memory[i]);
+	}
+}
+
+int bind_hybrid_targets(Init& init, Hybrid& hybrid, const ComputeEngine& compute) {
+	if (!hybrid.enabled)
+		return 0;
+	destroy_staging(init, hybrid);
+
+	// room for the whole frame, since the split can go anywhere
+	VkBufferCreateInfo buffer_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = (VkDeviceSize) compute.extent.width * compute.extent.height * sizeof(uint32_t),
+		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	for (size_t i = 0; i < hybrid.staging.size(); i++) {
+		if (init.disp.createBuffer(&buffer_info, nullptr, &hybrid.staging[i]) != VK_SUCCESS) {
+			std::cout << "failed to create hybrid staging buffer\n";
+			return -1;
+		}
+		if (0 != allocate_buffer_memory(init, hybrid.staging[i], VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, hybrid.staging_memory[i])) {
+			std::cout << "failed to allocate hybrid staging memory\n";
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void destroy_hybrid(Init& init, Hybrid& hybrid) {
+	destroy_staging(init, hybrid);
+	init.disp.destroyQueryPool(hybrid.timestamps, nullptr);
+	hybrid.timestamps = VK_NULL_HANDLE;
+	init.disp.destroySemaphore(hybrid.timeline, nullptr);
+	hybrid.timeline = VK_NULL_HANDLE;
+}
+
+// how far a frame moves the cpu's share when all that's known is which side finished first
+static const double HYBRID_NUDGE = 1.0 / 32;
+
+// how long frame's last GPU rows took, which whatever waited on the slot saw finish; -1 for no sample
+static double gpu_rows_ms(Init& init, const Hybrid& hybrid, size_t frame) {
+	if (hybrid.timestamps == VK_NULL_HANDLE || hybrid.gpu_rows[frame] == 0)
+		return -1;
+	// without WAIT_BIT, so a slot that somehow hasn't finished loses its sample rather than stalling the frame
+	uint64_t ticks[2];
+	if (init.disp.getQueryPoolResults(hybrid.timestamps, (uint32_t) frame * 2, 2, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+		return -1;
+	return ((ticks[1] - ticks[0]) & hybrid.timestamp_mask) * hybrid.timestamp_period / 1e6;
+}
+
+int hybrid_iterate(Init& init, RenderData& data, size_t frame, const MandelParams& params) {
+	Hybrid& hybrid = data.hybrid;
+	ComputeEngine& compute = data.compute;
+	uint32_t height = compute.extent.height;
+
+	// the GPU's side of the frame before last in this slot, a frame in flight late
+	double gpu_ms = gpu_rows_ms(init, hybrid, frame);
+	if (gpu_ms > 0) {
+		hybrid.gpu_rate = hybrid.gpu_rows[frame] / gpu_ms;
+		hybrid.gpu_frames++;
+		hybrid.gpu_ms += gpu_ms;
+	}
+
+	// whole workgroup rows, and at least one each so both sides keep being measured; frames too short for
+	// that stay on the GPU
+	uint32_t block = compute.local_size[1];
+	uint32_t blocks = (height + block - 1) / block;
+	uint32_t cpu_blocks = 0;
+	if (blocks >= 2)
+		cpu_blocks = std::clamp((uint32_t) (hybrid.share * blocks + 0.5), 1u, blocks - 1);
+	hybrid.split = std::min(height, (blocks - cpu_blocks) * block);
+
+	VkCommandBuffer cmd = hybrid.commands[frame];
+	init.disp.resetCommandBuffer(cmd, 0);
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	if (init.disp.beginCommandBuffer(cmd, &begin_info) != VK_SUCCESS) {
+		std::cout << "failed to begin hybrid command buffer\n";
+		return -1;
+	}
+	if (hybrid.timestamps != VK_NULL_HANDLE) {
+		init.disp.cmdResetQueryPool(cmd, hybrid.timestamps, (uint32_t) frame * 2, 2);
+		init.disp.cmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, hybrid.timestamps, (uint32_t) frame * 2);
+	}
+	record_compute_rows(init, compute, cmd, compute.descriptor_sets[frame], data.precision, hybrid.split);
+	if (hybrid.timestamps != VK_NULL_HANDLE)
+		init.disp.cmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, hybrid.timestamps, (uint32_t) frame * 2 + 1);
+	if (init.disp.endCommandBuffer(cmd) != VK_SUCCESS) {
+		std::cout << "failed to record hybrid command buffer\n";
+		return -1;
+	}
+
+	uint64_t value = ++hybrid.value;
+	VkSemaphoreSubmitInfo signal = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+		.semaphore = hybrid.timeline,
+		.value = value,
+		.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+	};
+	VkCommandBufferSubmitInfo command_buffer_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+		.commandBuffer = cmd,
+	};
+	VkSubmitInfo2 submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+		.commandBufferInfoCount = 1,
+		.pCommandBufferInfos = &command_buffer_info,
+		.signalSemaphoreInfoCount = 1,
+		.pSignalSemaphoreInfos = &signal,
+	};
+	if (init.disp.queueSubmit2(data.graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+		std::cout << "failed to submit hybrid rows\n";
+		return -1;
+	}
+	hybrid.gpu_rows[frame] = hybrid.split;
+
+	// the cpu's rows while the GPU does its own, on this thread and the engine's workers, done before the frame
+	// gets recorded; the wait for this slot covered the staging buffer
+	uint32_t cpu_rows = height - hybrid.split;
+	if (cpu_rows > 0) {
+		auto start = std::chrono::steady_clock::now();
+		cpu_render_rows(hybrid.cpu, params, hybrid.split, height, (uint32_t*) hybrid.staging_memory[frame].mapped);
+		double cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (cpu_ms > 0)
+			hybrid.cpu_rate = cpu_rows / cpu_ms;
+		hybrid.cpu_ms += cpu_ms;
+	}
+
+	// the rates say where both would have finished together; going halfway there keeps one odd frame, or
+	// rows far costlier than the rest moving across the split, from swinging it back and forth. Without
+	// timestamps, the GPU's rows already being done means the cpu held the frame up.
+	if (hybrid.timestamps != VK_NULL_HANDLE) {
+		if (hybrid.gpu_rate > 0 && hybrid.cpu_rate > 0) {
+			double target = hybrid.cpu_rate / (hybrid.cpu_rate + hybrid.gpu_rate);
+			hybrid.share = hybrid.gpu_frames <= 1 ? target : (hybrid.share + target) / 2;
+		}
+	} else if (cpu_rows > 0 && hybrid.split > 0) {
+		uint64_t done = 0;
+		if (init.disp.getSemaphoreCounterValue(hybrid.timeline, &done) == VK_SUCCESS)
+			hybrid.share = std::clamp(hybrid.share + (done >= value ? -HYBRID_NUDGE : HYBRID_NUDGE), 0.0, 1.0);
+	}
+
+	hybrid.frames++;
+	hybrid.cpu_rows += cpu_rows;
+	hybrid.rows += height;
+	return 0;
+}
+
+void record_hybrid_upload(Init& init, Hybrid& hybrid, const ComputeEngine& compute, VkCommandBuffer cmd, size_t frame) {
+	uint32_t width = compute.extent.width;
+	uint32_t height = compute.extent.height;
+	if (hybrid.split >= height)
+		return;
+
+	// the GPU's rows were written in a submission of their own, which record_compute_rows left ordered before
+	// colouring; the copy only has to wait out earlier frames' colorize reads and GPU writes of the same rows
+	VkMemoryBarrier previous_reads = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &previous_reads, 0, nullptr, 0, nullptr);
+
+	VkBufferCopy region = {
+		.srcOffset = 0,
+		.dstOffset = (VkDeviceSize) hybrid.split * width * sizeof(uint32_t),
+		.size = (VkDeviceSize) (height - hybrid.split) * width * sizeof(uint32_t),
+	};
+	init.disp.cmdCopyBuffer(cmd, hybrid.staging[frame], compute.iterations, 1, &region);
+
+	VkMemoryBarrier uploaded = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		// and the next frame's GPU rows, which may land where these were
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &uploaded, 0, nullptr, 0, nullptr);
+}
+
+void report_hybrid(const Hybrid& hybrid) {
+	if (!hybrid.enabled || hybrid.frames == 0)
+		return;
+	printf("hybrid: %llu frames, the cpu engine took %.1f%% of the rows in %.2fms a frame (%.1f rows/ms)",
+		(unsigned long long) hybrid.frames, 100.0 * hybrid.cpu_rows / hybrid.rows, hybrid.cpu_ms / hybrid.frames, hybrid.cpu_rate);
+	if (hybrid.gpu_frames > 0)
+		printf(", the GPU its rows in %.2fms (%.1f rows/ms)", hybrid.gpu_ms / hybrid.gpu_frames, hybrid.gpu_rate);
+	printf(", ending at a %.1f%% cpu share\n", 100.0 * hybrid.share);
+}
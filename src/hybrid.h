@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include "allocator.h"
+#include "cpu_engine.h"
+
+struct Init;
+struct Options;
+struct ComputeEngine;
+struct RenderData;
+
+// the window's compute engine frames split between the GPU and the cpu engine: the GPU iterates the rows above
+// split, the cpu engine the ones below into a staging buffer, and the frame's own command buffer uploads them
+// into the iteration buffer before colouring, so equalising sees one frame. Both run at once, and the host never
+// waits on the GPU's rows: their time comes from timestamps read when the frame slot comes round again, and each
+// frame moves the split towards where both sides would have finished together. Experimental: the cpu side's
+// rows match cpu_render's, but the split and the seam against the GPU's rows have yet to be checked on a device.
+struct Hybrid {
+	// off unless --hybrid
+	bool enabled = false;
+	CpuEngine cpu;
+
+	// the cpu's share of the rows for the next frame, and the row the last one split at
+	double share = 0.5;
+	uint32_t split = 0;
+	// rows per millisecond each side managed when last given any
+	double gpu_rate = 0;
+	double cpu_rate = 0;
+
+	// per frame in flight: the GPU's rows, submitted ahead of the frame's command buffer, and the cpu's counts
+	std::vector<VkCommandBuffer> commands;
+	std::vector<VkBuffer> staging;
+	std::vector<Allocation> staging_memory;
+	// per frame in flight, the GPU rows its last submission iterated and a timestamp either side of them; no
+	// pool when the queue has no timestamps
+	std::vector<uint32_t> gpu_rows;
+	VkQueryPool timestamps = VK_NULL_HANDLE;
+	double timestamp_period = 0;
+	uint64_t timestamp_mask = 0;
+	// without timestamps, polled once the cpu's rows are done to see which side finished first
+	VkSemaphore timeline = VK_NULL_HANDLE;
+	uint64_t value = 0;
+
+	// for report_hybrid
+	uint64_t frames = 0;
+	uint64_t cpu_rows = 0;
+	uint64_t rows = 0;
+	double cpu_ms = 0;
+	uint64_t gpu_frames = 0;
+	double gpu_ms = 0;
+};
+
+// does nothing unless options.hybrid; needs the command pool
+int create_hybrid(Init& init, RenderData& data, const Options& options);
+// sizes the staging buffers for compute's current extent, so it has to follow every create_compute_targets
+int bind_hybrid_targets(Init& init, Hybrid& hybrid, const ComputeEngine& compute);
+void destroy_hybrid(Init& init, Hybrid& hybrid);
+
+// submits the GPU's rows of params and iterates the cpu's meanwhile, leaving them in frame's staging buffer for
+// record_hybrid_upload and the split moved for the next frame. Whatever last used frame has to have finished.
+int hybrid_iterate(Init& init, RenderData& data, size_t frame, const MandelParams& params);
+// copies the cpu's rows of hybrid_iterate's frame into compute's iteration buffer, ready for record_colorize
+void record_hybrid_upload(Init& init, Hybrid& hybrid, const ComputeEngine& compute, VkCommandBuffer cmd, size_t frame);
+
+// how the rows were shared out over the session
+void report_hybrid(const Hybrid& hybrid);
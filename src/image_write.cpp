@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include <zlib.h>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include "image_write.h"
+
+static bool ends_with(const std::string& s, const char* suffix) {
+	size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+std::string format_output_name(const std::string& pattern, int index, bool multiple) {
+	size_t pct = pattern.find('%');
+	if (pct != std::string::npos) {
+		// accept %d and %0Nd, which is all anyone uses for frame numbers
+		size_t end = pct + 1;
+		bool zero_pad = end < pattern.size() && pattern[end] == '0';
+		int width = 0;
+		while (end < pattern.size() && pattern[end] >= '0' && pattern[end] <= '9')
+			width = width * 10 + (pattern[end++] - '0');
+		if (end < pattern.size() && pattern[end] == 'd') {
+			char number[32];
+			snprintf(number, sizeof(number), zero_pad ? "%0*d" : "%*d", width, index);
+			return pattern.substr(0, pct) + number + pattern.substr(end + 1);
+		}
+	}
+
+	if (!multiple)
+		return pattern;
+
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), "_%04d", index);
+
+	size_t dot = pattern.rfind('.');
+	size_t slash = pattern.rfind('/');
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return pattern + suffix;
+	return pattern.substr(0, dot) + suffix + pattern.substr(dot);
+}
+
+int write_image(const std::string& filename, uint32_t width, uint32_t height, const uint8_t* rgba) {
+	if (ends_with(filename, ".png") || ends_with(filename, ".PNG")) {
+		if (!stbi_write_png(filename.c_str(), (int) width, (int) height, 4, rgba, (int) (width * 4))) {
+			std::cout << "failed to write " << filename << "\n";
+			return -1;
+		}
+		return 0;
+	}
+
+	FILE* f = fopen(filename.c_str(), "wb");
+	if (f == nullptr) {
+		std::cout << "failed to open " << filename << " for writing\n";
+		return -1;
+	}
+	size_t size = (size_t) width * height * 4;
+	size_t written = fwrite(rgba, 1, size, f);
+	if (fclose(f) != 0 || written != size) {
+		std::cout << "failed to write " << filename << "\n";
+		return -1;
+	}
+	return 0;
+}
+
+// compressed bytes per IDAT chunk
+static const uint32_t PNG_CHUNK = 1 << 20;
+
+static void put_be32(uint8_t* p, uint32_t value) {
+	p[0] = (uint8_t) (value >> 24);
+	p[1] = (uint8_t) (value >> 16);
+	p[2] = (uint8_t) (value >> 8);
+	p[3] = (uint8_t) value;
+}
+
+static bool write_chunk(FILE* file, const char* type, const uint8_t* data, uint32_t size) {
+	uint8_t header[8];
+	put_be32(header, size);
+	memcpy(header + 4, type, 4);
+	// the CRC covers the type and data, not the length
+	uLong crc = crc32(0, header + 4, 4);
+	if (size > 0)
+		crc = crc32(crc, data, size);
+	uint8_t trailer[4];
+	put_be32(trailer, (uint32_t) crc);
+	return fwrite(header, 1, 8, file) == 8 && (size == 0 || fwrite(data, 1, size, file) == size) && fwrite(trailer, 1, 4, file) == 4;
+}
+
+// runs deflate over its pending input, writing an IDAT chunk every time the output buffer fills
+static int deflate_rows(ImageStream& stream, int flush) {
+	z_stream* z = stream.zlib;
+	for (;;) {
+		int ret = deflate(z, flush);
+		if (ret == Z_STREAM_ERROR)
+			return -1;
+		if (z->avail_out == 0) {
+			if (!write_chunk(stream.file, "IDAT", stream.compressed.data(), PNG_CHUNK))
+				return -1;
+			z->next_out = stream.compressed.data();
+			z->avail_out = PNG_CHUNK;
+			continue;
+		}
+		// room left over means deflate took all the input, or with Z_FINISH that it has finished
+		if (flush != Z_FINISH || ret == Z_STREAM_END)
+			return 0;
+	}
+}
+
+// closes the file and frees deflate's state, finished or not
+static void release_stream(ImageStream& stream) {
+	if (stream.zlib != nullptr) {
+		deflateEnd(stream.zlib);
+		delete stream.zlib;
+		stream.zlib = nullptr;
+	}
+	if (stream.file != nullptr)
+		fclose(stream.file);
+	stream.file = nullptr;
+}
+
+int open_image_stream(ImageStream& stream, const std::string& filename, uint32_t width, uint32_t height) {
+	stream = {};
+	stream.filename = filename;
+	stream.width = width;
+	stream.height = height;
+	stream.file = fopen(filename.c_str(), "wb");
+	if (stream.file == nullptr) {
+		std::cout << "failed to open " << filename << " for writing\n";
+		return -1;
+	}
+	if (!ends_with(filename, ".png") && !ends_with(filename, ".PNG"))
+		return 0;
+
+	stream.zlib = new z_stream {};
+	// at poster sizes deflate is what the export waits on, and the filtered rows still compress well
+	if (deflateInit(stream.zlib, Z_BEST_SPEED) != Z_OK) {
+		std::cout << "failed to start compressing " << filename << "\n";
+		release_stream(stream);
+		return -1;
+	}
+	stream.filtered.resize(1 + (size_t) width * 4);
+	stream.compressed.resize(PNG_CHUNK);
+	stream.zlib->next_out = stream.compressed.data();
+	stream.zlib->avail_out = PNG_CHUNK;
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	// 8 bit RGBA, deflate, adaptive filtering, not interlaced
+	uint8_t ihdr[13] = { 0, 0, 0, 0, 0, 0, 0, 0, 8, 6, 0, 0, 0 };
+	put_be32(ihdr, width);
+	put_be32(ihdr + 4, height);
+	if (fwrite(signature, 1, sizeof(signature), stream.file) != sizeof(signature) || !write_chunk(stream.file, "IHDR", ihdr, sizeof(ihdr))) {
+		std::cout << "failed to write " << filename << "\n";
+		release_stream(stream);
+		return -1;
+	}
+	return 0;
+}
+
+int write_image_rows(ImageStream& stream, const uint8_t* rgba, uint32_t count) {
+	if (stream.rows + count > stream.height) {
+		std::cout << "more rows than " << stream.filename << " has room for\n";
+		return -1;
+	}
+	size_t row_size = (size_t) stream.width * 4;
+
+	if (stream.zlib == nullptr) {
+		if (fwrite(rgba, 1, row_size * count, stream.file) != row_size * count) {
+			std::cout << "failed to write " << stream.filename << "\n";
+			return -1;
+		}
+		stream.rows += count;
+		return 0;
+	}
+
+	for (uint32_t r = 0; r < count; r++) {
+		// the Sub filter, each byte less the one a pixel to its left, which turns smooth gradients into runs
+		const uint8_t* row = rgba + r * row_size;
+		uint8_t* filtered = stream.filtered.data();
+		filtered[0] = 1;
+		memcpy(filtered + 1, row, 4);
+		for (size_t i = 4; i < row_size; i++)
+			filtered[1 + i] = (uint8_t) (row[i] - row[i - 4]);
+
+		stream.zlib->next_in = filtered;
+		stream.zlib->avail_in = (uInt) stream.filtered.size();
+		if (0 != deflate_rows(stream, Z_NO_FLUSH)) {
+			std::cout << "failed to write " << stream.filename << "\n";
+			return -1;
+		}
+	}
+	stream.rows += count;
+	return 0;
+}
+
+int close_image_stream(ImageStream& stream) {
+	if (stream.file == nullptr)
+		return -1;
+
+	bool ok = stream.rows == stream.height;
+	if (!ok)
+		std::cout << stream.filename << " is incomplete, " << stream.rows << " of " << stream.height << " rows were written\n";
+	if (ok && stream.zlib != nullptr) {
+		ok = 0 == deflate_rows(stream, Z_FINISH) &&
+			write_chunk(stream.file, "IDAT", stream.compressed.data(), PNG_CHUNK - stream.zlib->avail_out) &&
+			write_chunk(stream.file, "IEND", nullptr, 0);
+	}
+	if (ok && fflush(stream.file) != 0)
+		ok = false;
+	release_stream(stream);
+	if (!ok) {
+		std::cout << "failed to write " << stream.filename << "\n";
+		return -1;
+	}
+	return 0;
+}
+
+// what was stdout before claim_stdout pointed it at stderr, -1 until then
+static int video_stdout = -1;
+
+void claim_stdout() {
+	fflush(stdout);
+	video_stdout = dup(STDOUT_FILENO);
+	// everything else this process prints is text, which would corrupt the video
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+}
+
+int open_video_sink(VideoSink& sink, const std::string& filename, uint32_t width, uint32_t height, uint32_t fps) {
+	sink = {};
+	sink.filename = filename;
+	sink.width = width;
+	sink.height = height;
+	sink.y4m = ends_with(filename, ".y4m") || ends_with(filename, ".Y4M");
+
+	if (filename == "-") {
+		if (video_stdout < 0) {
+			std::cout << "stdout wasn't claimed for video\n";
+			return -1;
+		}
+		sink.file = fdopen(video_stdout, "wb");
+		video_stdout = -1;
+	} else {
+		sink.file = fopen(filename.c_str(), "wb");
+	}
+	if (sink.file == nullptr) {
+		std::cout << "failed to open " << filename << " for writing\n";
+		return -1;
+	}
+
+	if (sink.y4m) {
+		sink.planes.resize((size_t) width * height * 3);
+		// C444 keeps every pixel's colour, which fine detail in the fractal needs
+		if (fprintf(sink.file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", width, height, fps) < 0) {
+			std::cout << "failed to write " << filename << "\n";
+			fclose(sink.file);
+			sink.file = nullptr;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int write_video_frame(VideoSink& sink, const uint8_t* rgba) {
+	size_t pixels = (size_t) sink.width * sink.height;
+	bool ok;
+	if (sink.y4m) {
+		// studio range BT.601 from the sRGB encoded values, like every other RGB to Y'CbCr conversion
+		uint8_t* y = sink.planes.data();
+		uint8_t* cb = y + pixels;
+		uint8_t* cr = cb + pixels;
+		for (size_t i = 0; i < pixels; i++) {
+			int r = rgba[i * 4], g = rgba[i * 4 + 1], b = rgba[i * 4 + 2];
+			y[i] = (uint8_t) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+			cb[i] = (uint8_t) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+			cr[i] = (uint8_t) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+		}
+		ok = fputs("FRAME\n", sink.file) >= 0 && fwrite(sink.planes.data(), 1, sink.planes.size(), sink.file) == sink.planes.size();
+	} else {
+		ok = fwrite(rgba, 1, pixels * 4, sink.file) == pixels * 4;
+	}
+	if (!ok) {
+		std::cout << "failed to write frame " << sink.frames << " to " << sink.filename << "\n";
+		return -1;
+	}
+	sink.frames++;
+	return 0;
+}
+
+int close_video_sink(VideoSink& sink) {
+	if (sink.file == nullptr)
+		return -1;
+	int res = fclose(sink.file);
+	sink.file = nullptr;
+	if (res != 0) {
+		std::cout << "failed to write " << sink.filename << "\n";
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+// expands the first %d / %0Nd in pattern with index; if there is none and several images are
+// being written, the index is inserted before the extension instead
+std::string format_output_name(const std::string& pattern, int index, bool multiple);
+
+// writes tightly packed RGBA8 pixels, as PNG if filename ends in .png or as raw RGBA otherwise
+int write_image(const std::string& filename, uint32_t width, uint32_t height, const uint8_t* rgba);
+
+struct z_stream_s;
+
+// an image written a band of rows at a time, so only the band has to be in memory however tall the image is.
+// PNG through zlib when the filename ends in .png, raw RGBA8 otherwise, like write_image.
+struct ImageStream {
+	std::string filename;
+	FILE* file = nullptr;
+	uint32_t width;
+	uint32_t height;
+	uint32_t rows = 0;
+
+	// deflate's state, nullptr for raw output
+	z_stream_s* zlib = nullptr;
+	// one row with its filter byte, and deflate output waiting to fill an IDAT chunk
+	std::vector<uint8_t> filtered;
+	std::vector<uint8_t> compressed;
+};
+
+// on failure there is nothing to close
+int open_image_stream(ImageStream& stream, const std::string& filename, uint32_t width, uint32_t height);
+// count rows of tightly packed RGBA8, carrying on below the last ones written
+int write_image_rows(ImageStream& stream, const uint8_t* rgba, uint32_t count);
+// finishes the file once every row is in; otherwise, or on error, it is left incomplete and -1 returned
+int close_image_stream(ImageStream& stream);
+
+// equally sized frames for an external encoder: YUV4MPEG2 (4:4:4, BT.601) when the filename ends in .y4m,
+// raw RGBA8 one frame after another otherwise
+struct VideoSink {
+	std::string filename;
+	FILE* file = nullptr;
+	uint32_t width;
+	uint32_t height;
+	bool y4m = false;
+	// the three planes of one Y4M frame
+	std::vector<uint8_t> planes;
+	uint32_t frames = 0;
+};
+
+// "-" means stdout, which has to be claimed before anything else gets printed to it
+void claim_stdout();
+int open_video_sink(VideoSink& sink, const std::string& filename, uint32_t width, uint32_t height, uint32_t fps);
+int write_video_frame(VideoSink& sink, const uint8_t* rgba);
+int close_video_sink(VideoSink& sink);
@@ -1,67 +1,25 @@
+#include <fcntl.h>
+#include <math.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <memory>
 #include <iostream>
-#include <fstream>
 #include <string>
 
-#include <vulkan/vulkan_core.h>
-#include <GLFW/glfw3.h>
+#include "render.h"
+#include "headless.h"
+#include "pipeline_cache.h"
+#include "bench.h"
+#include "poster.h"
+#include "farm.h"
+#include "animation.h"
+#include "image_write.h"
 
-#include "VkBootstrap.h"
-
-// #include "vk_mem_alloc.h"
-
-#define EXAMPLE_BUILD_DIRECTORY "./shaders"
-
-const int MAX_FRAMES_IN_FLIGHT = 3;
-
-struct Init {
-	GLFWwindow* window;
-	vkb::Instance instance;
-	vkb::InstanceDispatchTable inst_disp;
-	VkSurfaceKHR surface;
-	vkb::PhysicalDevice physical_device;
-	vkb::Device device;
-	vkb::DispatchTable disp;
-	vkb::Swapchain swapchain;
-
-	// VmaAllocator allocator;
-};
-
-struct RenderData {
-	VkQueue graphics_queue;
-	VkQueue present_queue;
-
-	std::vector<VkImage> swapchain_images;
-	std::vector<VkImageView> swapchain_image_views;
-	std::vector<VkFramebuffer> framebuffers;
-
-	VkRenderPass render_pass;
-	VkPipelineLayout pipeline_layout;
-	VkPipeline graphics_pipeline;
-
-	VkCommandPool command_pool;
-	std::vector<VkCommandBuffer> command_buffers;
-
-	std::vector<VkSemaphore> available_semaphores;
-	std::vector<VkSemaphore> finished_semaphore;
-	std::vector<VkFence> in_flight_fences;
-	std::vector<VkFence> image_in_flight;
-
-	std::vector<VkBuffer> buffers;
-	std::vector<VkDeviceMemory> buffersMemory;
-	std::vector<void*> buffersMapped;
-
-	VkDescriptorPool descriptorPool;
-	VkDescriptorSetLayout setLayout {};
-
-	std::vector<VkDescriptorSet> descriptorSets;
-
-	size_t current_frame = 0;
-};
-
-// left/top/right/bottom borders
 double edgeData[4] = {-2.0f, -2.0f, 2.0f, 2.0f};
 
 GLFWwindow* create_window_glfw(const char* window_name = "", bool resize = true) {
@@ -93,11 +51,25 @@ VkSurfaceKHR create_surface_glfw(VkInstance instance, GLFWwindow* window, VkAllo
 	return surface;
 }
 
-int device_initialization(Init& init) {
-	init.window = create_window_glfw("Vulkan Mandel", true);
+int device_initialization(Init& init, const Options& options, PhaseTimer& startup) {
+	// headless runs have no display to open, so there is no window and no surface to present to
+	init.window = options.headless ? nullptr : create_window_glfw("Vulkan Mandel", true);
+	if (!options.headless)
+		timer_mark(startup, "window");
 
 	vkb::InstanceBuilder instance_builder;
-	auto instance_ret = instance_builder.use_default_debug_messenger().request_validation_layers().build();
+	if (options.validation)
+		instance_builder.use_default_debug_messenger().request_validation_layers();
+	// the swapchain extension that gives presents a fence needs these on the instance
+	bool surface_maintenance = false;
+	auto system_info = vkb::SystemInfo::get_system_info();
+	if (!options.headless && system_info && system_info->is_extension_available(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME) &&
+			system_info->is_extension_available(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME)) {
+		instance_builder.enable_extension(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+		instance_builder.enable_extension(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+		surface_maintenance = true;
+	}
+	auto instance_ret = instance_builder.set_headless(options.headless).require_api_version(1, 3, 0).build();
 	if (!instance_ret) {
 		std::cout << instance_ret.error().message() << "\n";
 		return -1;
@@ -106,7 +78,8 @@ int device_initialization(Init& init) {
 
 	init.inst_disp = init.instance.make_table();
 
-	init.surface = create_surface_glfw(init.instance, init.window);
+	init.surface = options.headless ? VK_NULL_HANDLE : create_surface_glfw(init.instance, init.window);
+	timer_mark(startup, "instance");
 
 	vkb::PhysicalDeviceSelector phys_device_selector(init.instance);
 	{
@@ -114,18 +87,85 @@ int device_initialization(Init& init) {
 			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES
 		};
 		features12.bufferDeviceAddress = true;
+		features12.timelineSemaphore = true;
 		phys_device_selector.set_required_features_12(features12);
-
-		VkPhysicalDeviceFeatures features {};
-		features.shaderFloat64 = VK_TRUE;
-		phys_device_selector.set_required_features(features);
+		// draw_frame submits with vkQueueSubmit2, and the fragment engine renders without render passes
+		VkPhysicalDeviceVulkan13Features features13 {
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES
+		};
+		features13.synchronization2 = true;
+		features13.dynamicRendering = true;
+		phys_device_selector.set_required_features_13(features13);
+		phys_device_selector.set_minimum_version(1, 3);
 	}
-	auto phys_device_ret = phys_device_selector.set_surface(init.surface).select();
-	if (!phys_device_ret) {
-		std::cout << phys_device_ret.error().message() << "\n";
+	if (options.headless)
+		phys_device_selector.require_present(false);
+	else
+		phys_device_selector.set_surface(init.surface);
+
+	auto phys_devices_ret = phys_device_selector.select_devices();
+	if (!phys_devices_ret) {
+		std::cout << phys_devices_ret.error().message() << "\n";
 		return -1;
 	}
-	init.physical_device = phys_device_ret.value();
+	// devices come back best first; --device lets build boxes pick a software rasterizer like lavapipe
+	auto& phys_devices = phys_devices_ret.value();
+	init.physical_device = phys_devices[0];
+	if (!options.device_name.empty()) {
+		bool found = false;
+		for (auto& pd : phys_devices) {
+			if (pd.name.find(options.device_name) != std::string::npos) {
+				init.physical_device = pd;
+				found = true;
+				break;
+			}
+		}
+		if (!found) {
+			std::cout << "no suitable device matches \"" << options.device_name << "\"\n";
+			return -1;
+		}
+	}
+	std::cout << "Using " << init.physical_device.name << std::endl;
+
+	// without fp64 the f32 and double-single tiers still work, but nothing that has to match the CPU exactly
+	VkPhysicalDeviceFeatures float64 {};
+	float64.shaderFloat64 = VK_TRUE;
+	init.shader_float64 = init.physical_device.enable_features_if_present(float64);
+	if (!init.shader_float64) {
+		const char* needs = nullptr;
+		if (options.engine == ENGINE_DEEP)
+			needs = "the deep engine";
+		else if (options.precision == PRECISION_F64)
+			needs = "--precision f64";
+		else if (options.validate)
+			needs = "--validate";
+		if (needs != nullptr) {
+			std::cout << init.physical_device.name << " has no shaderFloat64, which " << needs << " needs\n";
+			return -1;
+		}
+	}
+
+	VkPhysicalDeviceFeatures profiling {};
+	init.pipeline_statistics = init.fragment_atomics = false;
+	if (options.profile) {
+		profiling.pipelineStatisticsQuery = VK_TRUE;
+		init.pipeline_statistics = init.physical_device.enable_features_if_present(profiling);
+		profiling = {};
+		profiling.fragmentStoresAndAtomics = VK_TRUE;
+		init.fragment_atomics = init.physical_device.enable_features_if_present(profiling);
+	}
+
+	// only --memory reads the budget
+	bool memory_budget = options.memory && init.physical_device.enable_extension_if_present(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+	// retired swapchains wait for their last presents on these fences, or else for the whole present queue
+	VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapchain_maintenance {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT
+	};
+	swapchain_maintenance.swapchainMaintenance1 = VK_TRUE;
+	init.present_fences = surface_maintenance &&
+		init.physical_device.enable_extension_if_present(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME) &&
+		init.physical_device.enable_extension_features_if_present(swapchain_maintenance);
 
 	vkb::DeviceBuilder device_builder{ init.physical_device };
 	auto device_ret = device_builder.build();
@@ -136,21 +176,37 @@ int device_initialization(Init& init) {
 	init.device = device_ret.value();
 
 	init.disp = init.device.make_table();
+	create_allocator(init, memory_budget);
+	timer_mark(startup, "device");
 
 	return 0;
 }
 
-int create_swapchain(Init& init) {
+static VkPresentModeKHR vk_present_mode(PresentMode mode) {
+	switch (mode) {
+		case PRESENT_FIFO:      return VK_PRESENT_MODE_FIFO_KHR;
+		case PRESENT_MAILBOX:   return VK_PRESENT_MODE_MAILBOX_KHR;
+		case PRESENT_IMMEDIATE: return VK_PRESENT_MODE_IMMEDIATE_KHR;
+	}
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
 
+// leaves the swapchain it replaces, if any, for the caller to retire
+int create_swapchain(Init& init) {
+	bool first = init.swapchain.swapchain == VK_NULL_HANDLE;
 	vkb::SwapchainBuilder swapchain_builder{ init.device };
-	// swapchain_builder.set_desired_present_mode(VK_PRESENT_MODE_MAILBOX_KHR);
+	swapchain_builder.set_desired_present_mode(init.present_mode);
+	swapchain_builder.add_fallback_present_mode(VK_PRESENT_MODE_FIFO_KHR);
+	// the compute engine blits its storage image straight into the swapchain
+	swapchain_builder.add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT);
 	auto swap_ret = swapchain_builder.set_old_swapchain(init.swapchain).build();
 	if (!swap_ret) {
 		std::cout << swap_ret.error().message() << " " << swap_ret.vk_result() << "\n";
 		return -1;
 	}
-	vkb::destroy_swapchain(init.swapchain);
 	init.swapchain = swap_ret.value();
+	if (first && init.swapchain.present_mode != init.present_mode)
+		std::cout << "the surface doesn't support the requested present mode, using fifo\n";
 	return 0;
 }
 
@@ -162,6 +218,16 @@ int get_queues(Init& init, RenderData& data) {
 	}
 	data.graphics_queue = gq.value();
 
+	// vk-bootstrap makes a queue in every family, so this only finds out whether there is one
+	auto tq = init.device.get_queue(vkb::QueueType::transfer);
+	if (tq.has_value()) {
+		data.transfer_queue = tq.value();
+		data.transfer_family = init.device.get_queue_index(vkb::QueueType::transfer).value();
+	}
+
+	if (init.surface == VK_NULL_HANDLE)
+		return 0;
+
 	auto pq = init.device.get_queue(vkb::QueueType::present);
 	if (!pq.has_value()) {
 		std::cout << "failed to get present queue: " << pq.error().message() << "\n";
@@ -171,76 +237,41 @@ int get_queues(Init& init, RenderData& data) {
 	return 0;
 }
 
-int create_render_pass(Init& init, RenderData& data) {
-	VkAttachmentDescription color_attachment = {};
-	color_attachment.format = init.swapchain.image_format;
-	color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-	VkAttachmentReference color_attachment_ref = {};
-	color_attachment_ref.attachment = 0;
-	color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-	VkSubpassDescription subpass = {};
-	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpass.colorAttachmentCount = 1;
-	subpass.pColorAttachments = &color_attachment_ref;
-
-	VkSubpassDependency dependency = {};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-	VkRenderPassCreateInfo render_pass_info = {};
-	render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	render_pass_info.attachmentCount = 1;
-	render_pass_info.pAttachments = &color_attachment;
-	render_pass_info.subpassCount = 1;
-	render_pass_info.pSubpasses = &subpass;
-	render_pass_info.dependencyCount = 1;
-	render_pass_info.pDependencies = &dependency;
-
-	if (init.disp.createRenderPass(&render_pass_info, nullptr, &data.render_pass) != VK_SUCCESS) {
-		std::cout << "failed to create render pass\n";
-		return -1; // failed to create render pass!
-	}
-	return 0;
+std::string shader_path(const char* name, Precision precision) {
+	const char* suffix = "";
+	if (precision == PRECISION_F32)
+		suffix = ".f32";
+	else if (precision == PRECISION_DS)
+		suffix = ".ds";
+	return std::string(EXAMPLE_BUILD_DIRECTORY) + "/" + name + suffix + ".spv";
 }
 
-std::vector<char> readFile(const std::string& filename) {
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-	if (!file.is_open()) {
-		throw std::runtime_error("failed to open file!");
+VkShaderModule createShaderModule(Init& init, const std::string& path) {
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		std::cout << "failed to open " << path << "\n";
+		return VK_NULL_HANDLE;
+	}
+	struct stat st;
+	void* code = MAP_FAILED;
+	// SPIR-V is a whole number of words, and a mapping starts page aligned
+	if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size % 4 == 0)
+		code = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (code == MAP_FAILED) {
+		std::cout << "failed to map " << path << "\n";
+		return VK_NULL_HANDLE;
 	}
 
-	size_t file_size = (size_t)file.tellg();
-	std::vector<char> buffer(file_size);
-
-	file.seekg(0);
-	file.read(buffer.data(), static_cast<std::streamsize>(file_size));
-
-	file.close();
-
-	return buffer;
-}
-
-VkShaderModule createShaderModule(Init& init, const std::vector<char>& code) {
 	VkShaderModuleCreateInfo create_info = {};
 	create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	create_info.codeSize = code.size();
-	create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	create_info.codeSize = (size_t) st.st_size;
+	create_info.pCode = (const uint32_t*) code;
 
 	VkShaderModule shaderModule;
-	if (init.disp.createShaderModule(&create_info, nullptr, &shaderModule) != VK_SUCCESS) {
+	VkResult res = init.disp.createShaderModule(&create_info, nullptr, &shaderModule);
+	munmap(code, (size_t) st.st_size);
+	if (res != VK_SUCCESS) {
 		return VK_NULL_HANDLE; // failed to create shader module
 	}
 
@@ -248,90 +279,6 @@ VkShaderModule createShaderModule(Init& init, const std::vector<char>& code) {
 }
 
 int create_graphics_pipeline(Init& init, RenderData& data) {
-	auto vert_code = readFile(std::string(EXAMPLE_BUILD_DIRECTORY) + "/shader.vert.spv");
-	auto frag_code = readFile(std::string(EXAMPLE_BUILD_DIRECTORY) + "/shader.frag.spv");
-
-	VkShaderModule vert_module = createShaderModule(init, vert_code);
-	VkShaderModule frag_module = createShaderModule(init, frag_code);
-	if (vert_module == VK_NULL_HANDLE || frag_module == VK_NULL_HANDLE) {
-		std::cout << "failed to create shader module\n";
-		return -1; // failed to create shader modules
-	}
-
-	VkPipelineShaderStageCreateInfo vert_stage_info = {};
-	vert_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vert_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vert_stage_info.module = vert_module;
-	vert_stage_info.pName = "main";
-
-	VkPipelineShaderStageCreateInfo frag_stage_info = {};
-	frag_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	frag_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	frag_stage_info.module = frag_module;
-	frag_stage_info.pName = "main";
-
-	VkPipelineShaderStageCreateInfo shader_stages[] = { vert_stage_info, frag_stage_info };
-
-	VkPipelineVertexInputStateCreateInfo vertex_input_info = {};
-	vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertex_input_info.vertexBindingDescriptionCount = 0;
-	vertex_input_info.vertexAttributeDescriptionCount = 0;
-
-	VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
-	input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	input_assembly.primitiveRestartEnable = VK_FALSE;
-
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)init.swapchain.extent.width;
-	viewport.height = (float)init.swapchain.extent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor = {};
-	scissor.offset = { 0, 0 };
-	scissor.extent = init.swapchain.extent;
-
-	VkPipelineViewportStateCreateInfo viewport_state = {};
-	viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewport_state.viewportCount = 1;
-	viewport_state.pViewports = &viewport;
-	viewport_state.scissorCount = 1;
-	viewport_state.pScissors = &scissor;
-
-	VkPipelineRasterizationStateCreateInfo rasterizer = {};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizer.lineWidth = 1.0f;
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-	rasterizer.depthBiasEnable = VK_FALSE;
-
-	VkPipelineMultisampleStateCreateInfo multisampling = {};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-	colorBlendAttachment.colorWriteMask =
-	VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_FALSE;
-
-	VkPipelineColorBlendStateCreateInfo color_blending = {};
-	color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	color_blending.logicOpEnable = VK_FALSE;
-	color_blending.logicOp = VK_LOGIC_OP_COPY;
-	color_blending.attachmentCount = 1;
-	color_blending.pAttachments = &colorBlendAttachment;
-	color_blending.blendConstants[0] = 0.0f;
-	color_blending.blendConstants[1] = 0.0f;
-	color_blending.blendConstants[2] = 0.0f;
-	color_blending.blendConstants[3] = 0.0f;
-
 	VkDescriptorSetLayoutBinding binding {};
 	binding.binding = 0;
 	binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -375,11 +322,7 @@ int create_graphics_pipeline(Init& init, RenderData& data) {
 		throw std::runtime_error("Descriptor Set creation failed!");
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		VkDescriptorBufferInfo bufferInfo = {
-			.buffer = data.buffers[i],
-			.offset = 0,
-			.range = VK_WHOLE_SIZE,
-		};
+		VkDescriptorBufferInfo bufferInfo = uniform_descriptor(data.uniforms, i);
 
 		VkWriteDescriptorSet descriptorWrite = {
 			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
@@ -402,6 +345,107 @@ int create_graphics_pipeline(Init& init, RenderData& data) {
 	if (init.disp.createPipelineLayout(&pipeline_layout_info, nullptr, &data.pipeline_layout) != VK_SUCCESS)
 		throw std::runtime_error("failed to create pipeline layout\n");
 
+	data.vert_module = createShaderModule(init, std::string(EXAMPLE_BUILD_DIRECTORY) + "/shader.vert.spv");
+	if (data.vert_module == VK_NULL_HANDLE) {
+		std::cout << "failed to create shader module\n";
+		return -1; // failed to create shader modules
+	}
+
+	// the tiers only differ in their fragment shader
+	for (int p = 0; p < PRECISION_COUNT; p++) {
+		data.frag_modules[p] = VK_NULL_HANDLE;
+		if (p == PRECISION_F64 && !init.shader_float64)
+			continue;
+
+		data.frag_modules[p] = createShaderModule(init, shader_path("shader.frag", (Precision) p));
+		if (data.frag_modules[p] == VK_NULL_HANDLE) {
+			std::cout << "failed to create shader module\n";
+			return -1; // failed to create shader modules
+		}
+	}
+	return 0;
+}
+
+VariantKey fragment_variant(const RenderData& data) {
+	KernelConstants constants = data.constants;
+	constants.max_iterations = data.max_iterations;
+	constants.palette = data.color.palette;
+	return VariantKey { data.precision, constants };
+}
+
+static VkPipeline build_graphics_variant(Init& init, RenderData& data, const VariantKey& key) {
+	KernelConstants constants = key.constants;
+	std::vector<VkSpecializationMapEntry> spec_entries;
+	kernel_constant_entries(0, spec_entries);
+	VkSpecializationInfo spec_info = {
+		.mapEntryCount = (uint32_t) spec_entries.size(),
+		.pMapEntries = spec_entries.data(),
+		.dataSize = sizeof(constants),
+		.pData = &constants,
+	};
+
+	VkPipelineShaderStageCreateInfo vert_stage_info = {};
+	vert_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vert_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	vert_stage_info.module = data.vert_module;
+	vert_stage_info.pName = "main";
+
+	VkPipelineShaderStageCreateInfo frag_stage_info = {};
+	frag_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	frag_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	frag_stage_info.module = data.frag_modules[key.precision];
+	frag_stage_info.pName = "main";
+	frag_stage_info.pSpecializationInfo = &spec_info;
+
+	VkPipelineShaderStageCreateInfo shader_stages[] = { vert_stage_info, frag_stage_info };
+
+	VkPipelineVertexInputStateCreateInfo vertex_input_info = {};
+	vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertex_input_info.vertexBindingDescriptionCount = 0;
+	vertex_input_info.vertexAttributeDescriptionCount = 0;
+
+	VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
+	input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	input_assembly.primitiveRestartEnable = VK_FALSE;
+
+	// viewport and scissor are dynamic, so variants outlive swapchain resizes
+	VkPipelineViewportStateCreateInfo viewport_state = {};
+	viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewport_state.viewportCount = 1;
+	viewport_state.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer = {};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	rasterizer.depthBiasEnable = VK_FALSE;
+
+	VkPipelineMultisampleStateCreateInfo multisampling = {};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+	colorBlendAttachment.colorWriteMask =
+	VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_FALSE;
+
+	VkPipelineColorBlendStateCreateInfo color_blending = {};
+	color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	color_blending.logicOpEnable = VK_FALSE;
+	color_blending.logicOp = VK_LOGIC_OP_COPY;
+	color_blending.attachmentCount = 1;
+	color_blending.pAttachments = &colorBlendAttachment;
+	color_blending.blendConstants[0] = 0.0f;
+	color_blending.blendConstants[1] = 0.0f;
+	color_blending.blendConstants[2] = 0.0f;
+	color_blending.blendConstants[3] = 0.0f;
+
 	std::vector<VkDynamicState> dynamic_states = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
 
 	VkPipelineDynamicStateCreateInfo dynamic_info = {};
@@ -409,6 +453,12 @@ int create_graphics_pipeline(Init& init, RenderData& data) {
 	dynamic_info.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
 	dynamic_info.pDynamicStates = dynamic_states.data();
 
+	VkPipelineRenderingCreateInfo rendering_info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+		.colorAttachmentCount = 1,
+		.pColorAttachmentFormats = &data.color_format,
+	};
+
 	VkGraphicsPipelineCreateInfo pipeline_info = {};
 	pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 	pipeline_info.stageCount = 2;
@@ -421,96 +471,45 @@ int create_graphics_pipeline(Init& init, RenderData& data) {
 	pipeline_info.pColorBlendState = &color_blending;
 	pipeline_info.pDynamicState = &dynamic_info;
 	pipeline_info.layout = data.pipeline_layout;
-	pipeline_info.renderPass = data.render_pass;
-	pipeline_info.subpass = 0;
+	pipeline_info.pNext = &rendering_info;
 	pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
 
-	if (init.disp.createGraphicsPipelines(VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &data.graphics_pipeline) != VK_SUCCESS) {
-		std::cout << "failed to create pipline\n";
-		return -1; // failed to create graphics pipeline
+	VkPipeline pipeline;
+	if (init.disp.createGraphicsPipelines(init.pipeline_cache, 1, &pipeline_info, nullptr, &pipeline) != VK_SUCCESS) {
+		std::cout << "failed to create " << precision_name(key.precision) << " pipline\n";
+		return VK_NULL_HANDLE; // failed to create graphics pipeline
 	}
+	return pipeline;
+}
 
-	init.disp.destroyShaderModule(frag_module, nullptr);
-	init.disp.destroyShaderModule(vert_module, nullptr);
-	return 0;
+VkPipeline graphics_variant(Init& init, RenderData& data, const VariantKey& key) {
+	auto found = data.graphics_variants.find(key);
+	if (found != data.graphics_variants.end())
+		return found->second;
+
+	if (data.frag_modules[key.precision] == VK_NULL_HANDLE)
+		return VK_NULL_HANDLE;
+	VkPipeline pipeline = build_graphics_variant(init, data, key);
+	if (pipeline != VK_NULL_HANDLE)
+		data.graphics_variants.emplace(key, pipeline);
+	return pipeline;
 }
 
 int create_transfer_buffers(Init& init, RenderData& data) {
-	data.buffers.resize(MAX_FRAMES_IN_FLIGHT);
-	data.buffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-	data.buffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
-
-	uint32_t memoryIndex = 0xFFFFFFFF;
-
 	std::cout << "Creating transfer buffers…" << std::endl;
-
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-	{
-		VkBufferCreateInfo bufferInfo = {};
-		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferInfo.size  = sizeof(edgeData);
-		bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-		VkResult ret = vkCreateBuffer(init.device, &bufferInfo, nullptr, &data.buffers[i]);
-		if (ret != VK_SUCCESS)
-			throw std::runtime_error("Buffer creation failed!");
-
-		VkMemoryRequirements memreq;
-		vkGetBufferMemoryRequirements(init.device, data.buffers[i], &memreq);
-
-		if (memoryIndex == 0xFFFFFFFF) {
-			VkPhysicalDeviceMemoryProperties memProperties;
-			vkGetPhysicalDeviceMemoryProperties(init.physical_device, &memProperties);
-
-			for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-				if ((memreq.memoryTypeBits & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) == (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
-					memoryIndex = i;
-					break;
-				}
-			}
-		}
-		if (memoryIndex == 0xFFFFFFFF)
-			throw std::runtime_error("No suitable memory type found!");
-
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memreq.size;
-		allocInfo.memoryTypeIndex = memoryIndex;
-
-		if (vkAllocateMemory(init.device, &allocInfo, nullptr, &data.buffersMemory[i]) != VK_SUCCESS)
-			throw std::runtime_error("Failed to allocate memory for buffer!");
-
-		vkBindBufferMemory(init.device, data.buffers[i], data.buffersMemory[i], 0);
-
-		vkMapMemory(init.device, data.buffersMemory[i], 0, sizeof(edgeData), 0, &data.buffersMapped[i]);
-	}
-
-	return 0;
+	return create_uniform_ring(init, data.uniforms, sizeof(MandelParams), MAX_FRAMES_IN_FLIGHT);
 }
 
-int create_framebuffers(Init& init, RenderData& data) {
-	data.swapchain_images = init.swapchain.get_images().value();
-	data.swapchain_image_views = init.swapchain.get_image_views().value();
-
-	data.framebuffers.resize(data.swapchain_image_views.size());
-
-	for (size_t i = 0; i < data.swapchain_image_views.size(); i++) {
-		VkImageView attachments[] = { data.swapchain_image_views[i] };
-
-		VkFramebufferCreateInfo framebuffer_info = {};
-		framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		framebuffer_info.renderPass = data.render_pass;
-		framebuffer_info.attachmentCount = 1;
-		framebuffer_info.pAttachments = attachments;
-		framebuffer_info.width = init.swapchain.extent.width;
-		framebuffer_info.height = init.swapchain.extent.height;
-		framebuffer_info.layers = 1;
-
-		if (init.disp.createFramebuffer(&framebuffer_info, nullptr, &data.framebuffers[i]) != VK_SUCCESS) {
-			return -1; // failed to create framebuffer
-		}
+// views for the fragment engine to render into; the compute engine blits to the images themselves
+int get_swapchain_images(Init& init, RenderData& data) {
+	auto images = init.swapchain.get_images();
+	auto views = init.swapchain.get_image_views();
+	if (!images || !views) {
+		std::cout << "failed to get swapchain images\n";
+		return -1;
 	}
+	data.swapchain_images = images.value();
+	data.swapchain_image_views = views.value();
 	return 0;
 }
 
@@ -518,6 +517,8 @@ int create_command_pool(Init& init, RenderData& data) {
 	VkCommandPoolCreateInfo pool_info = {};
 	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	pool_info.queueFamilyIndex = init.device.get_queue_index(vkb::QueueType::graphics).value();
+	// draw_frame re-records each frame in flight's command buffer every frame
+	pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
 	if (init.disp.createCommandPool(&pool_info, nullptr, &data.command_pool) != VK_SUCCESS) {
 		std::cout << "failed to create command pool\n";
@@ -526,122 +527,326 @@ int create_command_pool(Init& init, RenderData& data) {
 	return 0;
 }
 
+// one per frame in flight, recorded afresh every frame by record_frame
 int create_command_buffers(Init& init, RenderData& data) {
-	data.command_buffers.resize(data.framebuffers.size());
+	data.command_buffers.resize(MAX_FRAMES_IN_FLIGHT);
 
 	VkCommandBufferAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	allocInfo.commandPool = data.command_pool;
 	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = (uint32_t)data.command_buffers.size();
+	allocInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
 
 	if (init.disp.allocateCommandBuffers(&allocInfo, data.command_buffers.data()) != VK_SUCCESS) {
 		return -1; // failed to allocate command buffers;
 	}
+	return 0;
+}
 
-	for (size_t i = 0; i < data.command_buffers.size(); i++) {
-		VkCommandBufferBeginInfo begin_info = {};
-		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+// present waits on these, and without init.present_fences a present can't signal anything that says when it is
+// done with one. Acquiring an image again does say that for the image's previous present, so there is one per
+// image rather than per frame.
+static int create_present_semaphores(Init& init, RenderData& data) {
+	data.finished_semaphores.resize(init.swapchain.image_count);
 
-		if (init.disp.beginCommandBuffer(data.command_buffers[i], &begin_info) != VK_SUCCESS) {
-			return -1; // failed to begin recording command buffer
+	VkSemaphoreCreateInfo semaphore_info = {};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	for (auto& semaphore : data.finished_semaphores) {
+		if (init.disp.createSemaphore(&semaphore_info, nullptr, &semaphore) != VK_SUCCESS) {
+			std::cout << "failed to create sync objects\n";
+			return -1; // failed to create synchronization objects for a frame
 		}
+	}
 
-		VkRenderPassBeginInfo render_pass_info = {};
-		render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		render_pass_info.renderPass = data.render_pass;
-		render_pass_info.framebuffer = data.framebuffers[i];
-		render_pass_info.renderArea.offset = { 0, 0 };
-		render_pass_info.renderArea.extent = init.swapchain.extent;
-		VkClearValue clearColor{ { { 0.0f, 0.0f, 0.0f, 1.0f } } };
-		render_pass_info.clearValueCount = 1;
-		render_pass_info.pClearValues = &clearColor;
+	// signalled, so an image that was never presented waits on nothing
+	VkFenceCreateInfo fence_info = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.flags = VK_FENCE_CREATE_SIGNALED_BIT,
+	};
+	data.present_fences.resize(init.present_fences ? init.swapchain.image_count : 0);
+	for (auto& fence : data.present_fences) {
+		if (init.disp.createFence(&fence_info, nullptr, &fence) != VK_SUCCESS) {
+			std::cout << "failed to create sync objects\n";
+			return -1;
+		}
+	}
+	return 0;
+}
 
-		VkViewport viewport = {};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = (float)init.swapchain.extent.width;
-		viewport.height = (float)init.swapchain.extent.height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
+// a present can still be waiting on its semaphore after every frame has finished, so these wait for the presents
+// themselves: on their fences, or with no fences for everything on the present queue
+static void destroy_present_semaphores(Init& init, RenderData& data, std::vector<VkSemaphore>& semaphores, std::vector<VkFence>& fences) {
+	if (!fences.empty()) {
+		init.disp.waitForFences((uint32_t) fences.size(), fences.data(), VK_TRUE, UINT64_MAX);
+		for (auto fence : fences)
+			init.disp.destroyFence(fence, nullptr);
+	} else if (!semaphores.empty() && data.present_queue != VK_NULL_HANDLE) {
+		init.disp.queueWaitIdle(data.present_queue);
+	}
+	for (auto semaphore : semaphores)
+		init.disp.destroySemaphore(semaphore, nullptr);
+	semaphores.clear();
+	fences.clear();
+}
 
-		VkRect2D scissor = {};
-		scissor.offset = { 0, 0 };
-		scissor.extent = init.swapchain.extent;
+int create_sync_objects(Init& init, RenderData& data) {
+	data.available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
+	data.frame_values.assign(MAX_FRAMES_IN_FLIGHT, 0);
+	data.frame_count = 0;
 
-		// {
-		// 	init.disp.cmdPushConstants(data.command_buffers[i], data.pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(edgeData), edgeData);
-		// }
+	VkSemaphoreCreateInfo semaphore_info = {};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-		init.disp.cmdSetViewport(data.command_buffers[i], 0, 1, &viewport);
-		init.disp.cmdSetScissor(data.command_buffers[i], 0, 1, &scissor);
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		if (init.disp.createSemaphore(&semaphore_info, nullptr, &data.available_semaphores[i]) != VK_SUCCESS) {
+			std::cout << "failed to create sync objects\n";
+			return -1; // failed to create synchronization objects for a frame
+		}
+	}
 
-		init.disp.cmdBeginRenderPass(data.command_buffers[i], &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+	VkSemaphoreTypeCreateInfo timeline_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = 0,
+	};
+	semaphore_info.pNext = &timeline_info;
+	if (init.disp.createSemaphore(&semaphore_info, nullptr, &data.frame_timeline) != VK_SUCCESS) {
+		std::cout << "failed to create sync objects\n";
+		return -1;
+	}
 
-		init.disp.cmdBindPipeline(data.command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, data.graphics_pipeline);
+	return create_present_semaphores(init, data);
+}
 
-		init.disp.cmdBindDescriptorSets(data.command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, data.pipeline_layout, 0, 1, &data.descriptorSets[i], 0, nullptr);
+// blocks until the frame that signalled value has finished on the GPU
+static void wait_for_frame(Init& init, RenderData& data, uint64_t value) {
+	VkSemaphoreWaitInfo wait_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.semaphoreCount = 1,
+		.pSemaphores = &data.frame_timeline,
+		.pValues = &value,
+	};
+	init.disp.waitSemaphores(&wait_info, UINT64_MAX);
+}
 
-		init.disp.cmdDraw(data.command_buffers[i], 6, 1, 0, 0);
+// destroys the swapchains retired before frame done, or every one of them with UINT64_MAX once the device is idle,
+// each after its pending presents
+static void release_retired(Init& init, RenderData& data, uint64_t done) {
+	for (size_t i = 0; i < data.retired.size();) {
+		RetiredSwapchain& retired = data.retired[i];
+		if (retired.frame > done) {
+			i++;
+			continue;
+		}
+		destroy_present_semaphores(init, data, retired.finished_semaphores, retired.present_fences);
+		retired.swapchain.destroy_image_views(retired.image_views);
+		vkb::destroy_swapchain(retired.swapchain);
+		data.retired.erase(data.retired.begin() + i);
+	}
+}
 
-		init.disp.cmdEndRenderPass(data.command_buffers[i]);
+// nothing here waits on the GPU unless it has to: frames already submitted keep the old swapchain's images,
+// which stay alive until the first frame on the new one has finished and their last presents are done, and
+// rendering carries straight on. Only the compute engine's targets, which every frame in flight shares, wait
+// for those frames to resize.
+int recreate_swapchain(Init& init, RenderData& data) {
+	RetiredSwapchain retired = { init.swapchain, data.swapchain_image_views, data.finished_semaphores, data.present_fences, data.frame_count + 1 };
+	if (0 != create_swapchain(init)) return -1;
+	data.retired.push_back(retired);
+	data.finished_semaphores.clear();
+	data.present_fences.clear();
+
+	if (0 != get_swapchain_images(init, data)) return -1;
+	if (0 != create_present_semaphores(init, data)) return -1;
+
+	// pipelines are built for one attachment format, which a new swapchain could in principle change
+	if (init.swapchain.image_format != data.color_format) {
+		wait_for_frame(init, data, data.frame_count);
+		for (auto& variant : data.graphics_variants)
+			init.disp.destroyPipeline(variant.second, nullptr);
+		data.graphics_variants.clear();
+		data.color_format = init.swapchain.image_format;
+	}
 
-		if (init.disp.endCommandBuffer(data.command_buffers[i]) != VK_SUCCESS) {
-			std::cout << "failed to record command buffer\n";
-			return -1; // failed to record command buffer!
-		}
+	if (data.engine == ENGINE_COMPUTE) {
+		wait_for_frame(init, data, data.frame_count);
+		destroy_compute_targets(init, data.compute);
+		if (0 != create_compute_targets(init, data.compute, init.swapchain.extent)) return -1;
+		bind_colorizer_targets(init, data.colorizer, data.compute);
+		if (0 != bind_tile_cache_targets(init, data.tile_cache, data.compute)) return -1;
+		if (0 != bind_hybrid_targets(init, data.hybrid, data.compute)) return -1;
+		data.iterated = false;
 	}
+
+	data.redraw = true;
 	return 0;
 }
 
-int create_sync_objects(Init& init, RenderData& data) {
-	data.available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	data.finished_semaphore.resize(MAX_FRAMES_IN_FLIGHT);
-	data.in_flight_fences.resize(MAX_FRAMES_IN_FLIGHT);
-	data.image_in_flight.resize(init.swapchain.image_count, VK_NULL_HANDLE);
-
-	VkSemaphoreCreateInfo semaphore_info = {};
-	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+void record_fragment(Init& init, RenderData& data, VkCommandBuffer cmd, VkPipeline pipeline, VkDescriptorSet set, VkImage image, VkImageView view, VkExtent2D extent, VkImageLayout final_layout) {
+	// the old contents never matter. For the swapchain this chains onto the acquire semaphore, which the
+	// submit waits for at this stage.
+	VkImageMemoryBarrier2 to_attachment = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+		.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		.srcAccessMask = 0,
+		.dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		.dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+	};
+	VkDependencyInfo dependency = {
+		.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+		.imageMemoryBarrierCount = 1,
+		.pImageMemoryBarriers = &to_attachment,
+	};
+	init.disp.cmdPipelineBarrier2(cmd, &dependency);
+
+	VkRenderingAttachmentInfo color_attachment = {
+		.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+		.imageView = view,
+		.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+		.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+		.clearValue = { { { 0.0f, 0.0f, 0.0f, 1.0f } } },
+	};
+	VkRenderingInfo rendering_info = {
+		.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+		.renderArea = { { 0, 0 }, extent },
+		.layerCount = 1,
+		.colorAttachmentCount = 1,
+		.pColorAttachments = &color_attachment,
+	};
 
-	VkFenceCreateInfo fence_info = {};
-	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)extent.width;
+	viewport.height = (float)extent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		if (init.disp.createSemaphore(&semaphore_info, nullptr, &data.available_semaphores[i]) != VK_SUCCESS ||
-			init.disp.createSemaphore(&semaphore_info, nullptr, &data.finished_semaphore[i]) != VK_SUCCESS ||
-			init.disp.createFence(&fence_info, nullptr, &data.in_flight_fences[i]) != VK_SUCCESS) {
-			std::cout << "failed to create sync objects\n";
-		return -1; // failed to create synchronization objects for a frame
-			}
-	}
-	return 0;
+	VkRect2D scissor = {};
+	scissor.offset = { 0, 0 };
+	scissor.extent = extent;
+
+	init.disp.cmdSetViewport(cmd, 0, 1, &viewport);
+	init.disp.cmdSetScissor(cmd, 0, 1, &scissor);
+
+	init.disp.cmdBeginRendering(cmd, &rendering_info);
+	init.disp.cmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	init.disp.cmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, data.pipeline_layout, 0, 1, &set, 0, nullptr);
+	init.disp.cmdDraw(cmd, 6, 1, 0, 0);
+	init.disp.cmdEndRendering(cmd);
+
+	// presenting only needs the layout, the submit's semaphore orders the rest; copies wait for the writes
+	bool present = final_layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	VkImageMemoryBarrier2 to_final = to_attachment;
+	to_final.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+	to_final.dstStageMask = present ? VK_PIPELINE_STAGE_2_NONE : VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+	to_final.dstAccessMask = present ? VK_ACCESS_2_NONE : VK_ACCESS_2_TRANSFER_READ_BIT;
+	to_final.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	to_final.newLayout = final_layout;
+	dependency.pImageMemoryBarriers = &to_final;
+	init.disp.cmdPipelineBarrier2(cmd, &dependency);
 }
 
-int recreate_swapchain(Init& init, RenderData& data) {
-	init.disp.deviceWaitIdle();
+// everything a frame needs goes through the current frame's command buffer, uniform slot and descriptor
+// sets, so nothing here depends on which swapchain image was acquired except the target. Compute frames where
+// only colours changed skip iterating; progressive mode runs its next pass, and the tile cache whatever tiles
+// the view is missing.
+static int record_frame(Init& init, RenderData& data, uint32_t image_index, const MandelParams& params, bool recolor) {
+	VkCommandBuffer cmd = data.command_buffers[data.current_frame];
+	uint32_t frame = (uint32_t) data.current_frame;
+	init.disp.resetCommandBuffer(cmd, 0);
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	if (init.disp.beginCommandBuffer(cmd, &begin_info) != VK_SUCCESS) {
+		return -1; // failed to begin recording command buffer
+	}
 
-	init.disp.destroyCommandPool(data.command_pool, nullptr);
+	record_profiler_begin(init, data.profiler, cmd, frame, frame);
 
-	for (auto framebuffer : data.framebuffers) {
-		init.disp.destroyFramebuffer(framebuffer, nullptr);
+	if (data.engine == ENGINE_FRAGMENT) {
+		// the iteration cap and palette are baked into the pipeline, so changing either picks another variant,
+		// built the first time it is needed
+		VkPipeline pipeline = graphics_variant(init, data, fragment_variant(data));
+		if (pipeline == VK_NULL_HANDLE)
+			return -1;
+		record_fragment(init, data, cmd, pipeline, data.descriptorSets[frame], data.swapchain_images[image_index],
+			data.swapchain_image_views[image_index], init.swapchain.extent, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	} else {
+		bool iterate = !recolor;
+		VkDescriptorSet set = data.compute.descriptor_sets[frame];
+		if (data.compute.progressive_budget > 0) {
+			if (!recolor)
+				data.progress = 0;
+			iterate = data.progress < data.max_iterations;
+			if (iterate) {
+				record_progressive(init, data.compute, cmd, set, data.precision, data.progress == 0);
+				data.progress += std::min(data.compute.progressive_budget, data.max_iterations - data.progress);
+			}
+		} else if (iterate && data.hybrid.enabled) {
+			// hybrid_iterate has already submitted the GPU's rows and done the cpu's
+			record_hybrid_upload(init, data.hybrid, data.compute, cmd, frame);
+		} else if (iterate && data.tile_cache.capacity > 0 && cache_covers(params)) {
+			if (0 != record_cached_view(init, data.tile_cache, data.compute, cmd, frame, params, data.precision_mode))
+				return -1;
+		} else if (iterate) {
+			record_compute(init, data.compute, cmd, set, data.precision);
+		}
+		record_colorize(init, data.colorizer, data.compute, cmd, frame, iterate && data.color.equalize);
+		record_compute_blit(init, data.compute, cmd, data.swapchain_images[image_index], init.swapchain.extent, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 	}
 
-	init.swapchain.destroy_image_views(data.swapchain_image_views);
+	record_profiler_end(init, data.profiler, cmd, frame, frame);
 
-	if (0 != create_swapchain(init)) return -1;
-	if (0 != create_framebuffers(init, data)) return -1;
-	if (0 != create_command_pool(init, data)) return -1;
-	if (0 != create_command_buffers(init, data)) return -1;
+	if (init.disp.endCommandBuffer(cmd) != VK_SUCCESS) {
+		std::cout << "failed to record command buffer\n";
+		return -1; // failed to record command buffer!
+	}
 	return 0;
 }
 
+// progressive mode keeps drawing while the view stays still, until every pixel is done
+static bool refining(const RenderData& data) {
+	return data.compute.progressive_budget > 0 && data.progress < data.max_iterations;
+}
+
+static void latch_input(Init& init, RenderData& data, FrameSample& frame);
+
+static bool same_view(const MandelParams& a, const MandelParams& b) {
+	return memcmp(a.edges, b.edges, sizeof(a.edges)) == 0 &&
+		a.extent[0] == b.extent[0] && a.extent[1] == b.extent[1] &&
+		a.max_iterations == b.max_iterations;
+}
+
 int draw_frame(Init& init, RenderData& data) {
-	init.disp.waitForFences(1, &data.in_flight_fences[data.current_frame], VK_TRUE, UINT64_MAX);
+	FrameSample frame = {};
+	double since = profiler_now(data.profiler);
+
+	// the only wait on the host: for the submission that last used this frame's command buffer, uniform
+	// buffer and descriptor sets. Whichever frame last drew to the acquired image is ordered by the acquire
+	// semaphore on the GPU instead.
+	wait_for_frame(init, data, data.frame_values[data.current_frame]);
+	profiler_phase(data.profiler, frame, PHASE_FRAME_WAIT, since);
+
+	if (!data.retired.empty()) {
+		uint64_t done = 0;
+		init.disp.getSemaphoreCounterValue(data.frame_timeline, &done);
+		release_retired(init, data, done);
+	}
 
 	uint32_t image_index = 0;
 	VkResult result = init.disp.acquireNextImageKHR(
 		init.swapchain, UINT64_MAX, data.available_semaphores[data.current_frame], VK_NULL_HANDLE, &image_index);
+	profiler_phase(data.profiler, frame, PHASE_ACQUIRE, since);
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 		return recreate_swapchain(init, data);
@@ -649,42 +854,101 @@ int draw_frame(Init& init, RenderData& data) {
 		std::cout << "failed to acquire swapchain image. Error " << result << "\n";
 		return -1;
 	}
-
-	if (data.image_in_flight[image_index] != VK_NULL_HANDLE) {
-		init.disp.waitForFences(1, &data.image_in_flight[image_index], VK_TRUE, UINT64_MAX);
+	// both waits are behind us, so whatever input arrived during them goes into this frame rather than the next
+	latch_input(init, data, frame);
+
+	MandelParams params;
+	fill_params(params, edgeData, init.swapchain.extent.width, init.swapchain.extent.height, data.max_iterations);
+	apply_color(params, data.color);
+	params.escape_radius2 = data.constants.escape_radius2;
+	if (data.early_out)
+		params.flags |= MANDEL_FLAG_EARLY_OUT;
+	// shader.frag may only write buffers with fragmentStoresAndAtomics
+	if (data.engine == ENGINE_COMPUTE || init.fragment_atomics)
+		params.work_counter = profiler_counter_address(data.profiler, (uint32_t) data.current_frame);
+	memcpy(uniform_mapped(data.uniforms, data.current_frame), &params, sizeof(params));
+
+	// the tile cache picks a tier per zoom level itself
+	if (data.tile_cache.capacity == 0) {
+		Precision precision = pick_precision(params, data.precision_mode, init.shader_float64);
+		if (precision != data.precision) {
+			printf("switching to %s precision\n", precision_name(precision));
+			data.precision = precision;
+		}
+	}
+	// a full frame after toggling equalisation, so the histogram gets built
+	if (data.color.equalize != data.recorded_equalize) {
+		data.recorded_equalize = data.color.equalize;
+		data.iterated = false;
 	}
-	data.image_in_flight[image_index] = data.in_flight_fences[data.current_frame];
-
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-	VkSemaphore wait_semaphores[] = { data.available_semaphores[data.current_frame] };
-	VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = wait_semaphores;
-	submitInfo.pWaitDstStageMask = wait_stages;
-
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &data.command_buffers[image_index];
-
-	VkSemaphore signal_semaphores[] = { data.finished_semaphore[data.current_frame] };
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signal_semaphores;
-
-	init.disp.resetFences(1, &data.in_flight_fences[data.current_frame]);
 
-	memcpy(data.buffersMapped[data.current_frame], &edgeData, sizeof(edgeData));
+	// palette changes and colour cycling leave the iteration counts as they are
+	bool recolor = data.engine == ENGINE_COMPUTE && data.iterated && same_view(params, data.iterated_params);
+	// except that subdivision only fills flat bands when not smoothing, and toggling the early outs is for
+	// timing them
+	if (data.compute.subdivide && ((params.flags ^ data.iterated_params.flags) & MANDEL_FLAG_SMOOTH))
+		recolor = false;
+	if ((params.flags ^ data.iterated_params.flags) & MANDEL_FLAG_EARLY_OUT)
+		recolor = false;
+	// the profiler counts this as recording, since the frame's command buffer needs the cpu's rows
+	if (data.hybrid.enabled && !recolor && 0 != hybrid_iterate(init, data, data.current_frame, params))
+		return -1;
+	if (0 != record_frame(init, data, image_index, params, recolor))
+		return -1;
+	data.iterated = true;
+	data.iterated_params = params;
+
+	// the wait above covered this slot's last frame, which this one is about to reset the queries of
+	profiler_collect(init, data.profiler, (uint32_t) data.current_frame);
+	frame.pixels = (uint64_t) init.swapchain.extent.width * init.swapchain.extent.height;
+	profiler_phase(data.profiler, frame, PHASE_RECORD, since);
+
+	// the compute engine first touches the swapchain image in its blit
+	VkSemaphoreSubmitInfo wait_semaphore = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+		.semaphore = data.available_semaphores[data.current_frame],
+		.stageMask = data.engine == ENGINE_COMPUTE ? VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT : VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+	};
+	uint64_t frame_value = ++data.frame_count;
+	VkSemaphoreSubmitInfo signal_semaphores[] = {
+		{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+			.semaphore = data.frame_timeline,
+			.value = frame_value,
+			.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+			.semaphore = data.finished_semaphores[image_index],
+			.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+		},
+	};
+	VkCommandBufferSubmitInfo command_buffer_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+		.commandBuffer = data.command_buffers[data.current_frame],
+	};
+	VkSubmitInfo2 submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+		.waitSemaphoreInfoCount = 1,
+		.pWaitSemaphoreInfos = &wait_semaphore,
+		.commandBufferInfoCount = 1,
+		.pCommandBufferInfos = &command_buffer_info,
+		.signalSemaphoreInfoCount = 2,
+		.pSignalSemaphoreInfos = signal_semaphores,
+	};
 
-	if (init.disp.queueSubmit(data.graphics_queue, 1, &submitInfo, data.in_flight_fences[data.current_frame]) != VK_SUCCESS) {
+	if (init.disp.queueSubmit2(data.graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
 		std::cout << "failed to submit draw command buffer\n";
 		return -1; //"failed to submit draw command buffer
 	}
+	data.frame_values[data.current_frame] = frame_value;
+	profiler_phase(data.profiler, frame, PHASE_SUBMIT, since);
 
 	VkPresentInfoKHR present_info = {};
 	present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
 	present_info.waitSemaphoreCount = 1;
-	present_info.pWaitSemaphores = signal_semaphores;
+	present_info.pWaitSemaphores = &data.finished_semaphores[image_index];
 
 	VkSwapchainKHR swapChains[] = { init.swapchain };
 	present_info.swapchainCount = 1;
@@ -692,7 +956,22 @@ int draw_frame(Init& init, RenderData& data) {
 
 	present_info.pImageIndices = &image_index;
 
+	// the image was acquired again, so its last present is done with the semaphore, and its fence is due
+	VkSwapchainPresentFenceInfoEXT present_fence = {
+		.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT,
+		.swapchainCount = 1,
+	};
+	if (!data.present_fences.empty()) {
+		VkFence& fence = data.present_fences[image_index];
+		init.disp.waitForFences(1, &fence, VK_TRUE, UINT64_MAX);
+		init.disp.resetFences(1, &fence);
+		present_fence.pFences = &fence;
+		present_info.pNext = &present_fence;
+	}
+
 	result = init.disp.queuePresentKHR(data.present_queue, &present_info);
+	profiler_phase(data.profiler, frame, PHASE_PRESENT, since);
+	profiler_submitted(data.profiler, (uint32_t) data.current_frame, frame);
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
 		return recreate_swapchain(init, data);
 	} else if (result != VK_SUCCESS) {
@@ -705,28 +984,32 @@ int draw_frame(Init& init, RenderData& data) {
 }
 
 void cleanup(Init& init, RenderData& data) {
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		init.disp.destroySemaphore(data.finished_semaphore[i], nullptr);
-		init.disp.destroySemaphore(data.available_semaphores[i], nullptr);
-		init.disp.destroyFence(data.in_flight_fences[i], nullptr);
-	}
+	// headless runs never create the per-frame sync objects
+	for (auto semaphore : data.available_semaphores)
+		init.disp.destroySemaphore(semaphore, nullptr);
+	destroy_present_semaphores(init, data, data.finished_semaphores, data.present_fences);
+	init.disp.destroySemaphore(data.frame_timeline, nullptr);
 
 	init.disp.destroyCommandPool(data.command_pool, nullptr);
 
-	for (auto framebuffer : data.framebuffers) {
-		init.disp.destroyFramebuffer(framebuffer, nullptr);
-	}
-
-	init.disp.destroyPipeline(data.graphics_pipeline, nullptr);
+	destroy_profiler(init, data.profiler);
+	destroy_deep_pipeline(init, data.deep);
+	destroy_tile_cache(init, data.tile_cache);
+	destroy_hybrid(init, data.hybrid);
+	destroy_colorizer(init, data.colorizer);
+	destroy_compute_pipeline(init, data.compute);
+
+	for (auto& variant : data.graphics_variants)
+		init.disp.destroyPipeline(variant.second, nullptr);
+	init.disp.destroyShaderModule(data.vert_module, nullptr);
+	for (auto module : data.frag_modules)
+		init.disp.destroyShaderModule(module, nullptr);
 	init.disp.destroyPipelineLayout(data.pipeline_layout, nullptr);
-	init.disp.destroyRenderPass(data.render_pass, nullptr);
 
+	release_retired(init, data, UINT64_MAX);
 	init.swapchain.destroy_image_views(data.swapchain_image_views);
 
-	for (auto b : data.buffers)
-		vkDestroyBuffer(init.device, b, nullptr);
-	for (auto m : data.buffersMemory)
-		vkFreeMemory(init.device, m, nullptr);
+	destroy_uniform_ring(init, data.uniforms);
 
 	// apparently the descriptor pool will free them for us
 	// vkFreeDescriptorSets(init.device, data.descriptorPool, data.descriptorSets.size(), data.descriptorSets.data());
@@ -735,11 +1018,15 @@ void cleanup(Init& init, RenderData& data) {
 
 	vkDestroyDescriptorSetLayout(init.device, data.setLayout, nullptr);
 
+	destroy_pipeline_cache(init);
 	vkb::destroy_swapchain(init.swapchain);
+	destroy_allocator(init);
 	vkb::destroy_device(init.device);
-	vkb::destroy_surface(init.instance, init.surface);
+	if (init.surface != VK_NULL_HANDLE)
+		vkb::destroy_surface(init.instance, init.surface);
 	vkb::destroy_instance(init.instance);
-	destroy_window_glfw(init.window);
+	if (init.window != nullptr)
+		destroy_window_glfw(init.window);
 }
 
 Init init;
@@ -754,6 +1041,36 @@ double mousePos[2] = {};
 double mousePoint[2] = {};
 double mouseGrabPoint[2] = {};
 
+// from a callback, when what's on screen has to change. Events only get handled between frames, so any
+// number of them coalesce into the next one.
+static void input_changed() {
+	render_data.redraw = true;
+	profiler_input(render_data.profiler);
+}
+
+// the view as of the latest input, taken as late as draw_frame can
+static void latch_input(Init& init, RenderData& data, FrameSample& frame) {
+	glfwPollEvents();
+	data.redraw = false;
+	profiler_latch(data.profiler, frame);
+
+	{
+		edgeData[0] = center[0] - perpixel * init.swapchain.extent.width / zoom;
+		edgeData[1] = center[1] - perpixel * init.swapchain.extent.height / zoom;
+		edgeData[2] = center[0] + perpixel * init.swapchain.extent.width / zoom;
+		edgeData[3] = center[1] + perpixel * init.swapchain.extent.height / zoom;
+	}
+
+	if (0) {
+		center[0] -= 0.001f;
+		zoom *= 1.001f;
+		edgeData[0] = center[0] - 2.0f/zoom;
+		edgeData[1] = center[1] - 2.0f/zoom;
+		edgeData[2] = center[0] + 2.0f/zoom;
+		edgeData[3] = center[1] + 2.0f/zoom;
+	}
+}
+
 static inline double dmap(double oldmin, double oldmax, double newmin, double newmax, double value) {
 	return (value - oldmin) * (newmax - newmin) / (oldmax - oldmin) + newmin;
 }
@@ -771,6 +1088,7 @@ static void cursor_position_callback(GLFWwindow* window, double xpos, double ypo
 	if (mouseDrag) {
 		center[0] += (mouseGrabPoint[0] - mousePoint[0]);
 		center[1] += (mouseGrabPoint[1] - mousePoint[1]);
+		input_changed();
 
 		// std::cout << "\t\t" << newMousePoint[0] << "," << newMousePoint[1] << " should equal " << mouseGrabPoint[0] << "," << mouseGrabPoint[1] << "; distance = " << (mouseGrabPoint[0] - newMousePoint[0]) << "," << (mouseGrabPoint[1] - newMousePoint[1]) << std::endl;
 	}
@@ -811,56 +1129,267 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 	// std::cout << "Scroll " << xoffset << "," << yoffset << std::endl;
 	if (yoffset != 0) {
 		zoom *= 1 + (yoffset * 0.1);
+		input_changed();
 	}
 
 	// std::cout << "Zoom is now " << zoom << std::endl;
 }
 
-int main() {
-	if (0 != device_initialization(init)) return -1;
+// what + and - can take the iteration cap to
+const uint32_t MIN_WINDOW_ITERATIONS = 16;
+const uint32_t MAX_WINDOW_ITERATIONS = 1 << 24;
+
+// where the window was before going fullscreen: x, y, width, height
+int windowedRect[4];
+
+static void toggle_fullscreen(GLFWwindow* window)
+{
+	if (glfwGetWindowMonitor(window) != nullptr) {
+		glfwSetWindowMonitor(window, nullptr, windowedRect[0], windowedRect[1], windowedRect[2], windowedRect[3], GLFW_DONT_CARE);
+		return;
+	}
+	glfwGetWindowPos(window, &windowedRect[0], &windowedRect[1]);
+	glfwGetWindowSize(window, &windowedRect[2], &windowedRect[3]);
+	GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+	const GLFWvidmode* mode = glfwGetVideoMode(monitor);
+	glfwSetWindowMonitor(window, monitor, 0, 0, mode->width, mode->height, mode->refreshRate);
+}
+
+// colour controls, which never iterate the compute engine's fractal again, plus the iteration cap and fullscreen
+static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	if (action != GLFW_PRESS)
+		return;
+
+	// the compute engine's histogram has one bin per count, sized for --iterations
+	uint32_t most_iterations = render_data.engine == ENGINE_FRAGMENT ? MAX_WINDOW_ITERATIONS : render_data.colorizer.bins;
+
+	ColorSettings& color = render_data.color;
+	switch (key) {
+		case GLFW_KEY_P:
+			color.palette = (color.palette + 1) % PALETTE_COUNT;
+			printf("palette %s\n", palette_name(color.palette));
+			break;
+		case GLFW_KEY_C:
+			color.cycle = !color.cycle;
+			break;
+		case GLFW_KEY_E:
+			color.equalize = !color.equalize;
+			break;
+		case GLFW_KEY_S:
+			color.smooth = !color.smooth;
+			break;
+		case GLFW_KEY_EQUAL:
+			if (render_data.max_iterations <= most_iterations / 2)
+				render_data.max_iterations *= 2;
+			else
+				render_data.max_iterations = std::max(render_data.max_iterations, most_iterations);
+			printf("%u iterations\n", render_data.max_iterations);
+			break;
+		case GLFW_KEY_MINUS:
+			render_data.max_iterations = std::max(render_data.max_iterations / 2, MIN_WINDOW_ITERATIONS);
+			printf("%u iterations\n", render_data.max_iterations);
+			break;
+		case GLFW_KEY_I:
+			render_data.early_out = !render_data.early_out;
+			printf("early out %s\n", render_data.early_out ? "on" : "off");
+			break;
+		case GLFW_KEY_F:
+			toggle_fullscreen(window);
+			break;
+		default:
+			return;
+	}
+	input_changed();
+}
+
+// exposes and resizes
+static void window_refresh_callback(GLFWwindow* window)
+{
+	render_data.redraw = true;
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if (0 != parse_options(argc, argv, options)) return -1;
+	// the coordinator only hands out tiles, the workers render them
+	if (!options.farm.empty())
+		return run_farm(options, argc, argv);
+	// a video on stdout needs it to itself, so everything printed from here on goes to stderr
+	if (!options.keyframes.empty() && options.output == "-")
+		claim_stdout();
+
+	// the cpu engine is for machines without a usable GPU, so it must not depend on Vulkan initialising
+	BenchReport bench;
+	if (options.bench && 0 != bench_cpu(options, bench)) return -1;
+	if (options.engine == ENGINE_CPU) {
+		if (options.poster)
+			return run_poster_cpu(options);
+		if (!options.worker.empty())
+			return run_farm_worker_cpu(options);
+		if (!options.keyframes.empty())
+			return run_animation_cpu(options);
+		return options.bench ? write_bench(bench, options) : run_headless_cpu(options);
+	}
+
+	PhaseTimer startup;
+	timer_start(startup);
+
+	if (0 != device_initialization(init, options, startup)) {
+		// CPU-only nodes still report the cpu engine
+		if (options.bench && options.engine == ENGINE_AUTO) {
+			std::cout << "no usable GPU, the report only has the cpu engine\n";
+			return write_bench(bench, options);
+		}
+		return -1;
+	}
+	if (0 != load_pipeline_cache(init, options.pipeline_cache)) return -1;
+	timer_mark(startup, "pipeline cache");
+	render_data.max_iterations = options.max_iterations;
+	render_data.precision_mode = options.precision;
+	// a tier every device has pipelines for; the first frame picks the real one
+	render_data.precision = init.shader_float64 ? PRECISION_F64 : PRECISION_DS;
+	render_data.color = options.color;
+	render_data.early_out = options.early_out;
+	init.present_mode = vk_present_mode(options.present_mode);
+	render_data.constants = kernel_constants(options);
+
+	if (options.headless) {
+		if (0 != get_queues(init, render_data)) return -1;
+		render_data.color_format = OFFSCREEN_FORMAT;
+		if (0 != create_transfer_buffers(init, render_data)) return -1;
+		if (0 != create_graphics_pipeline(init, render_data)) return -1;
+		if (0 != create_compute_pipeline(init, render_data.compute, options, render_data.uniforms)) return -1;
+		timer_mark(startup, "pipelines");
+		// posters and farm workers render a tile at a time
+		VkExtent2D extent = { options.width, options.height };
+		if (options.poster)
+			extent = poster_tile_extent(init, options);
+		else if (!options.worker.empty())
+			extent = { FARM_TILE, FARM_TILE };
+		if (0 != create_compute_targets(init, render_data.compute, extent)) return -1;
+		if (0 != create_colorizer(init, render_data.colorizer, options, render_data.compute, render_data.uniforms)) return -1;
+		bind_colorizer_targets(init, render_data.colorizer, render_data.compute);
+		// animations zoom through the same regions frame after frame, which the compute engine draws from the tile cache
+		if (!options.keyframes.empty() && options.engine != ENGINE_FRAGMENT) {
+			if (0 != create_tile_cache(init, render_data.tile_cache, options, render_data.compute, render_data.uniforms)) return -1;
+			if (0 != bind_tile_cache_targets(init, render_data.tile_cache, render_data.compute)) return -1;
+		}
+		if (options.engine == ENGINE_DEEP && 0 != create_deep_pipeline(init, render_data.deep, options, render_data.compute)) return -1;
+		if (0 != create_command_pool(init, render_data)) return -1;
+		if (0 != upload_palettes(init, render_data, render_data.colorizer)) return -1;
+		timer_mark(startup, "targets");
+		timer_report(startup, "startup");
+		if (options.memory)
+			report_memory(init, "startup");
+
+		int res;
+		if (options.bench)
+			res = bench_gpu(init, render_data, options, bench);
+		else if (options.poster)
+			res = run_poster(init, render_data, options);
+		else if (!options.worker.empty())
+			res = run_farm_worker(init, render_data, options);
+		else if (!options.keyframes.empty())
+			res = run_animation(init, render_data, options);
+		else
+			res = run_headless(init, render_data, options);
+		if (res == 0 && options.bench)
+			res = write_bench(bench, options);
+		init.disp.deviceWaitIdle();
+		if (options.memory)
+			report_memory(init, "exit");
+		save_pipeline_cache(init, options.pipeline_cache);
+
+		cleanup(init, render_data);
+		return res;
+	}
+
 	if (0 != create_swapchain(init)) return -1;
+	timer_mark(startup, "swapchain");
 	if (0 != get_queues(init, render_data)) return -1;
-	if (0 != create_render_pass(init, render_data)) return -1;
+	render_data.color_format = init.swapchain.image_format;
 	if (0 != create_transfer_buffers(init, render_data)) return -1;
 	if (0 != create_graphics_pipeline(init, render_data)) return -1;
-	if (0 != create_framebuffers(init, render_data)) return -1;
+	if (0 != create_compute_pipeline(init, render_data.compute, options, render_data.uniforms)) return -1;
+	timer_mark(startup, "pipelines");
+	if (0 != create_compute_targets(init, render_data.compute, init.swapchain.extent)) return -1;
+	if (0 != create_colorizer(init, render_data.colorizer, options, render_data.compute, render_data.uniforms)) return -1;
+	bind_colorizer_targets(init, render_data.colorizer, render_data.compute);
+	if (0 != get_swapchain_images(init, render_data)) return -1;
 	if (0 != create_command_pool(init, render_data)) return -1;
+	if (0 != upload_palettes(init, render_data, render_data.colorizer)) return -1;
+	timer_mark(startup, "targets");
+
+	render_data.engine = options.engine;
+	if (render_data.engine == ENGINE_AUTO) {
+		// probe in the swapchain's format, so the fragment engine's pipelines carry over
+		render_data.engine = pick_engine(init, render_data, init.swapchain.image_format, init.swapchain.extent, edgeData);
+		timer_mark(startup, "engine probe");
+	}
+
+	// progressive passes keep per-pixel state for one view, which tiles have no room for, and subdivision
+	// wants whole squares of the view; hybrid frames iterate every row, some of them on the cpu
+	if (render_data.engine == ENGINE_COMPUTE && options.progressive == 0 && !options.subdivide && !options.hybrid) {
+		if (0 != create_tile_cache(init, render_data.tile_cache, options, render_data.compute, render_data.uniforms)) return -1;
+		if (0 != bind_tile_cache_targets(init, render_data.tile_cache, render_data.compute)) return -1;
+	}
+
+	if (0 != create_profiler(init, render_data.profiler, options, MAX_FRAMES_IN_FLIGHT)) return -1;
 	if (0 != create_command_buffers(init, render_data)) return -1;
+	if (0 != create_hybrid(init, render_data, options)) return -1;
 	if (0 != create_sync_objects(init, render_data)) return -1;
+	timer_mark(startup, "command buffers");
 
 	glfwSetCursorPosCallback(init.window, cursor_position_callback);
 	glfwSetCursorEnterCallback(init.window, cursor_enter_callback);
 	glfwSetMouseButtonCallback(init.window, mouse_button_callback);
 	glfwSetScrollCallback(init.window, scroll_callback);
+	glfwSetKeyCallback(init.window, key_callback);
+	glfwSetWindowRefreshCallback(init.window, window_refresh_callback);
 
+	bool started = false;
 	while (!glfwWindowShouldClose(init.window)) {
-		glfwWaitEvents();
-
-		{
-			edgeData[0] = center[0] - perpixel * init.swapchain.extent.width / zoom;
-			edgeData[1] = center[1] - perpixel * init.swapchain.extent.height / zoom;
-			edgeData[2] = center[0] + perpixel * init.swapchain.extent.width / zoom;
-			edgeData[3] = center[1] + perpixel * init.swapchain.extent.height / zoom;
-		}
-
-		printf("Center: %1.17f,%1.17f, size: %1.17fx%1.17f\n", center[0], center[1], edgeData[2] - edgeData[0], edgeData[3] - edgeData[1]);
-
-		if (0) {
-			center[0] -= 0.001f;
-			zoom *= 1.001f;
-			edgeData[0] = center[0] - 2.0f/zoom;
-			edgeData[1] = center[1] - 2.0f/zoom;
-			edgeData[2] = center[0] + 2.0f/zoom;
-			edgeData[3] = center[1] + 2.0f/zoom;
+		// cycling and refining draw every frame, paced by the present mode. Otherwise sleep until something
+		// needs drawing, and then draw once however many events it took; draw_frame picks up the rest.
+		bool animating = render_data.color.cycle || refining(render_data);
+		if (!animating && !render_data.redraw) {
+			glfwWaitEvents();
+			continue;
 		}
+		if (render_data.color.cycle)
+			render_data.color.offset = fmodf(render_data.color.offset + 0.002f, 1.0f);
 
 		int res = draw_frame(init, render_data);
 		if (res != 0) {
 			std::cout << "failed to draw frame \n";
 			return -1;
 		}
+		report_profiler(render_data.profiler);
+		// up to the first submitted frame, which is where the fragment engine's first variant gets built
+		if (!started) {
+			timer_mark(startup, "first frame");
+			timer_report(startup, "startup");
+			if (options.memory)
+				report_memory(init, "startup");
+			started = true;
+		}
 	}
 	init.disp.deviceWaitIdle();
+	report_hybrid(render_data.hybrid);
+	if (!render_data.tile_cache.store.dir.empty()) {
+		flush_tile_store(init, render_data.tile_cache);
+		printf("tile store: %llu tiles loaded, %llu saved, %zu left unsaved\n", (unsigned long long) render_data.tile_cache.store.loads,
+			(unsigned long long) render_data.tile_cache.store.saves, render_data.tile_cache.store_backlog.size());
+	}
+	if (options.memory)
+		report_memory(init, "exit");
+	save_pipeline_cache(init, options.pipeline_cache);
+	if (!render_data.profiler.trace_path.empty()) {
+		for (uint32_t slot = 0; slot < PROFILER_SLOTS; slot++)
+			profiler_collect(init, render_data.profiler, slot);
+		write_trace(render_data.profiler, render_data.profiler.trace_path);
+	}
 
 	cleanup(init, render_data);
 	return 0;
@@ -0,0 +1,210 @@
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "mandel.h"
+
+const char* precision_name(Precision precision) {
+	switch (precision) {
+		case PRECISION_F32:  return "f32";
+		case PRECISION_DS:   return "ds";
+		case PRECISION_F64:  return "f64";
+		case PRECISION_AUTO: return "auto";
+	}
+	return "unknown";
+}
+
+static void split_double(double value, float* pair) {
+	pair[0] = (float) value;
+	pair[1] = (float) (value - pair[0]);
+}
+
+void fill_params(MandelParams& params, const double edges[4], uint32_t width, uint32_t height, uint32_t max_iterations) {
+	for (int i = 0; i < 4; i++)
+		params.edges[i] = edges[i];
+	params.step[0] = (edges[2] - edges[0]) / width;
+	params.step[1] = (edges[3] - edges[1]) / height;
+	params.extent[0] = width;
+	params.extent[1] = height;
+	params.max_iterations = max_iterations;
+	params.flags = 0;
+	params.palette = PALETTE_CLASSIC;
+	params.palette_offset = 0;
+	params.palette_scale = 1;
+	params.escape_radius2 = DEFAULT_ESCAPE_RADIUS * DEFAULT_ESCAPE_RADIUS;
+	params.work_counter = 0;
+	split_double(params.edges[0], &params.origin_ds[0]);
+	split_double(params.edges[1], &params.origin_ds[2]);
+	split_double(params.step[0], &params.step_ds[0]);
+	split_double(params.step[1], &params.step_ds[2]);
+}
+
+int precision_bits(Precision precision) {
+	switch (precision) {
+		case PRECISION_F32: return 24;
+		case PRECISION_DS:  return 48;
+		default:            return 53;
+	}
+}
+
+// headroom over the bits that tell neighbouring pixels apart, for the rounding error a long orbit amplifies
+static const int PRECISION_GUARD_BITS = 8;
+
+int precision_bits_needed(const MandelParams& params) {
+	double magnitude = 0;
+	for (int i = 0; i < 4; i++)
+		magnitude = std::max(magnitude, fabs(params.edges[i]));
+	double step = std::min(fabs(params.step[0]), fabs(params.step[1]));
+	return std::max(0, (int) ceil(log2(magnitude / step))) + PRECISION_GUARD_BITS;
+}
+
+// on consumer GPUs fp64 runs at 1/32 to 1/64 of the fp32 rate, while double-single costs roughly ten
+// to twenty fp32 operations per multiply, hence the order
+Precision pick_precision(const MandelParams& params, Precision mode, bool has_float64) {
+	if (mode != PRECISION_AUTO)
+		return mode;
+
+	int needed = precision_bits_needed(params);
+	if (needed <= precision_bits(PRECISION_F32))
+		return PRECISION_F32;
+	if (needed <= precision_bits(PRECISION_DS) || !has_float64)
+		return PRECISION_DS;
+	return PRECISION_F64;
+}
+
+const char* palette_name(uint32_t palette) {
+	switch (palette) {
+		case PALETTE_CLASSIC: return "classic";
+		case PALETTE_FIRE:    return "fire";
+		case PALETTE_RAINBOW: return "rainbow";
+		case PALETTE_GREY:    return "grey";
+	}
+	return "unknown";
+}
+
+int parse_palette(const char* name, uint32_t& palette) {
+	for (uint32_t p = 0; p < PALETTE_COUNT; p++) {
+		if (strcmp(name, palette_name(p)) == 0) {
+			palette = p;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static uint8_t unorm8(float c) {
+	return (uint8_t) lrintf(std::clamp(c, 0.0f, 1.0f) * 255.0f);
+}
+
+// linear RGB at position u along a palette; fragmentPalette in mandel.glsl has the same curves
+static void palette_color(uint32_t palette, float u, float c[3]) {
+	switch (palette) {
+		case PALETTE_FIRE:
+			c[0] = 3.0f * u;
+			c[1] = 3.0f * u - 1.0f;
+			c[2] = 3.0f * u - 2.0f;
+			break;
+		case PALETTE_RAINBOW:
+			// cosine palette; periodic, so it cycles without a seam
+			for (int k = 0; k < 3; k++)
+				c[k] = 0.5f + 0.5f * cosf(2.0f * (float) M_PI * (u + 0.1f * k));
+			break;
+		case PALETTE_GREY:
+			c[0] = c[1] = c[2] = u;
+			break;
+		default:
+			// the fragment engine's curves
+			c[0] = powf(u, 3.0f);
+			c[1] = (u - powf(u * 0.9f, 3.0f) - powf(u * 0.88f, 10.0f)) * 0.75f;
+			c[2] = (powf(u, 1.0f / 2) - powf(u, 3.0f) - powf(u, 10.0f)) * 0.5f;
+			break;
+	}
+}
+
+void fill_palette_lut(uint32_t palette, uint32_t width, uint8_t* rgba) {
+	for (uint32_t i = 0; i < width; i++) {
+		float c[3];
+		palette_color(palette, ((float) i + 0.5f) / width, c);
+		for (int k = 0; k < 3; k++)
+			rgba[i * 4 + k] = unorm8(c[k]);
+		rgba[i * 4 + 3] = 255;
+	}
+}
+
+void apply_color(MandelParams& params, const ColorSettings& color) {
+	params.flags &= ~(MANDEL_FLAG_EQUALIZE | MANDEL_FLAG_SMOOTH);
+	if (color.equalize)
+		params.flags |= MANDEL_FLAG_EQUALIZE;
+	if (color.smooth)
+		params.flags |= MANDEL_FLAG_SMOOTH;
+	params.palette = color.palette;
+	params.palette_offset = color.offset;
+	params.palette_scale = color.scale;
+}
+
+bool known_interior(double cx, double cy) {
+	double xq = cx - 0.25;
+	double y2 = cy * cy;
+	double q = (xq * xq) + y2;
+	if ((q * (q + xq)) <= (0.25 * y2))
+		return true;
+	double xb = cx + 1.0;
+	return ((xb * xb) + y2) <= 0.0625;
+}
+
+uint32_t iterate_mandelbrot(double cx, double cy, uint32_t max_iterations, bool early_out) {
+	if (early_out && known_interior(cx, cy))
+		return max_iterations;
+
+	double zr = 0, zi = 0;
+	// Brent: an orbit that lands exactly on the z saved at the last power of two is periodic, and would
+	// never have escaped
+	double saved_r = 0, saved_i = 0;
+	uint32_t window = 1, seen = 0;
+	for (uint32_t i = 0; i < max_iterations; i++) {
+		double re = (zr * zr) - (zi * zi);
+		double im = 2.0 * zr * zi;
+		zr = re + cx;
+		zi = im + cy;
+		if ((zr * zr) + (zi * zi) >= 4.0)
+			return i;
+		if (early_out) {
+			if (zr == saved_r && zi == saved_i)
+				return max_iterations;
+			if (++seen == window) {
+				saved_r = zr;
+				saved_i = zi;
+				seen = 0;
+				window *= 2;
+			}
+		}
+	}
+	return max_iterations;
+}
+
+static uint8_t linear_to_srgb8(float c) {
+	c = std::clamp(c, 0.0f, 1.0f);
+	float s = (c <= 0.0031308f) ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+	return (uint8_t) lrintf(s * 255.0f);
+}
+
+void build_palette(uint32_t max_iterations, uint32_t palette_id, std::vector<uint32_t>& palette) {
+	palette.resize(max_iterations + 1);
+	for (uint32_t n = 0; n <= max_iterations; n++) {
+		// points that never escape come out black
+		float c[3] = { 0, 0, 0 };
+		if (n < max_iterations)
+			palette_color(palette_id, (float) n / max_iterations, c);
+		uint8_t rgba[4] = { linear_to_srgb8(c[0]), linear_to_srgb8(c[1]), linear_to_srgb8(c[2]), 255 };
+		memcpy(&palette[n], rgba, 4);
+	}
+}
+
+void colorize(const uint32_t* iterations, size_t count, const std::vector<uint32_t>& palette, uint8_t* rgba) {
+	uint32_t last = (uint32_t) palette.size() - 1;
+	for (size_t i = 0; i < count; i++) {
+		uint32_t colour = palette[std::min(iterations[i], last)];
+		memcpy(rgba + i * 4, &colour, 4);
+	}
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+const uint32_t DEFAULT_MAX_ITERATIONS = 512;
+const float DEFAULT_ESCAPE_RADIUS = 2;
+
+// arithmetic the fragment and compute shaders iterate in, cheapest first; auto picks the cheapest one
+// that still resolves single pixels of the current view
+enum Precision {
+	PRECISION_F32,
+	// float-float pairs, about 48 bits of mantissa from fp32 hardware
+	PRECISION_DS,
+	PRECISION_F64,
+	PRECISION_AUTO,
+};
+
+const int PRECISION_COUNT = PRECISION_AUTO;
+
+const char* precision_name(Precision precision);
+
+// mirrors the std140 UniformBufferObject block in the shaders
+struct MandelParams {
+	double edges[4];
+	// complex-plane size of one pixel, so every engine maps pixel centres to coordinates the same way
+	double step[2];
+	uint32_t extent[2];
+	uint32_t max_iterations;
+	uint32_t flags;
+	// edges[0], edges[1] and step as hi/lo float pairs (x hi, x lo, y hi, y lo) for the reduced precision shaders
+	float origin_ds[4];
+	float step_ds[4];
+	// colorize.comp's settings, see apply_color
+	uint32_t palette;
+	float palette_offset;
+	float palette_scale;
+	// KernelConstants::escape_radius2, which colorize.comp's smooth shading needs too
+	float escape_radius2;
+	// where the iteration shaders add up the iterations they do, see profiler_counter_address; 0 for not at all
+	uint64_t work_counter;
+};
+
+// mirrors the specialization constants in shaders/include/mandel.glsl, which start at constant_id
+// KERNEL_CONSTANT_ID. A pipeline gets these baked in, so its compiler can fold them into the loop.
+struct KernelConstants {
+	// 0 leaves the cap to MandelParams::max_iterations
+	uint32_t max_iterations;
+	// |z|^2 past which a point has escaped; the cpu engine always uses 4
+	float escape_radius2;
+	// iterations between escape checks
+	uint32_t unroll;
+	// the fragment engine's palette; the compute engine leaves palettes to colorize.comp
+	uint32_t palette;
+
+	bool operator==(const KernelConstants& other) const {
+		return max_iterations == other.max_iterations && escape_radius2 == other.escape_radius2 &&
+			unroll == other.unroll && palette == other.palette;
+	}
+};
+
+const uint32_t KERNEL_CONSTANT_ID = 10;
+
+// MandelParams::flags
+const uint32_t MANDEL_FLAG_EQUALIZE = 1;
+const uint32_t MANDEL_FLAG_SMOOTH = 2;
+// skip the cardioid and period-2 bulb, and stop orbits that cycle; neither changes any escape count
+const uint32_t MANDEL_FLAG_EARLY_OUT = 4;
+
+// palettes colorize.comp can pick from, one row each of the palette texture
+enum Palette {
+	PALETTE_CLASSIC,
+	PALETTE_FIRE,
+	PALETTE_RAINBOW,
+	PALETTE_GREY,
+	PALETTE_COUNT,
+};
+
+const char* palette_name(uint32_t palette);
+// -1 when the name is unknown
+int parse_palette(const char* name, uint32_t& palette);
+
+// linear RGBA8 samples of one palette at texel centres, as width * 4 bytes
+void fill_palette_lut(uint32_t palette, uint32_t width, uint8_t* rgba);
+
+// how the compute engine's iteration counts turn into colours; none of it needs the fractal iterated again
+struct ColorSettings {
+	uint32_t palette = PALETTE_CLASSIC;
+	// position in the palette = offset + scale * (escape count / max iterations, or its histogram rank)
+	float offset = 0;
+	float scale = 1;
+	// spread colours by how many pixels escape at each count rather than by the count itself
+	bool equalize = false;
+	// fractional escape counts from |z| at escape, so bands blend into each other
+	bool smooth = false;
+	// window only: advance the offset every frame
+	bool cycle = false;
+};
+
+void apply_color(MandelParams& params, const ColorSettings& color);
+
+void fill_params(MandelParams& params, const double edges[4], uint32_t width, uint32_t height, uint32_t max_iterations);
+
+// mantissa bits each tier carries, and the bits a view needs to give every pixel its own coordinate
+int precision_bits(Precision precision);
+int precision_bits_needed(const MandelParams& params);
+// the cheapest tier with enough bits, or the most precise one the device has when none are enough
+Precision pick_precision(const MandelParams& params, Precision mode, bool has_float64);
+
+// coordinate of a pixel centre, with the same operation order as mandel.comp
+static inline double pixel_coord(double edge, double step, uint32_t pixel) {
+	return edge + step * ((double) pixel + 0.5);
+}
+
+// Mariani-Silver subdivision, shared by the cpu engine and mandel_subdivide.comp so both pick the same squares:
+// squares this big on a grid from the top left, halved while their border isn't one count, down to this small
+const uint32_t SUBDIVIDE_SIZE = 64;
+const uint32_t SUBDIVIDE_MIN_SIZE = 8;
+
+// inside the main cardioid or the period-2 bulb, so certainly in the set
+bool known_interior(double cx, double cy);
+
+// scalar reference for iterateMandelbrot: the iteration the point escapes on, or max_iterations if it never does.
+// early_out is MANDEL_FLAG_EARLY_OUT.
+uint32_t iterate_mandelbrot(double cx, double cy, uint32_t max_iterations, bool early_out);
+
+// the fragment engine's colour for every iteration count 0..max_iterations, as sRGB-encoded RGBA8 like the
+// offscreen target
+void build_palette(uint32_t max_iterations, uint32_t palette_id, std::vector<uint32_t>& palette);
+void colorize(const uint32_t* iterations, size_t count, const std::vector<uint32_t>& palette, uint8_t* rgba);
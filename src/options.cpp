@@ -0,0 +1,614 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "options.h"
+
+const char* engine_name(Engine engine) {
+	switch (engine) {
+		case ENGINE_FRAGMENT: return "fragment";
+		case ENGINE_COMPUTE:  return "compute";
+		case ENGINE_CPU:      return "cpu";
+		case ENGINE_DEEP:     return "deep";
+		case ENGINE_AUTO:     return "auto";
+	}
+	return "unknown";
+}
+
+static int parse_engine(const char* arg, Engine& engine) {
+	for (Engine e : { ENGINE_FRAGMENT, ENGINE_COMPUTE, ENGINE_CPU, ENGINE_DEEP, ENGINE_AUTO }) {
+		if (strcmp(arg, engine_name(e)) == 0) {
+			engine = e;
+			return 0;
+		}
+	}
+	std::cout << "unknown engine \"" << arg << "\"\n";
+	return -1;
+}
+
+const char* cpu_isa_name(CpuIsa isa) {
+	switch (isa) {
+		case CPU_ISA_SCALAR: return "scalar";
+		case CPU_ISA_AVX2:   return "avx2";
+		case CPU_ISA_AVX512: return "avx512";
+		case CPU_ISA_AUTO:   return "auto";
+	}
+	return "unknown";
+}
+
+static int parse_cpu_isa(const char* arg, CpuIsa& isa) {
+	for (CpuIsa i : { CPU_ISA_SCALAR, CPU_ISA_AVX2, CPU_ISA_AVX512, CPU_ISA_AUTO }) {
+		if (strcmp(arg, cpu_isa_name(i)) == 0) {
+			isa = i;
+			return 0;
+		}
+	}
+	std::cout << "unknown instruction set \"" << arg << "\"\n";
+	return -1;
+}
+
+const char* present_mode_name(PresentMode mode) {
+	switch (mode) {
+		case PRESENT_FIFO:      return "fifo";
+		case PRESENT_MAILBOX:   return "mailbox";
+		case PRESENT_IMMEDIATE: return "immediate";
+	}
+	return "unknown";
+}
+
+static int parse_present_mode(const char* arg, PresentMode& mode) {
+	for (PresentMode m : { PRESENT_FIFO, PRESENT_MAILBOX, PRESENT_IMMEDIATE }) {
+		if (strcmp(arg, present_mode_name(m)) == 0) {
+			mode = m;
+			return 0;
+		}
+	}
+	std::cout << "unknown present mode \"" << arg << "\"\n";
+	return -1;
+}
+
+static int parse_precision(const char* arg, Precision& precision) {
+	for (Precision p : { PRECISION_F32, PRECISION_DS, PRECISION_F64, PRECISION_AUTO }) {
+		if (strcmp(arg, precision_name(p)) == 0) {
+			precision = p;
+			return 0;
+		}
+	}
+	std::cout << "unknown precision \"" << arg << "\"\n";
+	return -1;
+}
+
+static void usage(const char* argv0) {
+	std::cout
+		<< "Usage: " << argv0 << " [options]\n"
+		<< "\n"
+		<< "  --headless            render offscreen without a window or surface\n"
+		<< "  --size WxH            offscreen resolution (default 1024x1024)\n"
+		<< "  --view X,Y,SIZE       add a viewport centered on X,Y that is SIZE wide (repeatable)\n"
+		<< "  --views FILE          add one viewport per line of FILE, as \"X Y SIZE\"\n"
+		<< "  --output PATTERN      output filename, printf-style for the view index (default mandel.png)\n"
+		<< "                        .png writes PNG, anything else writes raw RGBA8\n"
+		<< "  --engine NAME         fragment, compute, cpu, deep, or auto to time both GPU engines and keep the faster\n"
+		<< "                        (default fragment; cpu needs --headless and never touches Vulkan,\n"
+		<< "                        deep zooms past double precision, --headless only, not in the window)\n"
+		<< "  --iterations N        iteration cap (default 512)\n"
+		<< "  --precision NAME      f32, ds (float-float), f64, or auto for the cheapest that resolves every\n"
+		<< "                        pixel of the view (default auto; fragment and compute engines only)\n"
+		<< "  --no-early-out        iterate points in the cardioid and period-2 bulb and orbits that cycle all the\n"
+		<< "                        way to the iteration cap, to measure what skipping them saves\n"
+		<< "  --escape-radius R     bailout radius, 2 or more (default 2; fragment and compute engines only)\n"
+		<< "  --unroll N            iterations between escape checks, 1 to 64 (default 1; fragment and compute\n"
+		<< "                        engines only)\n"
+		<< "  --palette NAME        classic, fire, rainbow or grey (default classic)\n"
+		<< "                        --equalize and --smooth are compute engine only\n"
+		<< "  --equalize            spread the palette by histogram rank instead of by iteration count\n"
+		<< "  --smooth              continuous escape counts instead of bands\n"
+		<< "  --workgroup XxY       compute engine workgroup size (default 16x16)\n"
+		<< "  --tile N              compute engine dispatch tile size in pixels (default 256)\n"
+		<< "  --progressive N       compute engine: advance pixels N iterations per frame and present them as they\n"
+		<< "                        refine, each pass resuming where the last stopped (default off)\n"
+		<< "  --subdivide           cpu and compute engines: only iterate the borders of squares whose border\n"
+		<< "                        escapes on one count, and fill their insides (default off)\n"
+		<< "  --cache-mb N          GPU memory for the window's compute engine tile cache (default 256, 0 turns it off)\n"
+		<< "  --tile-store DIR      keep the tile cache's tiles in files under DIR too, for later runs and other\n"
+		<< "                        processes to load instead of iterating; uses the compute engine\n"
+		<< "  --isa NAME            cpu engine kernels: scalar, avx2, avx512 or auto (default auto)\n"
+		<< "  --threads N           cpu engine worker threads (default one per hardware thread)\n"
+		<< "  --hybrid              window, compute engine: render the bottom rows of each frame on the cpu engine\n"
+		<< "                        alongside the GPU, splitting by how fast each side was on the last frame;\n"
+		<< "                        experimental, its split and seam are unverified on real devices\n"
+		<< "  --poster              headless: render one view at --size, which may be far beyond the device's\n"
+		<< "                        largest image, in tiles and stream it to --output a band of rows at a time\n"
+		<< "  --keyframes FILE      headless zoom animation through \"FRAME X Y SIZE\" lines of FILE, streamed to\n"
+		<< "                        --output (default mandel.y4m) as Y4M, or raw RGBA8 frames; - is stdout\n"
+		<< "                        the compute engine reuses tile cache tiles, the others iterate every frame\n"
+		<< "  --fps N               frame rate in the Y4M header (default 30)\n"
+		<< "  --reproject           with --keyframes and the cpu engine, reuse the frame before's counts where all\n"
+		<< "                        eight neighbours agree; still iterates most pixels, and a few in a million differ\n"
+		<< "  --farm SOCKET         headless: split every view into tiles and hand them to --worker processes over\n"
+		<< "                        the Unix socket SOCKET, most expensive first, and write the images\n"
+		<< "  --spawn ENGINE:N      with --farm, start N local workers on ENGINE (repeatable), eg cpu:1 compute:1\n"
+		<< "  --tile-timeout S      with --farm, hand a tile to another worker once its own has had it S seconds, or\n"
+		<< "                        several times its usual pace for one that costly if longer (default 30)\n"
+		<< "  --worker SOCKET       headless: render tiles for the --farm on SOCKET; --iterations and colours have\n"
+		<< "                        to match the coordinator's\n"
+		<< "  --validate            check the compute engine's iteration counts against the cpu engine\n"
+		<< "  --device NAME         pick the first device whose name contains NAME\n"
+		<< "  --pipeline-cache FILE keep compiled pipelines in FILE between runs (default pipeline_cache.bin,\n"
+		<< "                        \"\" for none)\n"
+		<< "  --no-validation       skip the validation layers, for faster startup\n"
+		<< "  --present MODE        window present mode: fifo, mailbox, or immediate, which may tear (default fifo;\n"
+		<< "                        modes the surface lacks fall back to fifo)\n"
+		<< "  --profile             print frame timings, Mpix/s, Giter/s and input to present latency once a second\n"
+		<< "                        (window only)\n"
+		<< "  --trace FILE          profile, and write the last frames as a Chrome trace to FILE on exit\n"
+		<< "  --memory              print GPU memory use per heap after startup and at exit\n"
+		<< "  --bench               headless benchmark of the named views at 256x256 and 1024x1024 with 256 and\n"
+		<< "                        4096 iterations through every engine, tier and instruction set; --view,\n"
+		<< "                        --size, --iterations, --engine, --precision and --isa narrow it down\n"
+		<< "  --bench-output FILE   where --bench writes its JSON (default bench.json)\n"
+		<< "  --bench-runs N        timed renders per case (default 10)\n"
+		<< "  --help                show this text\n";
+}
+
+static bool parse_double(const std::string& text, double& value) {
+	char* end;
+	value = strtod(text.c_str(), &end);
+	return !text.empty() && *end == '\0';
+}
+
+static int set_view(View& view, const std::string& x, const std::string& y, const std::string& size) {
+	if (!parse_double(x, view.center[0]) || !parse_double(y, view.center[1]) || !parse_double(size, view.size) || !(view.size > 0))
+		return -1;
+	view.center_text[0] = x;
+	view.center_text[1] = y;
+	return 0;
+}
+
+static int parse_view(const char* arg, View& view) {
+	std::istringstream fields(arg);
+	std::string x, y, size;
+	if (!std::getline(fields, x, ',') || !std::getline(fields, y, ',') || !std::getline(fields, size) || 0 != set_view(view, x, y, size)) {
+		std::cout << "bad view \"" << arg << "\", expected X,Y,SIZE\n";
+		return -1;
+	}
+	return 0;
+}
+
+static int read_views(const char* filename, std::vector<View>& views) {
+	std::ifstream file(filename);
+	if (!file.is_open()) {
+		std::cout << "failed to open views file " << filename << "\n";
+		return -1;
+	}
+
+	std::string line;
+	int lineno = 0;
+	while (std::getline(file, line)) {
+		lineno++;
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream fields(line);
+		std::string x, y, size;
+		View view;
+		if (!(fields >> x >> y >> size) || 0 != set_view(view, x, y, size)) {
+			std::cout << filename << ":" << lineno << ": expected \"X Y SIZE\"\n";
+			return -1;
+		}
+		views.push_back(view);
+	}
+	return 0;
+}
+
+// "FRAME X Y SIZE" per line, frames in increasing order
+static int read_keyframes(const char* filename, std::vector<Keyframe>& keyframes) {
+	std::ifstream file(filename);
+	if (!file.is_open()) {
+		std::cout << "failed to open keyframes file " << filename << "\n";
+		return -1;
+	}
+
+	std::string line;
+	int lineno = 0;
+	while (std::getline(file, line)) {
+		lineno++;
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::istringstream fields(line);
+		std::string x, y, size;
+		Keyframe keyframe;
+		if (!(fields >> keyframe.frame >> x >> y >> size) || 0 != set_view(keyframe.view, x, y, size)) {
+			std::cout << filename << ":" << lineno << ": expected \"FRAME X Y SIZE\"\n";
+			return -1;
+		}
+		if (!keyframes.empty() && keyframe.frame <= keyframes.back().frame) {
+			std::cout << filename << ":" << lineno << ": frame " << keyframe.frame << " comes before the keyframe above it\n";
+			return -1;
+		}
+		keyframes.push_back(keyframe);
+	}
+	if (keyframes.empty()) {
+		std::cout << filename << " has no keyframes\n";
+		return -1;
+	}
+	return 0;
+}
+
+int parse_options(int argc, char** argv, Options& options) {
+	// --bench covers everything these weren't set to
+	bool size_set = false;
+	bool iterations_set = false;
+	bool tile_timeout_set = false;
+	bool engine_set = false;
+	// an animation's default output is a video, not a png
+	bool output_set = false;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		// every option except the flags below takes a value
+		bool has_value = (i + 1) < argc;
+
+		if (strcmp(arg, "--help") == 0) {
+			usage(argv[0]);
+			return -1;
+		}
+		else if (strcmp(arg, "--headless") == 0) {
+			options.headless = true;
+		}
+		else if (strcmp(arg, "--size") == 0 && has_value) {
+			if (sscanf(argv[++i], "%ux%u", &options.width, &options.height) != 2 || options.width == 0 || options.height == 0) {
+				std::cout << "bad size \"" << argv[i] << "\", expected WxH\n";
+				return -1;
+			}
+			size_set = true;
+		}
+		else if (strcmp(arg, "--view") == 0 && has_value) {
+			View view;
+			if (0 != parse_view(argv[++i], view)) return -1;
+			options.views.push_back(view);
+		}
+		else if (strcmp(arg, "--views") == 0 && has_value) {
+			if (0 != read_views(argv[++i], options.views)) return -1;
+		}
+		else if (strcmp(arg, "--output") == 0 && has_value) {
+			options.output = argv[++i];
+			output_set = true;
+		}
+		else if (strcmp(arg, "--engine") == 0 && has_value) {
+			if (0 != parse_engine(argv[++i], options.engine)) return -1;
+			engine_set = true;
+		}
+		else if (strcmp(arg, "--iterations") == 0 && has_value) {
+			// the deep engine marks glitched pixels with ~0u
+			if (sscanf(argv[++i], "%u", &options.max_iterations) != 1 || options.max_iterations == 0 || options.max_iterations == 0xFFFFFFFF) {
+				std::cout << "bad iteration count \"" << argv[i] << "\"\n";
+				return -1;
+			}
+			iterations_set = true;
+		}
+		else if (strcmp(arg, "--precision") == 0 && has_value) {
+			if (0 != parse_precision(argv[++i], options.precision)) return -1;
+		}
+		else if (strcmp(arg, "--no-early-out") == 0) {
+			options.early_out = false;
+		}
+		else if (strcmp(arg, "--escape-radius") == 0 && has_value) {
+			// below 2 an escaped orbit can come back inside, which would break the unrolled loop's rollback
+			if (sscanf(argv[++i], "%f", &options.escape_radius) != 1 || !(options.escape_radius >= 2.0f) || !isfinite(options.escape_radius * options.escape_radius)) {
+				std::cout << "bad escape radius \"" << argv[i] << "\", expected 2 or more\n";
+				return -1;
+			}
+		}
+		else if (strcmp(arg, "--unroll") == 0 && has_value) {
+			if (sscanf(argv[++i], "%u", &options.unroll) != 1 || options.unroll == 0 || options.unroll > 64) {
+				std::cout << "bad unroll factor \"" << argv[i] << "\", expected 1 to 64\n";
+				return -1;
+			}
+		}
+		else if (strcmp(arg, "--palette") == 0 && has_value) {
+			if (0 != parse_palette(argv[++i], options.color.palette)) {
+				std::cout << "unknown palette \"" << argv[i] << "\"\n";
+				return -1;
+			}
+		}
+		else if (strcmp(arg, "--equalize") == 0) {
+			options.color.equalize = true;
+		}
+		else if (strcmp(arg, "--smooth") == 0) {
+			options.color.smooth = true;
+		}
+		else if (strcmp(arg, "--workgroup") == 0 && has_value) {
+			if (sscanf(argv[++i], "%ux%u", &options.workgroup[0], &options.workgroup[1]) != 2 || options.workgroup[0] == 0 || options.workgroup[1] == 0) {
+				std::cout << "bad workgroup \"" << argv[i] << "\", expected XxY\n";
+				return -1;
+			}
+		}
+		else if (strcmp(arg, "--tile") == 0 && has_value) {
+			if (sscanf(argv[++i], "%u", &options.tile_size) != 1 || options.tile_size == 0) {
+				std::cout << "bad tile size \"" << argv[i] << "\"\n";
+				return -1;
+			}
+		}
+		else if (strcmp(arg, "--progressive") == 0 && has_value) {
+			if (sscanf(argv[++i], "%u", &options.progressive) != 1 || options.progressive == 0) {
+				std::cout << "bad progressive budget \"" << argv[i] << "\"\n";
+				return -1;
+			}
+		}
+		else if (strcmp(arg, "--subdivide") == 0) {
+			options.subdivide = true;
+		}
+		else if (strcmp(arg, "--hybrid") == 0) {
+			options.hybrid = true;
+		}
+		else if (strcmp(arg, "--cache-mb") == 0 && has_value) {
+			if (sscanf(argv[++i], "%u", &options.cache_mb) != 1) {
+				std::cout << "bad cache size \"" << argv[i] << "\"\n";
+				return -1;
+			}
+		}
+		else if (strcmp(arg, "--tile-store") == 0 && has_value) {
+			options.tile_store = argv[++i];
+		}
+		else if (strcmp(arg, "--isa") == 0 && has_value) {
+			if (0 != parse_cpu_isa(argv[++i], options.cpu_isa)) return -1;
+		}
+		else if (strcmp(arg, "--threads") == 0 && has_value) {
+			if (sscanf(argv[++i], "%u", &options.threads) != 1) {
+				std::cout << "bad thread count \"" << argv[i] << "\"\n";
+				return -1;
+			}
+		}
+		else if (strcmp(arg, "--poster") == 0) {
+			options.poster = true;
+			options.headless = true;
+		}
+		else if (strcmp(arg, "--keyframes") == 0 && has_value) {
+			if (0 != read_keyframes(argv[++i], options.keyframes)) return -1;
+			options.headless = true;
+		}
+		else if (strcmp(arg, "--fps") == 0 && has_value) {
+			if (sscanf(argv[++i], "%u", &options.fps) != 1 || options.fps == 0) {
+				std::cout << "bad frame rate \"" << argv[i] << "\"\n";
+				return -1;
+			}
+		}
+		else if (strcmp(arg, "--reproject") == 0) {
+			options.reproject = true;
+		}
+		else if (strcmp(arg, "--farm") == 0 && has_value) {
+			options.farm = argv[++i];
+			options.headless = true;
+		}
+		else if (strcmp(arg, "--spawn") == 0 && has_value) {
+			const char* value = argv[++i];
+			const char* colon = strchr(value, ':');
+			SpawnWorkers spawn = { ENGINE_CPU, 1 };
+			std::string engine = colon ? std::string(value, colon - value) : std::string(value);
+			if (0 != parse_engine(engine.c_str(), spawn.engine)) return -1;
+			if (colon && (sscanf(colon + 1, "%u", &spawn.count) != 1 || spawn.count == 0)) {
+				std::cout << "bad worker count \"" << value << "\", expected ENGINE:N\n";
+				return -1;
+			}
+			options.spawn.push_back(spawn);
+		}
+		else if (strcmp(arg, "--tile-timeout") == 0 && has_value) {
+			if (sscanf(argv[++i], "%u", &options.tile_timeout) != 1 || options.tile_timeout == 0) {
+				std::cout << "bad tile timeout \"" << argv[i] << "\"\n";
+				return -1;
+			}
+			tile_timeout_set = true;
+		}
+		else if (strcmp(arg, "--worker") == 0 && has_value) {
+			options.worker = argv[++i];
+			options.headless = true;
+		}
+		else if (strcmp(arg, "--validate") == 0) {
+			options.validate = true;
+		}
+		else if (strcmp(arg, "--device") == 0 && has_value) {
+			options.device_name = argv[++i];
+		}
+		else if (strcmp(arg, "--pipeline-cache") == 0 && has_value) {
+			options.pipeline_cache = argv[++i];
+		}
+		else if (strcmp(arg, "--no-validation") == 0) {
+			options.validation = false;
+		}
+		else if (strcmp(arg, "--present") == 0 && has_value) {
+			if (0 != parse_present_mode(argv[++i], options.present_mode)) return -1;
+		}
+		else if (strcmp(arg, "--profile") == 0) {
+			options.profile = true;
+		}
+		else if (strcmp(arg, "--trace") == 0 && has_value) {
+			options.trace = argv[++i];
+			options.profile = true;
+		}
+		else if (strcmp(arg, "--memory") == 0) {
+			options.memory = true;
+		}
+		else if (strcmp(arg, "--bench") == 0) {
+			options.bench = true;
+			options.headless = true;
+		}
+		else if (strcmp(arg, "--bench-output") == 0 && has_value) {
+			options.bench_output = argv[++i];
+		}
+		else if (strcmp(arg, "--bench-runs") == 0 && has_value) {
+			if (sscanf(argv[++i], "%u", &options.bench_runs) != 1 || options.bench_runs == 0) {
+				std::cout << "bad run count \"" << argv[i] << "\"\n";
+				return -1;
+			}
+		}
+		else {
+			std::cout << "unknown or incomplete option " << arg << "\n";
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if (options.bench) {
+		// auto stands for every engine here
+		if (!engine_set)
+			options.engine = ENGINE_AUTO;
+		if (size_set)
+			options.bench_sizes = { { options.width, options.height } };
+		else
+			options.bench_sizes = { { 256, 256 }, { 1024, 1024 } };
+		if (iterations_set)
+			options.bench_iterations = { options.max_iterations };
+		else
+			options.bench_iterations = { 256, 4096 };
+		// what the colorizer's histogram and the deep engine's orbit get sized for
+		options.max_iterations = 0;
+		for (uint32_t cap : options.bench_iterations)
+			options.max_iterations = std::max(options.max_iterations, cap);
+	}
+
+	if (options.engine == ENGINE_CPU && !options.headless) {
+		std::cout << "the cpu engine only renders --headless\n";
+		return -1;
+	}
+	// the window's frame loop has no reference orbit to keep up to date as the view moves
+	if (options.engine == ENGINE_DEEP && !options.headless) {
+		std::cout << "the deep engine only renders --headless, eg --headless --view X,Y,SIZE; the window can't use it\n";
+		return -1;
+	}
+
+	if (options.progressive > 0 && options.engine != ENGINE_COMPUTE) {
+		std::cout << "--progressive needs --engine compute\n";
+		return -1;
+	}
+
+	if (options.subdivide && options.engine != ENGINE_COMPUTE && options.engine != ENGINE_CPU) {
+		std::cout << "--subdivide needs --engine compute or cpu\n";
+		return -1;
+	}
+
+	if (options.subdivide && options.progressive > 0) {
+		std::cout << "--subdivide and --progressive don't mix, progressive passes don't know the borders yet\n";
+		return -1;
+	}
+
+	// the cpu and deep engines, and so --validate's reference, bail out at 2
+	bool custom_radius = options.escape_radius != DEFAULT_ESCAPE_RADIUS;
+	bool every_engine = options.bench && options.engine == ENGINE_AUTO;
+	if (custom_radius && (options.engine == ENGINE_CPU || options.engine == ENGINE_DEEP || options.validate || every_engine)) {
+		std::cout << "--escape-radius needs the fragment or compute engine and can't be validated\n";
+		return -1;
+	}
+
+	// the cpu engine writes iteration counts alone, bailing out at 2, into the compute engine's buffers
+	if (options.hybrid) {
+		if (options.headless || options.engine != ENGINE_COMPUTE) {
+			std::cout << "--hybrid needs the window and --engine compute\n";
+			return -1;
+		}
+		if (options.progressive > 0 || options.subdivide || options.color.smooth || custom_radius) {
+			std::cout << "--hybrid can't --progressive, --subdivide, --smooth or change --escape-radius\n";
+			return -1;
+		}
+	}
+
+	// only the compute engine's tile cache fills the store, and only where main.cpp creates one
+	if (!options.tile_store.empty()) {
+		bool engine = options.engine == ENGINE_AUTO || options.engine == ENGINE_COMPUTE;
+		bool window = !options.headless && options.progressive == 0 && !options.subdivide && !options.hybrid;
+		if (options.cache_mb == 0 || !engine || !(window || !options.keyframes.empty())) {
+			std::cout << "--tile-store needs the compute engine's tile cache: the window or --keyframes, without --cache-mb 0\n";
+			return -1;
+		}
+		// the probe could pick the fragment engine, which has no tile cache to fill the store from
+		options.engine = ENGINE_COMPUTE;
+	}
+
+	if (options.profile && options.headless) {
+		std::cout << "--profile and --trace time the window's frames, headless runs print their own timings\n";
+		return -1;
+	}
+
+	if (options.poster) {
+		if (options.bench || options.views.size() > 1) {
+			std::cout << "--poster renders one view\n";
+			return -1;
+		}
+		// these all take a view as a whole, with its counts in memory, rather than a tile at a time
+		if (options.engine == ENGINE_DEEP || options.progressive > 0 || options.validate) {
+			std::cout << "--poster needs the fragment, compute or cpu engine, without --progressive or --validate\n";
+			return -1;
+		}
+		// each tile's histogram would spread the palette differently and leave seams between them
+		if (options.color.equalize) {
+			std::cout << "--poster can't --equalize\n";
+			return -1;
+		}
+	}
+
+	if (!options.keyframes.empty()) {
+		if (options.bench || options.poster || !options.farm.empty() || !options.worker.empty() || !options.views.empty()) {
+			std::cout << "--keyframes is a job of its own, without --view, --bench, --poster or the farm\n";
+			return -1;
+		}
+		// keyframes carry no exact centres, and the others take a frame as a whole
+		if (options.engine == ENGINE_DEEP || options.progressive > 0 || options.validate) {
+			std::cout << "--keyframes needs the fragment, compute or cpu engine, without --progressive or --validate\n";
+			return -1;
+		}
+		if (!output_set)
+			options.output = "mandel.y4m";
+	}
+	if (options.reproject && (options.keyframes.empty() || options.engine != ENGINE_CPU)) {
+		std::cout << "--reproject needs --keyframes and --engine cpu\n";
+		return -1;
+	}
+
+	if (!options.farm.empty() || !options.worker.empty()) {
+		if (!options.farm.empty() && !options.worker.empty()) {
+			std::cout << "a process is either the --farm or one of its workers\n";
+			return -1;
+		}
+		if (options.bench || options.poster) {
+			std::cout << "--farm and --worker don't mix with --bench or --poster\n";
+			return -1;
+		}
+		// the same as --poster: tiles render apart from each other and from any whole image
+		if (options.engine == ENGINE_DEEP || options.progressive > 0 || options.validate || options.color.equalize) {
+			std::cout << "farm tiles need the fragment, compute or cpu engine, without --progressive, --validate or --equalize\n";
+			return -1;
+		}
+		for (const SpawnWorkers& spawn : options.spawn) {
+			if (spawn.engine == ENGINE_DEEP) {
+				std::cout << "farm workers can't use the deep engine\n";
+				return -1;
+			}
+		}
+	}
+	if ((!options.spawn.empty() || tile_timeout_set) && options.farm.empty()) {
+		std::cout << "--spawn and --tile-timeout need --farm\n";
+		return -1;
+	}
+
+	// --bench has views of its own
+	if (options.views.empty() && !options.bench)
+		options.views.push_back(View { { 0, 0 }, 4.0, { "0", "0" } });
+
+	return 0;
+}
+
+KernelConstants kernel_constants(const Options& options) {
+	return KernelConstants {
+		.max_iterations = 0,
+		.escape_radius2 = options.escape_radius * options.escape_radius,
+		.unroll = options.unroll,
+		.palette = PALETTE_CLASSIC,
+	};
+}
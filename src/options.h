@@ -0,0 +1,180 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "mandel.h"
+
+
+// fullscreen-quad fragment shader vs tiled compute dispatch into a storage image, or no GPU at all;
+// deep is the compute engine iterating double deltas against an arbitrary precision reference orbit
+enum Engine {
+	ENGINE_FRAGMENT,
+	ENGINE_COMPUTE,
+	ENGINE_CPU,
+	ENGINE_DEEP,
+	ENGINE_AUTO,
+};
+
+const char* engine_name(Engine engine);
+
+// instruction set for the CPU engine's kernels; auto takes the widest the CPU supports
+enum CpuIsa {
+	CPU_ISA_SCALAR,
+	CPU_ISA_AVX2,
+	CPU_ISA_AVX512,
+	CPU_ISA_AUTO,
+};
+
+const char* cpu_isa_name(CpuIsa isa);
+
+// the window's swapchain: fifo waits for vblank and queues frames behind it, mailbox waits for vblank but
+// replaces a queued frame with a newer one, immediate shows frames as soon as they're done and may tear
+enum PresentMode {
+	PRESENT_FIFO,
+	PRESENT_MAILBOX,
+	PRESENT_IMMEDIATE,
+};
+
+const char* present_mode_name(PresentMode mode);
+
+// a viewport in the complex plane; size is the width of the view, height follows the aspect ratio
+struct View {
+	double center[2];
+	double size;
+	// the centre as written, since past ~1e-15 wide a double no longer tells neighbouring pixels apart
+	std::string center_text[2];
+	// what --bench reports it as
+	std::string name;
+};
+
+// a view the animation passes through on the given frame
+struct Keyframe {
+	uint32_t frame;
+	View view;
+};
+
+// --spawn ENGINE:N, N local workers on one engine
+struct SpawnWorkers {
+	Engine engine;
+	uint32_t count;
+};
+
+struct BenchSize {
+	uint32_t width;
+	uint32_t height;
+};
+
+struct Options {
+	bool headless = false;
+
+	uint32_t width  = 1024;
+	uint32_t height = 1024;
+
+	std::vector<View> views;
+
+	// printf-style pattern, eg "frame%04d.png" - extension picks png or raw rgba output
+	std::string output = "mandel.png";
+
+	Engine engine = ENGINE_FRAGMENT;
+
+	uint32_t max_iterations = DEFAULT_MAX_ITERATIONS;
+	Precision precision = PRECISION_AUTO;
+	// MANDEL_FLAG_EARLY_OUT, on unless comparing against plain iteration
+	bool early_out = true;
+	// fragment and compute engines: the bailout, and iterations between escape checks
+	float escape_radius = DEFAULT_ESCAPE_RADIUS;
+	uint32_t unroll = 1;
+
+	// compute engine colouring
+	ColorSettings color;
+
+	// compute engine workgroup shape and the size of the square tiles it dispatches
+	uint32_t workgroup[2] = { 16, 16 };
+	uint32_t tile_size = 256;
+
+	// iterations per pixel per pass in progressive mode, which keeps each pixel's z between passes so
+	// --iterations can go into the millions; 0 iterates every pixel to completion at once
+	uint32_t progressive = 0;
+
+	// Mariani-Silver: iterate the border of each square and fill it when the border is one count, for the
+	// cpu and compute engines
+	bool subdivide = false;
+
+	// GPU memory for the window's tile cache, 0 to iterate every frame in full
+	uint32_t cache_mb = 256;
+	// the tile cache's tiles also go to files under this directory, and come back from them in later runs,
+	// or other processes; empty for none
+	std::string tile_store;
+
+	CpuIsa cpu_isa = CPU_ISA_AUTO;
+	// 0 means one per hardware thread
+	unsigned threads = 0;
+
+	// window, compute engine: the cpu engine renders the bottom rows of every frame while the GPU does the rest,
+	// and the split follows how fast each side was on the frames before
+	bool hybrid = false;
+
+	// headless: --size is the whole of one view, however large, rendered in device sized tiles a band of rows
+	// at a time and streamed to --output, so memory stays flat however tall the image gets
+	bool poster = false;
+
+	// headless: one frame per step of the path through these, zooming at a constant rate between keyframes,
+	// streamed to output as YUV4MPEG2 when it ends in .y4m and raw RGBA8 otherwise; "-" is stdout
+	std::vector<Keyframe> keyframes;
+	// only for the Y4M header
+	uint32_t fps = 30;
+	// cpu engine: reproject the frame before's counts rather than iterate every pixel of every frame
+	bool reproject = false;
+
+	// headless: coordinate a render farm on this Unix socket, handing tiles of every view out to workers and
+	// writing the images they add up to, without rendering anything itself
+	std::string farm;
+	// workers the coordinator starts on the same machine, each with its own command line plus --worker
+	std::vector<SpawnWorkers> spawn;
+	// seconds a worker gets for a tile before the tile goes to another one as well, at least; once the worker has
+	// sent some back, its own pace can stretch that
+	uint32_t tile_timeout = 30;
+	// headless: render tiles for the coordinator on this socket until it hangs up
+	std::string worker;
+
+	// compare the GPU's iteration counts against the CPU engine's after every view
+	bool validate = false;
+
+	// substring match on the physical device name, eg "llvmpipe" to force lavapipe
+	std::string device_name;
+
+	// compiled pipelines kept between runs, empty for none
+	std::string pipeline_cache = "pipeline_cache.bin";
+	// the Khronos validation layers, when installed; they cost a good part of startup
+	bool validation = true;
+
+	// window only; falls back to fifo, which every surface supports
+	PresentMode present_mode = PRESENT_FIFO;
+
+	// window only: GPU and CPU frame timings, throughput and input latency, summarised once a second
+	bool profile = false;
+	// the profiled frames as a Chrome trace, written on exit; implies profile
+	std::string trace;
+	// GPU memory per heap, against its budget, once started up and again at exit
+	bool memory = false;
+
+	// headless: every view (the named bench views unless --view or --views gave some) at every size and
+	// cap, through every engine, tier and instruction set that --engine, --precision and --isa leave open,
+	// written to bench_output as JSON
+	bool bench = false;
+	std::string bench_output = "bench.json";
+	// timed renders per case, after one untimed warm-up
+	uint32_t bench_runs = 10;
+	// --size and --iterations when given
+	std::vector<BenchSize> bench_sizes;
+	std::vector<uint32_t> bench_iterations;
+};
+
+int parse_options(int argc, char** argv, Options& options);
+
+// the escape radius and unroll factor as specialization constants, with the iteration cap left to the uniform
+// buffer and the palette to colorize.comp
+KernelConstants kernel_constants(const Options& options);
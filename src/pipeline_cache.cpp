@@ -0,0 +1,162 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include "render.h"
+#include "pipeline_cache.h"
+
+// bumped whenever PipelineCacheHeader changes
+const uint32_t PIPELINE_CACHE_VERSION = 1;
+const uint32_t PIPELINE_CACHE_MAGIC = 0x4350444D; // "MDPC"
+
+// ahead of the driver's own data; Vulkan's header has the UUID too, but some drivers crash rather than
+// reject data from another device, so it is checked before they ever see it
+struct PipelineCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vendor_id;
+	uint32_t device_id;
+	uint32_t driver_version;
+	uint8_t uuid[VK_UUID_SIZE];
+	uint32_t pad;
+	uint64_t size;
+	uint64_t checksum;
+};
+
+static uint64_t fnv1a(const uint8_t* data, size_t size) {
+	uint64_t h = 0xCBF29CE484222325ull;
+	for (size_t i = 0; i < size; i++)
+		h = (h ^ data[i]) * 0x100000001B3ull;
+	return h;
+}
+
+static void fill_header(Init& init, PipelineCacheHeader& header) {
+	const VkPhysicalDeviceProperties& props = init.physical_device.properties;
+	memset(&header, 0, sizeof(header));
+	header.magic = PIPELINE_CACHE_MAGIC;
+	header.version = PIPELINE_CACHE_VERSION;
+	header.vendor_id = props.vendorID;
+	header.device_id = props.deviceID;
+	header.driver_version = props.driverVersion;
+	memcpy(header.uuid, props.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+// the driver's data in a mapped file, or nullptr with the reason it was turned down
+static const uint8_t* valid_cache_data(Init& init, const uint8_t* file, size_t file_size, size_t& size, const char*& reason) {
+	PipelineCacheHeader expected;
+	fill_header(init, expected);
+
+	PipelineCacheHeader header;
+	if (file_size < sizeof(header)) {
+		reason = "truncated";
+		return nullptr;
+	}
+	memcpy(&header, file, sizeof(header));
+	if (header.magic != expected.magic || header.version != expected.version) {
+		reason = "from another version";
+		return nullptr;
+	}
+	if (header.vendor_id != expected.vendor_id || header.device_id != expected.device_id ||
+		header.driver_version != expected.driver_version || memcmp(header.uuid, expected.uuid, VK_UUID_SIZE) != 0) {
+		reason = "from another device or driver";
+		return nullptr;
+	}
+	if (header.size != file_size - sizeof(header) || header.checksum != fnv1a(file + sizeof(header), header.size)) {
+		reason = "corrupt";
+		return nullptr;
+	}
+	size = header.size;
+	return file + sizeof(header);
+}
+
+int load_pipeline_cache(Init& init, const std::string& path) {
+	init.pipeline_cache = VK_NULL_HANDLE;
+	if (path.empty())
+		return 0;
+
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+
+	void* mapped = MAP_FAILED;
+	size_t file_size = 0;
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd >= 0) {
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			file_size = (size_t) st.st_size;
+			mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		close(fd);
+	}
+	if (mapped != MAP_FAILED) {
+		const char* reason = nullptr;
+		data = valid_cache_data(init, (const uint8_t*) mapped, file_size, size, reason);
+		if (data == nullptr)
+			std::cout << "pipeline cache " << path << " is " << reason << ", starting cold\n";
+	}
+
+	VkPipelineCacheCreateInfo create_info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.initialDataSize = size,
+		.pInitialData = data,
+	};
+	VkResult res = init.disp.createPipelineCache(&create_info, nullptr, &init.pipeline_cache);
+	if (mapped != MAP_FAILED)
+		munmap(mapped, file_size);
+	if (res != VK_SUCCESS) {
+		std::cout << "failed to create pipeline cache\n";
+		init.pipeline_cache = VK_NULL_HANDLE;
+		return -1;
+	}
+	if (data != nullptr)
+		std::cout << "pipeline cache: " << size << " bytes from " << path << "\n";
+	return 0;
+}
+
+int save_pipeline_cache(Init& init, const std::string& path) {
+	if (init.pipeline_cache == VK_NULL_HANDLE)
+		return 0;
+
+	size_t size = 0;
+	if (init.disp.getPipelineCacheData(init.pipeline_cache, &size, nullptr) != VK_SUCCESS) {
+		std::cout << "failed to read pipeline cache\n";
+		return -1;
+	}
+	std::vector<uint8_t> file(sizeof(PipelineCacheHeader) + size);
+	// the size can come back smaller the second time, never larger
+	if (init.disp.getPipelineCacheData(init.pipeline_cache, &size, file.data() + sizeof(PipelineCacheHeader)) != VK_SUCCESS) {
+		std::cout << "failed to read pipeline cache\n";
+		return -1;
+	}
+	file.resize(sizeof(PipelineCacheHeader) + size);
+
+	PipelineCacheHeader header;
+	fill_header(init, header);
+	header.size = size;
+	header.checksum = fnv1a(file.data() + sizeof(header), size);
+	memcpy(file.data(), &header, sizeof(header));
+
+	std::string temp = path + ".tmp";
+	FILE* out = fopen(temp.c_str(), "wb");
+	if (out == nullptr) {
+		std::cout << "failed to write pipeline cache " << temp << "\n";
+		return -1;
+	}
+	bool written = fwrite(file.data(), 1, file.size(), out) == file.size();
+	if (fclose(out) != 0 || !written || rename(temp.c_str(), path.c_str()) != 0) {
+		std::cout << "failed to write pipeline cache " << path << "\n";
+		unlink(temp.c_str());
+		return -1;
+	}
+	return 0;
+}
+
+void destroy_pipeline_cache(Init& init) {
+	init.disp.destroyPipelineCache(init.pipeline_cache, nullptr);
+	init.pipeline_cache = VK_NULL_HANDLE;
+}
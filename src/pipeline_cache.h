@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+
+struct Init;
+
+// the driver's compiled pipelines, kept on disk between runs so a warm start skips shader compilation.
+// The file is only trusted when it was written by this build's format for the same device and driver;
+// anything else starts an empty cache, which gets written over on exit.
+// An empty path turns it off, leaving init.pipeline_cache VK_NULL_HANDLE.
+int load_pipeline_cache(Init& init, const std::string& path);
+// writes through a temporary file and a rename, so an interrupted run never leaves a torn cache
+int save_pipeline_cache(Init& init, const std::string& path);
+void destroy_pipeline_cache(Init& init);
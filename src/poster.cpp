@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "poster.h"
+#include "headless.h"
+#include "readback.h"
+#include "image_write.h"
+#include "cpu_engine.h"
+
+VkExtent2D poster_tile_extent(const Init& init, const Options& options) {
+	uint32_t max_dim = init.physical_device.properties.limits.maxImageDimension2D;
+	return {
+		std::min({ POSTER_TILE_WIDTH, options.width, max_dim }),
+		std::min(POSTER_BAND_HEIGHT, options.height),
+	};
+}
+
+static void print_poster(const std::string& filename, const View& view, const Options& options, size_t tiles, double ms) {
+	printf("%s: center %1.17f,%1.17f size %1.17g, %ux%u in %zu tiles in %.2fms, %.1f Mpix/s\n", filename.c_str(),
+		view.center[0], view.center[1], view.size, options.width, options.height, tiles, ms,
+		(double) options.width * options.height / (ms * 1000.0));
+}
+
+// tiles go left to right along a band and band after band down the image, so they come back from the ring in
+// the order the stream wants their rows. Tiles along the right and bottom edges render in full and are cropped.
+int run_poster(Init& init, RenderData& data, const Options& options) {
+	const View& view = options.views[0];
+	double edges[4];
+	view_edges(view, options.width, options.height, edges);
+	VkExtent2D tile = poster_tile_extent(init, options);
+
+	// one tier for every tile, the one the whole image needs, so the arithmetic doesn't change at a tile border
+	if (data.precision_mode == PRECISION_AUTO) {
+		MandelParams params;
+		offscreen_params(data, { options.width, options.height }, edges, params);
+		data.precision_mode = pick_precision(params, PRECISION_AUTO, init.shader_float64);
+	}
+
+	Engine engine = options.engine;
+	if (engine == ENGINE_AUTO)
+		engine = pick_engine(init, data, OFFSCREEN_FORMAT, tile, edges);
+	data.engine = engine;
+
+	Readback readback;
+	if (0 != create_readback(init, data, readback, tile)) {
+		destroy_readback(init, data, readback);
+		return -1;
+	}
+
+	std::string filename = format_output_name(options.output, 0, false);
+	ImageStream stream;
+	if (0 != open_image_stream(stream, filename, options.width, options.height)) {
+		destroy_readback(init, data, readback);
+		return -1;
+	}
+
+	uint32_t columns = (options.width + tile.width - 1) / tile.width;
+	uint32_t bands = (options.height + tile.height - 1) / tile.height;
+	size_t count = (size_t) columns * bands;
+	size_t row_size = (size_t) options.width * 4;
+	std::vector<uint8_t> band(row_size * tile.height);
+
+	int res = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < count + READBACK_SLOTS - 1 && res == 0; i++) {
+		if (i < count) {
+			double tile_edge[4];
+			tile_edges(edges, options.width, options.height, (uint32_t) (i % columns) * tile.width, (uint32_t) (i / columns) * tile.height, tile.width, tile.height, tile_edge);
+			res = readback_submit(init, data, readback, (uint32_t) (i % READBACK_SLOTS), engine, tile_edge);
+		}
+		if (res != 0 || i < READBACK_SLOTS - 1 || i - (READBACK_SLOTS - 1) >= count)
+			continue;
+
+		size_t done = i - (READBACK_SLOTS - 1);
+		uint32_t slot = (uint32_t) (done % READBACK_SLOTS);
+		if (0 != readback_wait(init, readback, slot)) {
+			res = -1;
+			break;
+		}
+
+		uint32_t x0 = (uint32_t) (done % columns) * tile.width;
+		uint32_t y0 = (uint32_t) (done / columns) * tile.height;
+		uint32_t width = std::min(tile.width, options.width - x0);
+		uint32_t rows = std::min(tile.height, options.height - y0);
+		const uint8_t* pixels = (const uint8_t*) readback.slots[slot].staging_memory.mapped;
+		for (uint32_t y = 0; y < rows; y++)
+			memcpy(band.data() + y * row_size + (size_t) x0 * 4, pixels + (size_t) y * tile.width * 4, (size_t) width * 4);
+
+		if (done % columns == columns - 1 && 0 != write_image_rows(stream, band.data(), rows))
+			res = -1;
+	}
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	destroy_readback(init, data, readback);
+	if (0 != close_image_stream(stream))
+		res = -1;
+	if (res == 0)
+		print_poster(filename, view, options, count, elapsed.count());
+	return res;
+}
+
+int run_poster_cpu(const Options& options) {
+	CpuEngine cpu;
+	if (0 != cpu_engine_init(cpu, options)) return -1;
+	std::cout << "Using " << cpu.threads << " threads with " << cpu_isa_name(cpu.isa) << " kernels" << std::endl;
+
+	const View& view = options.views[0];
+	double edges[4];
+	view_edges(view, options.width, options.height, edges);
+
+	// the cpu engine takes a band of any size, so each is one tile the full width of the image
+	uint32_t band_height = std::min(POSTER_BAND_HEIGHT, options.height);
+	size_t pixels = (size_t) options.width * band_height;
+	std::vector<uint32_t> iterations(pixels);
+	std::vector<uint8_t> rgba(pixels * 4);
+	std::vector<uint32_t> palette;
+	build_palette(options.max_iterations, options.color.palette, palette);
+
+	std::string filename = format_output_name(options.output, 0, false);
+	ImageStream stream;
+	if (0 != open_image_stream(stream, filename, options.width, options.height))
+		return -1;
+	}
+
+	int res = 0;
+	size_t bands = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t y0 = 0; y0 < options.height && res == 0; y0 += band_height, bands++) {
+		uint32_t rows = std::min(band_height, options.height - y0);
+		double band_edges[4];
+		tile_edges(edges, options.width, options.height, 0, y0, options.width, rows, band_edges);
+		MandelParams params;
+		fill_params(params, band_edges, options.width, rows, options.max_iterations);
+		if (options.early_out)
+			params.flags |= MANDEL_FLAG_EARLY_OUT;
+
+		cpu_render(cpu, params, iterations.data());
+		colorize(iterations.data(), (size_t) options.width * rows, palette, rgba.data());
+		res = write_image_rows(stream, rgba.data(), rows);
+	}
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	if (0 != close_image_stream(stream))
+		res = -1;
+	if (res == 0)
+		print_poster(filename, view, options, bands, elapsed.count());
+	return res;
+}
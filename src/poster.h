@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vulkan/vulkan_core.h>
+
+#include "options.h"
+
+struct Init;
+struct RenderData;
+
+// --poster renders in tiles this wide at most, a band of this many rows at a time; the band is the only part of
+// the image ever in memory, so it costs width * POSTER_BAND_HEIGHT * 4 bytes however tall the poster is
+const uint32_t POSTER_TILE_WIDTH = 4096;
+const uint32_t POSTER_BAND_HEIGHT = 256;
+
+// the size of one tile, which the compute engine's targets have to match
+VkExtent2D poster_tile_extent(const Init& init, const Options& options);
+
+// renders options.views[0] at --size, tile by tile through the readback ring, and streams it to options.output
+int run_poster(Init& init, RenderData& data, const Options& options);
+// the same a band at a time on the cpu engine, without initialising Vulkan
+int run_poster_cpu(const Options& options);
@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include "render.h"
+#include "profiler.h"
+
+// frames kept for --trace, about a minute at 60Hz
+const size_t RING_CAPACITY = 4096;
+
+const char* cpu_phase_name(CpuPhase phase) {
+	switch (phase) {
+		case PHASE_FRAME_WAIT: return "frame wait";
+		case PHASE_ACQUIRE:    return "acquire";
+		case PHASE_RECORD:     return "record";
+		case PHASE_SUBMIT:     return "submit";
+		case PHASE_PRESENT:    return "present";
+		case PHASE_COUNT:      break;
+	}
+	return "unknown";
+}
+
+static int create_profiler_buffer(Init& init, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& memory) {
+	VkBufferCreateInfo buffer_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = usage,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	if (init.disp.createBuffer(&buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+		std::cout << "failed to create profiler buffer\n";
+		return -1;
+	}
+
+	// buffer blocks are all allocated device addressable
+	if (0 != allocate_buffer_memory(init, buffer, properties, memory)) {
+		std::cout << "failed to allocate profiler buffer memory\n";
+		return -1;
+	}
+	return 0;
+}
+
+int create_profiler(Init& init, Profiler& profiler, const Options& options, uint32_t counters) {
+	profiler.enabled = options.profile;
+	profiler.trace_path = options.trace;
+	profiler.epoch = std::chrono::steady_clock::now();
+	if (!profiler.enabled)
+		return 0;
+
+	profiler.ring.reserve(RING_CAPACITY);
+
+	uint32_t family = init.device.get_queue_index(vkb::QueueType::graphics).value();
+	uint32_t valid_bits = init.device.queue_families[family].timestampValidBits;
+	if (valid_bits > 0) {
+		profiler.timestamp_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+		profiler.timestamp_period = init.physical_device.properties.limits.timestampPeriod;
+
+		VkQueryPoolCreateInfo pool_info = {
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_TIMESTAMP,
+			.queryCount = PROFILER_SLOTS * 2,
+		};
+		if (init.disp.createQueryPool(&pool_info, nullptr, &profiler.timestamps) != VK_SUCCESS) {
+			std::cout << "failed to create timestamp query pool\n";
+			return -1;
+		}
+	} else {
+		std::cout << "the graphics queue has no timestamps, rates fall back to CPU frame times\n";
+	}
+
+	if (init.pipeline_statistics) {
+		VkQueryPoolCreateInfo pool_info = {
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+			.queryCount = PROFILER_SLOTS,
+			.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+				VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT,
+		};
+		if (init.disp.createQueryPool(&pool_info, nullptr, &profiler.statistics) != VK_SUCCESS) {
+			std::cout << "failed to create pipeline statistics query pool\n";
+			return -1;
+		}
+	}
+
+	VkDeviceSize region = WORK_BUCKETS * sizeof(uint64_t);
+	if (0 != create_profiler_buffer(init, region * counters,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, profiler.counters, profiler.counters_memory))
+		return -1;
+	VkBufferDeviceAddressInfo address_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+		.buffer = profiler.counters,
+	};
+	profiler.counters_address = init.disp.getBufferDeviceAddress(&address_info);
+
+	if (0 != create_profiler_buffer(init, region * PROFILER_SLOTS, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, profiler.readback, profiler.readback_memory))
+		return -1;
+	profiler.readback_mapped = (uint64_t*) profiler.readback_memory.mapped;
+	return 0;
+}
+
+void destroy_profiler(Init& init, Profiler& profiler) {
+	init.disp.destroyQueryPool(profiler.timestamps, nullptr);
+	init.disp.destroyQueryPool(profiler.statistics, nullptr);
+	init.disp.destroyBuffer(profiler.counters, nullptr);
+	free_memory(init, profiler.counters_memory);
+	init.disp.destroyBuffer(profiler.readback, nullptr);
+	free_memory(init, profiler.readback_memory);
+	profiler = {};
+}
+
+uint64_t profiler_counter_address(const Profiler& profiler, uint32_t counter) {
+	if (!profiler.enabled)
+		return 0;
+	return profiler.counters_address + (uint64_t) counter * WORK_BUCKETS * sizeof(uint64_t);
+}
+
+void record_profiler_begin(Init& init, Profiler& profiler, VkCommandBuffer cmd, uint32_t slot, uint32_t counter) {
+	if (!profiler.enabled || slot >= PROFILER_SLOTS)
+		return;
+
+	if (profiler.timestamps != VK_NULL_HANDLE)
+		init.disp.cmdResetQueryPool(cmd, profiler.timestamps, slot * 2, 2);
+	if (profiler.statistics != VK_NULL_HANDLE)
+		init.disp.cmdResetQueryPool(cmd, profiler.statistics, slot, 1);
+
+	// the last frame that used this uniform slot may still be adding to its counters, or copying them out
+	VkDeviceSize region = WORK_BUCKETS * sizeof(uint64_t);
+	VkMemoryBarrier to_fill = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+		.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &to_fill, 0, nullptr, 0, nullptr);
+	init.disp.cmdFillBuffer(cmd, profiler.counters, counter * region, region, 0);
+	VkMemoryBarrier to_shaders = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &to_shaders, 0, nullptr, 0, nullptr);
+
+	if (profiler.timestamps != VK_NULL_HANDLE)
+		init.disp.cmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profiler.timestamps, slot * 2);
+	if (profiler.statistics != VK_NULL_HANDLE)
+		init.disp.cmdBeginQuery(cmd, profiler.statistics, slot, 0);
+}
+
+void record_profiler_end(Init& init, Profiler& profiler, VkCommandBuffer cmd, uint32_t slot, uint32_t counter) {
+	if (!profiler.enabled || slot >= PROFILER_SLOTS)
+		return;
+
+	if (profiler.statistics != VK_NULL_HANDLE)
+		init.disp.cmdEndQuery(cmd, profiler.statistics, slot);
+	if (profiler.timestamps != VK_NULL_HANDLE)
+		init.disp.cmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler.timestamps, slot * 2 + 1);
+
+	VkDeviceSize region = WORK_BUCKETS * sizeof(uint64_t);
+	VkMemoryBarrier to_copy = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 1, &to_copy, 0, nullptr, 0, nullptr);
+	VkBufferCopy copy = { counter * region, slot * region, region };
+	init.disp.cmdCopyBuffer(cmd, profiler.counters, profiler.readback, 1, &copy);
+	VkMemoryBarrier to_host = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &to_host, 0, nullptr, 0, nullptr);
+}
+
+double profiler_now(const Profiler& profiler) {
+	std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - profiler.epoch;
+	return elapsed.count();
+}
+
+void profiler_phase(const Profiler& profiler, FrameSample& frame, CpuPhase phase, double& since) {
+	double now = profiler_now(profiler);
+	frame.cpu_start[phase] = since;
+	frame.cpu_us[phase] = now - since;
+	since = now;
+}
+
+// until queuePresentKHR returns; the display adds up to a refresh more with fifo, which mailbox trims
+static double input_latency(const FrameSample& frame) {
+	return frame.cpu_start[PHASE_PRESENT] + frame.cpu_us[PHASE_PRESENT] - frame.input_start;
+}
+
+void profiler_collect(Init& init, Profiler& profiler, uint32_t slot) {
+	if (!profiler.enabled || slot >= PROFILER_SLOTS || !profiler.submitted[slot])
+		return;
+	profiler.submitted[slot] = false;
+	FrameSample frame = profiler.pending[slot];
+
+	// without WAIT_BIT, so a frame that somehow hasn't finished gets dropped rather than stalling the next
+	frame.gpu_us = -1;
+	if (profiler.timestamps != VK_NULL_HANDLE) {
+		uint64_t ticks[2];
+		if (init.disp.getQueryPoolResults(profiler.timestamps, slot * 2, 2, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+			return;
+		frame.gpu_us = ((ticks[1] - ticks[0]) & profiler.timestamp_mask) * profiler.timestamp_period / 1000.0;
+	}
+	frame.fragment_invocations = frame.compute_invocations = 0;
+	if (profiler.statistics != VK_NULL_HANDLE) {
+		// in bit order: fragment, then compute
+		uint64_t counts[2];
+		if (init.disp.getQueryPoolResults(profiler.statistics, slot, 1, sizeof(counts), counts, sizeof(counts), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+			return;
+		frame.fragment_invocations = counts[0];
+		frame.compute_invocations = counts[1];
+	}
+	frame.iterations = 0;
+	const uint64_t* buckets = profiler.readback_mapped + slot * WORK_BUCKETS;
+	for (uint32_t i = 0; i < WORK_BUCKETS; i++)
+		frame.iterations += buckets[i];
+
+	if (profiler.ring.size() < RING_CAPACITY) {
+		profiler.ring.push_back(frame);
+	} else {
+		profiler.ring[profiler.head] = frame;
+		profiler.head = (profiler.head + 1) % RING_CAPACITY;
+	}
+
+	profiler.report_frames++;
+	for (int p = 0; p < PHASE_COUNT; p++)
+		profiler.report_cpu_us[p] += frame.cpu_us[p];
+	profiler.report_gpu_us += frame.gpu_us;
+	profiler.report_pixels += frame.pixels;
+	profiler.report_iterations += frame.iterations;
+	if (frame.input_start >= 0) {
+		double latency = input_latency(frame);
+		profiler.report_inputs++;
+		profiler.report_latency_us += latency;
+		profiler.report_latency_max = std::max(profiler.report_latency_max, latency);
+	}
+}
+
+void profiler_submitted(Profiler& profiler, uint32_t slot, const FrameSample& frame) {
+	if (!profiler.enabled || slot >= PROFILER_SLOTS)
+		return;
+	profiler.pending[slot] = frame;
+	profiler.pending[slot].frame = profiler.frames++;
+	profiler.submitted[slot] = true;
+}
+
+void profiler_input(Profiler& profiler) {
+	if (profiler.enabled && profiler.input_pending < 0)
+		profiler.input_pending = profiler_now(profiler);
+}
+
+void profiler_latch(Profiler& profiler, FrameSample& frame) {
+	frame.input_start = profiler.input_pending;
+	profiler.input_pending = -1;
+}
+
+// per second of GPU time, or of the CPU's whole frame when there are no timestamps
+static double frame_rate(double count, double gpu_us, const double cpu_us[PHASE_COUNT]) {
+	double us = gpu_us;
+	if (us <= 0) {
+		us = 0;
+		for (int p = 0; p < PHASE_COUNT; p++)
+			us += cpu_us[p];
+	}
+	return us > 0 ? count / us * 1e6 : 0;
+}
+
+void report_profiler(Profiler& profiler) {
+	if (!profiler.enabled)
+		return;
+	double now = profiler_now(profiler);
+	if (now - profiler.report_start < 1e6 || profiler.report_frames == 0)
+		return;
+
+	double n = (double) profiler.report_frames;
+	printf("%llu frames, cpu", (unsigned long long) profiler.report_frames);
+	for (int p = 0; p < PHASE_COUNT; p++)
+		printf(" %s %.2fms%s", cpu_phase_name((CpuPhase) p), profiler.report_cpu_us[p] / n / 1000.0, p + 1 < PHASE_COUNT ? "," : "");
+	if (profiler.timestamps != VK_NULL_HANDLE)
+		printf("; gpu %.2fms", profiler.report_gpu_us / n / 1000.0);
+	printf("; %.1f Mpix/s, %.3f Giter/s",
+		frame_rate(profiler.report_pixels, profiler.report_gpu_us, profiler.report_cpu_us) / 1e6,
+		frame_rate(profiler.report_iterations, profiler.report_gpu_us, profiler.report_cpu_us) / 1e9);
+	if (profiler.report_inputs > 0)
+		printf("; input to present %.2fms, worst %.2fms", profiler.report_latency_us / profiler.report_inputs / 1000.0, profiler.report_latency_max / 1000.0);
+	printf("\n");
+
+	profiler.report_start = now;
+	profiler.report_frames = 0;
+	memset(profiler.report_cpu_us, 0, sizeof(profiler.report_cpu_us));
+	profiler.report_gpu_us = 0;
+	profiler.report_pixels = 0;
+	profiler.report_iterations = 0;
+	profiler.report_inputs = 0;
+	profiler.report_latency_us = 0;
+	profiler.report_latency_max = 0;
+}
+
+int write_trace(const Profiler& profiler, const std::string& path) {
+	FILE* file = fopen(path.c_str(), "w");
+	if (file == nullptr) {
+		std::cout << "could not open " << path << " for writing\n";
+		return -1;
+	}
+
+	// CPU phases on one track, GPU work on another and input latency on a third. The GPU's clock isn't the
+	// CPU's, so its spans are placed at their submit and only their lengths are measured.
+	fprintf(file, "{\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"cpu\"}},\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"gpu\"}},\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":3,\"args\":{\"name\":\"input\"}}");
+	size_t count = profiler.ring.size();
+	for (size_t i = 0; i < count; i++) {
+		const FrameSample& frame = profiler.ring[(profiler.head + i) % count];
+		for (int p = 0; p < PHASE_COUNT; p++) {
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+				cpu_phase_name((CpuPhase) p), frame.cpu_start[p], frame.cpu_us[p], (unsigned long long) frame.frame);
+		}
+		if (frame.input_start >= 0) {
+			fprintf(file, ",\n{\"name\":\"input to present\",\"ph\":\"X\",\"pid\":1,\"tid\":3,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+				frame.input_start, input_latency(frame), (unsigned long long) frame.frame);
+		}
+		double submit = frame.cpu_start[PHASE_SUBMIT];
+		if (frame.gpu_us >= 0) {
+			fprintf(file, ",\n{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%.3f,\"dur\":%.3f,"
+				"\"args\":{\"frame\":%llu,\"fragment invocations\":%llu,\"compute invocations\":%llu,\"iterations\":%llu}}",
+				submit, frame.gpu_us, (unsigned long long) frame.frame, (unsigned long long) frame.fragment_invocations,
+				(unsigned long long) frame.compute_invocations, (unsigned long long) frame.iterations);
+		}
+		fprintf(file, ",\n{\"name\":\"throughput\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"Mpix/s\":%.3f,\"Giter/s\":%.6f}}",
+			submit, frame_rate(frame.pixels, frame.gpu_us, frame.cpu_us) / 1e6, frame_rate(frame.iterations, frame.gpu_us, frame.cpu_us) / 1e9);
+	}
+	fprintf(file, "\n]}\n");
+
+	if (fclose(file) != 0) {
+		std::cout << "failed writing " << path << "\n";
+		return -1;
+	}
+	printf("wrote %zu frames to %s\n", count, path.c_str());
+	return 0;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include "allocator.h"
+
+struct Init;
+struct Options;
+
+// mirrors WORK_BUCKETS in shaders/include/mandel.glsl: the shaders spread their iteration counts over this many
+// 64-bit words so the atomics don't all contend for one address
+const uint32_t WORK_BUCKETS = 64;
+
+// command buffers the profiler can have in flight at once, one per frame in flight; frames past this many go
+// unprofiled
+const uint32_t PROFILER_SLOTS = 16;
+
+// what draw_frame spends its CPU time on, in the order it does them
+enum CpuPhase {
+	// for the frame in flight's last submission, on the timeline semaphore
+	PHASE_FRAME_WAIT,
+	PHASE_ACQUIRE,
+	// updating the uniform buffer and recording the frame's command buffer
+	PHASE_RECORD,
+	PHASE_SUBMIT,
+	PHASE_PRESENT,
+	PHASE_COUNT,
+};
+
+const char* cpu_phase_name(CpuPhase phase);
+
+struct FrameSample {
+	uint64_t frame;
+	// microseconds since the profiler was created
+	double cpu_start[PHASE_COUNT];
+	double cpu_us[PHASE_COUNT];
+	// between the timestamps around the frame's work, negative when the device has no timestamps
+	double gpu_us;
+	// pipeline statistics, 0 without pipelineStatisticsQuery
+	uint64_t fragment_invocations;
+	uint64_t compute_invocations;
+	// pixels on screen, and iterations the shaders counted doing them; 0 when the shaders can't count
+	uint64_t pixels;
+	uint64_t iterations;
+	// when the oldest input the frame draws arrived, negative when no input changed it
+	double input_start;
+};
+
+// GPU timestamps, pipeline statistics and the shaders' iteration counts around each frame's command buffer,
+// plus draw_frame's CPU timings, kept in a ring of recent frames. Nothing is recorded unless enabled.
+struct Profiler {
+	bool enabled = false;
+	// --trace, written by write_trace at exit
+	std::string trace_path;
+
+	std::chrono::steady_clock::time_point epoch;
+
+	// 2 timestamps per slot, VK_NULL_HANDLE when the graphics queue has no timestamp bits
+	VkQueryPool timestamps = VK_NULL_HANDLE;
+	uint64_t timestamp_mask;
+	double timestamp_period;
+	// one fragment and compute invocation query per slot, VK_NULL_HANDLE without pipelineStatisticsQuery
+	VkQueryPool statistics = VK_NULL_HANDLE;
+
+	// WORK_BUCKETS pairs of words per uniform slot, which the shaders find through MandelParams::work_counter,
+	// and a host visible copy per slot to read them back from
+	VkBuffer counters = VK_NULL_HANDLE;
+	Allocation counters_memory;
+	VkDeviceAddress counters_address = 0;
+	VkBuffer readback = VK_NULL_HANDLE;
+	Allocation readback_memory;
+	uint64_t* readback_mapped = nullptr;
+
+	// the CPU half of the frame each slot last submitted, waiting for its GPU results
+	FrameSample pending[PROFILER_SLOTS];
+	bool submitted[PROFILER_SLOTS] = {};
+
+	// the most recent finished frames, oldest at head once it has wrapped
+	std::vector<FrameSample> ring;
+	size_t head = 0;
+	uint64_t frames = 0;
+
+	// the interval report_profiler prints, started at its last report
+	double report_start = 0;
+	uint64_t report_frames = 0;
+	double report_cpu_us[PHASE_COUNT] = {};
+	double report_gpu_us = 0;
+	uint64_t report_pixels = 0;
+	uint64_t report_iterations = 0;
+	// input to present, over the frames input changed
+	uint64_t report_inputs = 0;
+	double report_latency_us = 0;
+	double report_latency_max = 0;
+
+	// the first input since the last frame latched, negative when there was none
+	double input_pending = -1;
+};
+
+// counters is the number of uniform slots the shaders get work_counter from
+int create_profiler(Init& init, Profiler& profiler, const Options& options, uint32_t counters);
+void destroy_profiler(Init& init, Profiler& profiler);
+
+// for MandelParams::work_counter in the given uniform slot; 0 turns the shaders' counting off
+uint64_t profiler_counter_address(const Profiler& profiler, uint32_t counter);
+
+// around the work of one command buffer that reads uniform slot counter. Both go outside any render pass.
+void record_profiler_begin(Init& init, Profiler& profiler, VkCommandBuffer cmd, uint32_t slot, uint32_t counter);
+void record_profiler_end(Init& init, Profiler& profiler, VkCommandBuffer cmd, uint32_t slot, uint32_t counter);
+
+// microseconds since create_profiler
+double profiler_now(const Profiler& profiler);
+// closes the phase that began at since, and starts the next one there
+void profiler_phase(const Profiler& profiler, FrameSample& frame, CpuPhase phase, double& since);
+
+// moves the slot's previous frame into the ring; its submission must have been waited on, and the next submission
+// that uses the slot must not have started
+void profiler_collect(Init& init, Profiler& profiler, uint32_t slot);
+// the frame just submitted with the slot's command buffer
+void profiler_submitted(Profiler& profiler, uint32_t slot, const FrameSample& frame);
+
+// input changed the view; the frame that latches it measures its latency from the first call since the last one
+void profiler_input(Profiler& profiler);
+// hands frame the input that arrived since the last frame latched
+void profiler_latch(Profiler& profiler, FrameSample& frame);
+
+// prints averages over the frames since the last report, at most once a second
+void report_profiler(Profiler& profiler);
+// the ring as Chrome trace event JSON, for chrome://tracing or Perfetto
+int write_trace(const Profiler& profiler, const std::string& path);
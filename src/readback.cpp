@@ -0,0 +1,317 @@
+#include <string.h>
+
+#include <iostream>
+
+#include "headless.h"
+#include "readback.h"
+
+static_assert(READBACK_SLOTS <= MAX_FRAMES_IN_FLIGHT, "every readback slot needs a uniform slot of its own");
+
+static int create_slot_image(Init& init, RenderData& data, Readback& readback, ReadbackSlot& slot) {
+	// rendered on one queue family and copied on another, without ownership transfers in between
+	uint32_t families[2] = { init.device.get_queue_index(vkb::QueueType::graphics).value(), data.transfer_family };
+	bool shared = data.transfer_queue != VK_NULL_HANDLE;
+
+	VkImageCreateInfo image_info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = OFFSCREEN_FORMAT,
+		.extent = { readback.extent.width, readback.extent.height, 1 },
+		.mipLevels = 1,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		.sharingMode = shared ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = shared ? 2u : 0u,
+		.pQueueFamilyIndices = shared ? families : nullptr,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+	if (init.disp.createImage(&image_info, nullptr, &slot.image) != VK_SUCCESS) {
+		std::cout << "failed to create readback image\n";
+		return -1;
+	}
+	if (0 != allocate_image_memory(init, slot.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, slot.image_memory)) {
+		std::cout << "failed to allocate readback image memory\n";
+		return -1;
+	}
+
+	VkImageViewCreateInfo view_info = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = slot.image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = OFFSCREEN_FORMAT,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+	};
+	if (init.disp.createImageView(&view_info, nullptr, &slot.image_view) != VK_SUCCESS) {
+		std::cout << "failed to create readback image view\n";
+		return -1;
+	}
+	return 0;
+}
+
+// the same every time, so it is recorded once
+static int record_copy(Init& init, Readback& readback, ReadbackSlot& slot) {
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+	};
+	if (init.disp.beginCommandBuffer(slot.copy, &begin_info) != VK_SUCCESS)
+		return -1;
+
+	// the render left the image in TRANSFER_SRC_OPTIMAL, and the timeline wait made its writes visible
+	VkBufferImageCopy region = {
+		.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+		.imageExtent = { readback.extent.width, readback.extent.height, 1 },
+	};
+	init.disp.cmdCopyImageToBuffer(slot.copy, slot.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.staging, 1, &region);
+
+	VkBufferMemoryBarrier2 to_host = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+		.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+		.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+		.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer = slot.staging,
+		.offset = 0,
+		.size = VK_WHOLE_SIZE,
+	};
+	VkDependencyInfo dependency = {
+		.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+		.bufferMemoryBarrierCount = 1,
+		.pBufferMemoryBarriers = &to_host,
+	};
+	init.disp.cmdPipelineBarrier2(slot.copy, &dependency);
+
+	if (init.disp.endCommandBuffer(slot.copy) != VK_SUCCESS) {
+		std::cout << "failed to record readback copy\n";
+		return -1;
+	}
+	return 0;
+}
+
+int create_readback(Init& init, RenderData& data, Readback& readback, VkExtent2D extent) {
+	readback = {};
+	readback.extent = extent;
+
+	uint32_t copy_family = data.transfer_family;
+	readback.copy_queue = data.transfer_queue;
+	if (readback.copy_queue == VK_NULL_HANDLE) {
+		copy_family = init.device.get_queue_index(vkb::QueueType::graphics).value();
+		readback.copy_queue = data.graphics_queue;
+	}
+
+	VkCommandPoolCreateInfo pool_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.queueFamilyIndex = copy_family,
+	};
+	if (init.disp.createCommandPool(&pool_info, nullptr, &readback.copy_pool) != VK_SUCCESS) {
+		std::cout << "failed to create readback command pool\n";
+		return -1;
+	}
+
+	VkSemaphoreTypeCreateInfo timeline_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = 0,
+	};
+	VkSemaphoreCreateInfo semaphore_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &timeline_info,
+	};
+	if (init.disp.createSemaphore(&semaphore_info, nullptr, &readback.rendered) != VK_SUCCESS ||
+		init.disp.createSemaphore(&semaphore_info, nullptr, &readback.copied) != VK_SUCCESS) {
+		std::cout << "failed to create readback timeline\n";
+		return -1;
+	}
+
+	VkCommandBuffer render[READBACK_SLOTS];
+	VkCommandBuffer copy[READBACK_SLOTS];
+	VkCommandBufferAllocateInfo alloc_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = data.command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = READBACK_SLOTS,
+	};
+	if (init.disp.allocateCommandBuffers(&alloc_info, render) != VK_SUCCESS) {
+		std::cout << "failed to allocate readback command buffers\n";
+		return -1;
+	}
+	alloc_info.commandPool = readback.copy_pool;
+	if (init.disp.allocateCommandBuffers(&alloc_info, copy) != VK_SUCCESS) {
+		init.disp.freeCommandBuffers(data.command_pool, READBACK_SLOTS, render);
+		std::cout << "failed to allocate readback command buffers\n";
+		return -1;
+	}
+
+	VkDeviceSize size = (VkDeviceSize) extent.width * extent.height * 4;
+	for (uint32_t i = 0; i < READBACK_SLOTS; i++) {
+		ReadbackSlot& slot = readback.slots[i];
+		slot.render = render[i];
+		slot.copy = copy[i];
+		slot.engine = ENGINE_AUTO;
+		if (0 != create_slot_image(init, data, readback, slot)) return -1;
+		if (0 != create_readback_buffer(init, size, slot.staging, slot.staging_memory)) return -1;
+		if (0 != record_copy(init, readback, slot)) return -1;
+	}
+	return 0;
+}
+
+void destroy_readback(Init& init, RenderData& data, Readback& readback) {
+	// a render whose copy failed to submit still counts in renders, so both are waited on
+	VkSemaphore timelines[2] = { readback.rendered, readback.copied };
+	uint64_t values[2] = { readback.renders, readback.copies };
+	for (uint32_t i = 0; i < 2; i++) {
+		if (timelines[i] == VK_NULL_HANDLE)
+			continue;
+		VkSemaphoreWaitInfo wait_info = {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+			.semaphoreCount = 1,
+			.pSemaphores = &timelines[i],
+			.pValues = &values[i],
+		};
+		init.disp.waitSemaphores(&wait_info, UINT64_MAX);
+		init.disp.destroySemaphore(timelines[i], nullptr);
+	}
+
+	for (ReadbackSlot& slot : readback.slots) {
+		if (slot.render != VK_NULL_HANDLE)
+			init.disp.freeCommandBuffers(data.command_pool, 1, &slot.render);
+		init.disp.destroyImageView(slot.image_view, nullptr);
+		init.disp.destroyImage(slot.image, nullptr);
+		free_memory(init, slot.image_memory);
+		init.disp.destroyBuffer(slot.staging, nullptr);
+		free_memory(init, slot.staging_memory);
+	}
+	// the copy command buffers go with their pool
+	init.disp.destroyCommandPool(readback.copy_pool, nullptr);
+	readback = {};
+}
+
+static int record_render(Init& init, RenderData& data, ReadbackSlot& slot, uint32_t index, Engine engine, VkExtent2D extent) {
+	init.disp.resetCommandBuffer(slot.render, 0);
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+	};
+	if (init.disp.beginCommandBuffer(slot.render, &begin_info) != VK_SUCCESS)
+		return -1;
+	if (0 != record_offscreen(init, data, slot.render, engine, index, slot.image, slot.image_view, extent))
+		return -1;
+	if (init.disp.endCommandBuffer(slot.render) != VK_SUCCESS) {
+		std::cout << "failed to record readback render\n";
+		return -1;
+	}
+	slot.engine = engine;
+	slot.precision = data.precision;
+	return 0;
+}
+
+// the tile table, and which tiles need iterating, change from frame to frame, so this is recorded every time
+static int record_cached(Init& init, RenderData& data, ReadbackSlot& slot, uint32_t index, const MandelParams& params, VkExtent2D extent) {
+	init.disp.resetCommandBuffer(slot.render, 0);
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	if (init.disp.beginCommandBuffer(slot.render, &begin_info) != VK_SUCCESS)
+		return -1;
+	if (0 != record_cached_view(init, data.tile_cache, data.compute, slot.render, index, params, data.precision_mode))
+		return -1;
+	record_colorize(init, data.colorizer, data.compute, slot.render, index, data.color.equalize);
+	record_compute_blit(init, data.compute, slot.render, slot.image, extent, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	if (init.disp.endCommandBuffer(slot.render) != VK_SUCCESS) {
+		std::cout << "failed to record readback render\n";
+		return -1;
+	}
+	// whatever renders in this slot next records again
+	slot.engine = ENGINE_AUTO;
+	return 0;
+}
+
+int readback_submit(Init& init, RenderData& data, Readback& readback, uint32_t index, Engine engine, const double edges[4]) {
+	ReadbackSlot& slot = readback.slots[index];
+
+	MandelParams params;
+	offscreen_params(data, readback.extent, edges, params);
+	memcpy(uniform_mapped(data.uniforms, index), &params, sizeof(params));
+
+	data.precision = pick_precision(params, data.precision_mode, init.shader_float64);
+	if (readback.cached && engine == ENGINE_COMPUTE && cache_covers(params)) {
+		if (0 != record_cached(init, data, slot, index, params, readback.extent))
+			return -1;
+	} else if ((slot.engine != engine || slot.precision != data.precision) && 0 != record_render(init, data, slot, index, engine, readback.extent))
+		return -1;
+
+	VkSemaphoreSubmitInfo render_signal = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+		.semaphore = readback.rendered,
+		.value = readback.renders + 1,
+		.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+	};
+	VkCommandBufferSubmitInfo render_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+		.commandBuffer = slot.render,
+	};
+	VkSubmitInfo2 render_submit = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+		.commandBufferInfoCount = 1,
+		.pCommandBufferInfos = &render_info,
+		.signalSemaphoreInfoCount = 1,
+		.pSignalSemaphoreInfos = &render_signal,
+	};
+	if (init.disp.queueSubmit2(data.graphics_queue, 1, &render_submit, VK_NULL_HANDLE) != VK_SUCCESS) {
+		std::cout << "failed to submit readback render\n";
+		return -1;
+	}
+	// what destroy_readback waits for, should the copy not get submitted
+	readback.renders++;
+
+	VkSemaphoreSubmitInfo copy_wait = render_signal;
+	copy_wait.stageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	VkSemaphoreSubmitInfo copy_signal = render_signal;
+	copy_signal.semaphore = readback.copied;
+	copy_signal.value = readback.copies + 1;
+	VkCommandBufferSubmitInfo copy_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+		.commandBuffer = slot.copy,
+	};
+	VkSubmitInfo2 copy_submit = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+		.waitSemaphoreInfoCount = 1,
+		.pWaitSemaphoreInfos = &copy_wait,
+		.commandBufferInfoCount = 1,
+		.pCommandBufferInfos = &copy_info,
+		.signalSemaphoreInfoCount = 1,
+		.pSignalSemaphoreInfos = &copy_signal,
+	};
+	if (init.disp.queueSubmit2(readback.copy_queue, 1, &copy_submit, VK_NULL_HANDLE) != VK_SUCCESS) {
+		std::cout << "failed to submit readback copy\n";
+		return -1;
+	}
+	readback.copies++;
+	slot.copied = readback.copies;
+	slot.submitted = std::chrono::steady_clock::now();
+	return 0;
+}
+
+int readback_wait(Init& init, Readback& readback, uint32_t index) {
+	ReadbackSlot& slot = readback.slots[index];
+	uint64_t copied = slot.copied;
+	if (copied == 0)
+		return 0;
+	slot.copied = 0;
+
+	VkSemaphoreWaitInfo wait_info = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.semaphoreCount = 1,
+		.pSemaphores = &readback.copied,
+		.pValues = &copied,
+	};
+	if (init.disp.waitSemaphores(&wait_info, UINT64_MAX) != VK_SUCCESS) {
+		std::cout << "failed waiting for readback\n";
+		return -1;
+	}
+	invalidate_allocation(init, slot.staging_memory);
+	return 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+
+#include <vulkan/vulkan_core.h>
+
+#include "allocator.h"
+#include "options.h"
+
+struct Init;
+struct RenderData;
+
+// one per uniform slot, so no more than MAX_FRAMES_IN_FLIGHT: enough for the GPU to render one frame while it
+// copies the one before and the CPU encodes the one before that
+const uint32_t READBACK_SLOTS = 3;
+
+struct ReadbackSlot {
+	// rendered on the graphics queue and copied from on the transfer queue
+	VkImage image;
+	Allocation image_memory;
+	VkImageView image_view;
+	// persistently mapped, holds the pixels once the copied timeline reaches copied
+	VkBuffer staging;
+	Allocation staging_memory;
+
+	// re-recorded whenever the engine or precision tier changes; copy never is
+	VkCommandBuffer render;
+	VkCommandBuffer copy;
+	Engine engine;
+	Precision precision;
+
+	// what the copied timeline reaches once the copy is done, 0 while the slot holds nothing
+	uint64_t copied;
+	std::chrono::steady_clock::time_point submitted;
+};
+
+// offscreen frames pipelined through a ring of targets and staging buffers: each frame renders on the graphics
+// queue and is copied back on the transfer queue, when the device has one, chained by timeline semaphores
+// rather than waited on in between. Only the fragment and compute engines, without progressive passes, go
+// through it; the deep engine and progressive mode submit and wait several times per frame anyway.
+struct Readback {
+	VkExtent2D extent;
+	// the transfer queue, or the graphics queue on devices without one
+	VkQueue copy_queue;
+	VkCommandPool copy_pool = VK_NULL_HANDLE;
+
+	// one timeline per queue, each counting the frames that got that far: a timeline signalled from both queues
+	// would let the next frame's render signal before this frame's copy, and a signal must never go backwards
+	VkSemaphore rendered = VK_NULL_HANDLE;
+	VkSemaphore copied = VK_NULL_HANDLE;
+	uint64_t renders = 0;
+	uint64_t copies = 0;
+	ReadbackSlot slots[READBACK_SLOTS] = {};
+
+	// the compute engine draws from data.tile_cache, re-recording every frame, rather than iterating in full
+	bool cached = false;
+};
+
+int create_readback(Init& init, RenderData& data, Readback& readback, VkExtent2D extent);
+// waits for whatever is still in flight
+void destroy_readback(Init& init, RenderData& data, Readback& readback);
+
+// renders edges into the slot with the engine and copies it back, without waiting. The slot must be empty or
+// waited on, and nothing else may use its uniform slot until it is.
+int readback_submit(Init& init, RenderData& data, Readback& readback, uint32_t slot, Engine engine, const double edges[4]);
+// waits for the slot's copy and empties it; its RGBA8 pixels are then in staging_memory.mapped
+int readback_wait(Init& init, Readback& readback, uint32_t slot);
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <string.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+#include <GLFW/glfw3.h>
+
+#include "VkBootstrap.h"
+
+#include "options.h"
+#include "allocator.h"
+#include "mandel.h"
+#include "compute.h"
+#include "colorize.h"
+#include "tile_cache.h"
+#include "hybrid.h"
+#include "deep.h"
+#include "timing.h"
+#include "profiler.h"
+
+#define EXAMPLE_BUILD_DIRECTORY "./shaders"
+
+const int MAX_FRAMES_IN_FLIGHT = 3;
+
+
+struct Init {
+	GLFWwindow* window;
+	vkb::Instance instance;
+	vkb::InstanceDispatchTable inst_disp;
+	VkSurfaceKHR surface;
+	vkb::PhysicalDevice physical_device;
+	vkb::Device device;
+	vkb::DispatchTable disp;
+	vkb::Swapchain swapchain;
+	// --present; create_swapchain falls back to FIFO when the surface lacks it
+	VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+
+	// optional now that the float and double-single tiers cover devices without it
+	bool shader_float64;
+	// only for --profile: invocation counts, and shader.frag adding to the work counters
+	bool pipeline_statistics;
+	bool fragment_atomics;
+	// VK_EXT_swapchain_maintenance1: presents signal a fence once they're done with the swapchain's semaphores
+	bool present_fences;
+
+	// every pipeline goes through it, see pipeline_cache.h; VK_NULL_HANDLE with --pipeline-cache ""
+	VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+
+	// every buffer and image's memory comes from it, see allocator.h
+	Allocator allocator;
+};
+
+// a fragment engine pipeline: the tier's shader.frag specialized with these constants
+struct VariantKey {
+	Precision precision;
+	KernelConstants constants;
+
+	bool operator==(const VariantKey& other) const {
+		return precision == other.precision && constants == other.constants;
+	}
+};
+
+struct VariantKeyHash {
+	size_t operator()(const VariantKey& key) const {
+		uint32_t radius_bits;
+		memcpy(&radius_bits, &key.constants.escape_radius2, sizeof(radius_bits));
+		uint64_t h = (uint64_t) key.constants.max_iterations * 0x9E3779B97F4A7C15ull;
+		h ^= ((uint64_t) radius_bits << 16) + (h << 6) + (h >> 2);
+		h ^= ((uint64_t) key.constants.unroll << 8) ^ ((uint64_t) key.constants.palette << 4) ^ (uint64_t) key.precision;
+		return (size_t) h;
+	}
+};
+
+// a swapchain replaced by recreate_swapchain, with what went with it; see release_retired
+struct RetiredSwapchain {
+	vkb::Swapchain swapchain;
+	std::vector<VkImageView> image_views;
+	std::vector<VkSemaphore> finished_semaphores;
+	std::vector<VkFence> present_fences;
+	// the first frame submitted after it was replaced; once that finishes, no submit uses it anymore, though its
+	// last presents may still be pending
+	uint64_t frame;
+};
+
+struct RenderData {
+	VkQueue graphics_queue;
+	VkQueue present_queue;
+	// a family with transfers but no graphics, usually a copy engine that runs alongside rendering;
+	// VK_NULL_HANDLE when the device has none
+	VkQueue transfer_queue = VK_NULL_HANDLE;
+	uint32_t transfer_family = 0;
+
+	std::vector<VkImage> swapchain_images;
+	std::vector<VkImageView> swapchain_image_views;
+	// swapchains replaced by a resize, until the frames that used them are done
+	std::vector<RetiredSwapchain> retired;
+
+	// what the fragment engine's pipelines render to: the swapchain's format, or OFFSCREEN_FORMAT headless
+	VkFormat color_format;
+	VkPipelineLayout pipeline_layout;
+	// the fragment engine's shaders, kept to build pipeline variants from; VK_NULL_HANDLE for the f64 tier on
+	// devices without shaderFloat64
+	VkShaderModule vert_module;
+	VkShaderModule frag_modules[PRECISION_COUNT];
+	// every variant built so far. Switching iteration caps or palettes back and forth only rebinds, and the
+	// handful a session visits never needs evicting.
+	std::unordered_map<VariantKey, VkPipeline, VariantKeyHash> graphics_variants;
+
+	VkCommandPool command_pool;
+	// one per frame in flight, like the uniform slots and descriptor sets, and re-recorded every frame
+	std::vector<VkCommandBuffer> command_buffers;
+
+	// per frame in flight, signalled by the acquire
+	std::vector<VkSemaphore> available_semaphores;
+	// per swapchain image, signalled by the submit for present to wait on
+	std::vector<VkSemaphore> finished_semaphores;
+	// per swapchain image with init.present_fences, signalled by its last present; created signalled
+	std::vector<VkFence> present_fences;
+	// counts submitted frames; frame_values holds the value each frame in flight's last submit signals
+	VkSemaphore frame_timeline = VK_NULL_HANDLE;
+	uint64_t frame_count = 0;
+	std::vector<uint64_t> frame_values;
+
+	// MandelParams per frame in flight
+	UniformRing uniforms;
+
+	VkDescriptorPool descriptorPool;
+	VkDescriptorSetLayout setLayout {};
+
+	std::vector<VkDescriptorSet> descriptorSets;
+
+	Engine engine = ENGINE_FRAGMENT;
+	uint32_t max_iterations = DEFAULT_MAX_ITERATIONS;
+	// --escape-radius and --unroll; the fragment engine bakes in the cap and palette too, see fragment_variant
+	KernelConstants constants;
+	// --precision, and the tier the last frame was drawn in
+	Precision precision_mode = PRECISION_AUTO;
+	Precision precision = PRECISION_F64;
+	ComputeEngine compute;
+	Colorizer colorizer;
+	TileCache tile_cache;
+	Hybrid hybrid;
+	DeepEngine deep;
+	Profiler profiler;
+
+	ColorSettings color;
+	// MANDEL_FLAG_EARLY_OUT, toggled with I in the window
+	bool early_out = true;
+	// whether the last full frame built the histogram, which only matters when equalising
+	bool recorded_equalize = false;
+	// the view the compute engine's iteration buffers currently hold
+	bool iterated = false;
+	MandelParams iterated_params;
+	// progressive mode: iterations per pixel the passes have covered since the view last changed
+	uint32_t progress = 0;
+
+	size_t current_frame = 0;
+	// something on screen changed: input, or a new swapchain whose images hold nothing yet. The window loop
+	// sleeps while it's clear and nothing animates.
+	bool redraw = true;
+};
+
+// left/top/right/bottom borders
+extern double edgeData[4];
+
+// marks the window, instance and device phases on startup
+int device_initialization(Init& init, const Options& options, PhaseTimer& startup);
+int get_queues(Init& init, RenderData& data);
+int create_transfer_buffers(Init& init, RenderData& data);
+// the pipeline layout, descriptors and shader modules; the pipelines themselves come from graphics_variant
+int create_graphics_pipeline(Init& init, RenderData& data);
+// the variant for data's current tier, iteration cap and palette
+VariantKey fragment_variant(const RenderData& data);
+// builds the variant the first time it is asked for; VK_NULL_HANDLE if that fails
+VkPipeline graphics_variant(Init& init, RenderData& data, const VariantKey& key);
+// one fullscreen draw with dynamic rendering into image, which it leaves in final_layout: PRESENT_SRC for the
+// swapchain, or TRANSFER_SRC with the writes ordered before transfer reads
+void record_fragment(Init& init, RenderData& data, VkCommandBuffer cmd, VkPipeline pipeline, VkDescriptorSet set, VkImage image, VkImageView view, VkExtent2D extent, VkImageLayout final_layout);
+int create_command_pool(Init& init, RenderData& data);
+
+// SPIR-V for a shader built once per precision tier, eg "mandel.comp"
+std::string shader_path(const char* name, Precision precision);
+// maps the SPIR-V file rather than copying it; VK_NULL_HANDLE if it can't be loaded
+VkShaderModule createShaderModule(Init& init, const std::string& path);
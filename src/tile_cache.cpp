@@ -0,0 +1,536 @@
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include "render.h"
+#include "headless.h"
+#include "tile_cache.h"
+
+static int create_cache_buffer(Init& init, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, Allocation& memory, VkMemoryPropertyFlags properties) {
+	VkBufferCreateInfo buffer_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = usage,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	if (init.disp.createBuffer(&buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+		std::cout << "failed to create tile cache buffer\n";
+		return -1;
+	}
+
+	if (0 != allocate_buffer_memory(init, buffer, properties, memory)) {
+		std::cout << "failed to allocate tile cache memory\n";
+		return -1;
+	}
+	return 0;
+}
+
+static VkPipeline create_cache_stage(Init& init, TileCache& cache, const std::string& path, const VkSpecializationInfo* spec_info) {
+	VkShaderModule comp_module = createShaderModule(init, path);
+	if (comp_module == VK_NULL_HANDLE) {
+		std::cout << "failed to create shader module\n";
+		return VK_NULL_HANDLE;
+	}
+
+	VkComputePipelineCreateInfo pipeline_info = {
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = comp_module,
+			.pName = "main",
+			.pSpecializationInfo = spec_info,
+		},
+		.layout = cache.pipeline_layout,
+	};
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult res = init.disp.createComputePipelines(init.pipeline_cache, 1, &pipeline_info, nullptr, &pipeline);
+	init.disp.destroyShaderModule(comp_module, nullptr);
+	if (res != VK_SUCCESS) {
+		std::cout << "failed to create " << path << " pipeline\n";
+		return VK_NULL_HANDLE;
+	}
+	return pipeline;
+}
+
+int create_tile_cache(Init& init, TileCache& cache, const Options& options, const ComputeEngine& compute, const UniformRing& uniforms) {
+	if (options.cache_mb == 0)
+		return 0;
+
+	VkDeviceSize tile_bytes = (VkDeviceSize) CACHE_TILE_SIZE * CACHE_TILE_SIZE * sizeof(uint32_t);
+	VkDeviceSize slots = ((VkDeviceSize) options.cache_mb << 20) / (2 * tile_bytes);
+	// each of the two buffers has to fit a single storage buffer binding
+	VkDeviceSize max_slots = init.physical_device.properties.limits.maxStorageBufferRange / tile_bytes;
+	if (slots > max_slots) {
+		std::cout << "tile cache limited to " << max_slots << " tiles by the device's storage buffer range\n";
+		slots = max_slots;
+	}
+	cache.capacity = (uint32_t) slots;
+	cache.free_slots.clear();
+	for (uint32_t i = cache.capacity; i-- > 0; )
+		cache.free_slots.push_back(i);
+
+	VkDescriptorSetLayoutBinding bindings[6] = {};
+	for (uint32_t i = 0; i < 6; i++) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = (i == 0) ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = 6,
+		.pBindings = bindings
+	};
+	if (init.disp.createDescriptorSetLayout(&setLayoutCreateInfo, nullptr, &cache.set_layout) != VK_SUCCESS) {
+		std::cout << "failed to create tile cache descriptor set layout\n";
+		return -1;
+	}
+
+	uint32_t set_count = uniforms.count;
+	VkDescriptorPoolSize poolSizes[2] = {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, set_count },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5 * set_count },
+	};
+	VkDescriptorPoolCreateInfo poolInfo {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.maxSets = set_count,
+		.poolSizeCount = 2,
+		.pPoolSizes = poolSizes,
+	};
+	if (init.disp.createDescriptorPool(&poolInfo, nullptr, &cache.descriptor_pool) != VK_SUCCESS) {
+		std::cout << "failed to create tile cache descriptor pool\n";
+		return -1;
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(set_count, cache.set_layout);
+	VkDescriptorSetAllocateInfo allocInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = cache.descriptor_pool,
+		.descriptorSetCount = set_count,
+		.pSetLayouts = layouts.data(),
+	};
+	cache.descriptor_sets.resize(set_count);
+	if (init.disp.allocateDescriptorSets(&allocInfo, cache.descriptor_sets.data()) != VK_SUCCESS) {
+		std::cout << "failed to allocate tile cache descriptor sets\n";
+		return -1;
+	}
+
+	// the store copies tiles in and out of the cache
+	VkDeviceSize cache_size = (VkDeviceSize) cache.capacity * tile_bytes;
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	if (0 != create_cache_buffer(init, cache_size, usage, cache.iterations, cache.iterations_memory, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) return -1;
+	if (0 != create_cache_buffer(init, cache_size, usage, cache.magnitudes, cache.magnitudes_memory, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) return -1;
+
+	if (!options.tile_store.empty()) {
+		if (0 != open_tile_store(cache.store, options.tile_store)) return -1;
+		VkDeviceSize store_size = (VkDeviceSize) uniforms.count * 2 * STORE_TILES * tile_bytes;
+		if (0 != create_cache_buffer(init, store_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, cache.store_upload, cache.store_upload_memory,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) return -1;
+		if (0 != create_readback_buffer(init, store_size, cache.store_readback, cache.store_readback_memory)) return -1;
+		cache.store_pending.assign(uniforms.count, {});
+	}
+
+	// the compose target and tile tables are written in bind_tile_cache_targets
+	VkDescriptorBufferInfo iterationsInfo = { cache.iterations, 0, VK_WHOLE_SIZE };
+	VkDescriptorBufferInfo magnitudesInfo = { cache.magnitudes, 0, VK_WHOLE_SIZE };
+	for (uint32_t i = 0; i < set_count; i++) {
+		VkDescriptorBufferInfo uniformInfo = uniform_descriptor(uniforms, i);
+		VkDescriptorBufferInfo* infos[3] = { &uniformInfo, &iterationsInfo, &magnitudesInfo };
+		VkWriteDescriptorSet writes[3];
+		for (uint32_t b = 0; b < 3; b++) {
+			writes[b] = {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = cache.descriptor_sets[i],
+				.dstBinding = b,
+				.descriptorCount = 1,
+				.descriptorType = bindings[b].descriptorType,
+				.pBufferInfo = infos[b],
+			};
+		}
+		init.disp.updateDescriptorSets(3, writes, 0, nullptr);
+	}
+
+	// both push constant blocks start at offset 0, one range covers the larger
+	VkPushConstantRange pushRange = {
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = (uint32_t) std::max(sizeof(CacheTilePush), sizeof(ComposePush)),
+	};
+	VkPipelineLayoutCreateInfo pipeline_layout_info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &cache.set_layout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &pushRange,
+	};
+	if (init.disp.createPipelineLayout(&pipeline_layout_info, nullptr, &cache.pipeline_layout) != VK_SUCCESS) {
+		std::cout << "failed to create tile cache pipeline layout\n";
+		return -1;
+	}
+
+	struct {
+		uint32_t local_size[2];
+		uint32_t tile;
+		KernelConstants constants;
+	} spec_data = { { compute.local_size[0], compute.local_size[1] }, CACHE_TILE_SIZE, compute.constants };
+	std::vector<VkSpecializationMapEntry> spec_entries = {
+		{ 0, 0, sizeof(uint32_t) },
+		{ 1, sizeof(uint32_t), sizeof(uint32_t) },
+		{ 2, 2 * sizeof(uint32_t), sizeof(uint32_t) },
+	};
+	kernel_constant_entries(offsetof(decltype(spec_data), constants), spec_entries);
+	VkSpecializationInfo spec_info = {
+		.mapEntryCount = (uint32_t) spec_entries.size(),
+		.pMapEntries = spec_entries.data(),
+		.dataSize = sizeof(spec_data),
+		.pData = &spec_data,
+	};
+
+	for (int p = 0; p < PRECISION_COUNT; p++) {
+		cache.tile_pipelines[p] = VK_NULL_HANDLE;
+		if (p == PRECISION_F64 && !init.shader_float64)
+			continue;
+		cache.tile_pipelines[p] = create_cache_stage(init, cache, shader_path("mandel_tile.comp", (Precision) p), &spec_info);
+		if (cache.tile_pipelines[p] == VK_NULL_HANDLE)
+			return -1;
+	}
+	cache.compose_pipeline = create_cache_stage(init, cache, std::string(EXAMPLE_BUILD_DIRECTORY) + "/compose.comp.spv", &spec_info);
+	if (cache.compose_pipeline == VK_NULL_HANDLE)
+		return -1;
+	return 0;
+}
+
+static void destroy_tile_table(Init& init, TileCache& cache) {
+	init.disp.destroyBuffer(cache.table, nullptr);
+	free_memory(init, cache.table_memory);
+	cache.table = VK_NULL_HANDLE;
+	cache.table_mapped = nullptr;
+}
+
+int bind_tile_cache_targets(Init& init, TileCache& cache, const ComputeEngine& compute) {
+	if (cache.capacity == 0)
+		return 0;
+
+	// a view's pixels are at most twice as wide as its level's, plus a partial tile either side
+	uint32_t cols = (2 * compute.extent.width + CACHE_TILE_SIZE - 1) / CACHE_TILE_SIZE + 2;
+	uint32_t rows = (2 * compute.extent.height + CACHE_TILE_SIZE - 1) / CACHE_TILE_SIZE + 2;
+	cache.table_capacity = cols * rows;
+	if (cache.table_capacity > cache.capacity) {
+		std::cout << "tile cache holds " << cache.capacity << " tiles but a " << compute.extent.width << "x" << compute.extent.height
+			<< " view can touch " << cache.table_capacity << ", raise --cache-mb\n";
+		return -1;
+	}
+
+	destroy_tile_table(init, cache);
+	VkDeviceSize table_size = (VkDeviceSize) cache.table_capacity * cache.descriptor_sets.size() * sizeof(uint32_t);
+	if (0 != create_cache_buffer(init, table_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, cache.table, cache.table_memory, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) return -1;
+	cache.table_mapped = (uint32_t*) cache.table_memory.mapped;
+
+	VkDescriptorBufferInfo iterationsInfo = { compute.iterations, 0, VK_WHOLE_SIZE };
+	VkDescriptorBufferInfo magnitudesInfo = { compute.magnitudes, 0, VK_WHOLE_SIZE };
+	VkDescriptorBufferInfo tableInfo = { cache.table, 0, VK_WHOLE_SIZE };
+	VkDescriptorBufferInfo* infos[3] = { &iterationsInfo, &magnitudesInfo, &tableInfo };
+	for (auto set : cache.descriptor_sets) {
+		VkWriteDescriptorSet writes[3];
+		for (uint32_t b = 0; b < 3; b++) {
+			writes[b] = {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = set,
+				.dstBinding = 3 + b,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = infos[b],
+			};
+		}
+		init.disp.updateDescriptorSets(3, writes, 0, nullptr);
+	}
+	return 0;
+}
+
+void destroy_tile_cache(Init& init, TileCache& cache) {
+	if (cache.capacity == 0)
+		return;
+
+	destroy_tile_table(init, cache);
+	init.disp.destroyBuffer(cache.iterations, nullptr);
+	free_memory(init, cache.iterations_memory);
+	init.disp.destroyBuffer(cache.magnitudes, nullptr);
+	free_memory(init, cache.magnitudes_memory);
+	init.disp.destroyBuffer(cache.store_upload, nullptr);
+	free_memory(init, cache.store_upload_memory);
+	init.disp.destroyBuffer(cache.store_readback, nullptr);
+	free_memory(init, cache.store_readback_memory);
+
+	for (auto pipeline : cache.tile_pipelines)
+		init.disp.destroyPipeline(pipeline, nullptr);
+	init.disp.destroyPipeline(cache.compose_pipeline, nullptr);
+	init.disp.destroyPipelineLayout(cache.pipeline_layout, nullptr);
+	// descriptor sets go with the pool
+	init.disp.destroyDescriptorPool(cache.descriptor_pool, nullptr);
+	init.disp.destroyDescriptorSetLayout(cache.set_layout, nullptr);
+}
+
+int cache_level_for(const MandelParams& params) {
+	double step = std::min(fabs(params.step[0]), fabs(params.step[1]));
+	return (int) ceil(log2(CACHE_LEVEL0_STEP / step));
+}
+
+bool cache_covers(const MandelParams& params) {
+	// cache_level_for's int would overflow for a step of 0 or one near the ends of the double range
+	double step = std::min(fabs(params.step[0]), fabs(params.step[1]));
+	if (!(step > 0x1p-1000 && step < 0x1p1000))
+		return false;
+	double tile_span = ldexp(CACHE_LEVEL0_STEP, -cache_level_for(params)) * CACHE_TILE_SIZE;
+	const double limit = 0x1p62;
+	for (int axis = 0; axis < 2; axis++) {
+		double last = params.edges[axis] + params.extent[axis] * params.step[axis];
+		// written so that a nan or inf edge fails too
+		if (!(fabs(params.edges[axis] / tile_span) < limit && fabs(last / tile_span) < limit))
+			return false;
+	}
+	return true;
+}
+
+static void split_bits(double value, uint32_t* bits) {
+	memcpy(bits, &value, sizeof(value));
+}
+
+static void split_ds(double value, float* pair) {
+	pair[0] = (float) value;
+	pair[1] = (float) (value - pair[0]);
+}
+
+// a free slot, or the least recently used tile's
+static uint32_t insert_tile(TileCache& cache, const TileKey& key) {
+	uint32_t slot;
+	if (!cache.free_slots.empty()) {
+		slot = cache.free_slots.back();
+		cache.free_slots.pop_back();
+	} else {
+		auto victim = cache.entries.find(cache.lru.back());
+		slot = victim->second.slot;
+		cache.entries.erase(victim);
+		cache.lru.pop_back();
+	}
+	cache.lru.push_front(key);
+	cache.entries[key] = { slot, cache.lru.begin() };
+	return slot;
+}
+
+static const VkDeviceSize TILE_BYTES = (VkDeviceSize) CACHE_TILE_SIZE * CACHE_TILE_SIZE * sizeof(uint32_t);
+
+// where the store's jth tile of a frame goes in store_upload or store_readback, counts and magnitudes
+static VkDeviceSize store_offset(size_t frame, uint32_t j, bool magnitudes) {
+	return ((frame * 2 + (magnitudes ? 1 : 0)) * STORE_TILES + j) * TILE_BYTES;
+}
+
+// the tiles frame's last use copied back, which has finished by now
+static void save_pending(Init& init, TileCache& cache, size_t frame) {
+	std::vector<StoredTile>& pending = cache.store_pending[frame];
+	if (pending.empty())
+		return;
+	invalidate_allocation(init, cache.store_readback_memory);
+	uint8_t* mapped = (uint8_t*) cache.store_readback_memory.mapped;
+	for (uint32_t j = 0; j < pending.size(); j++) {
+		save_stored_tile(cache.store, pending[j], CACHE_TILE_SIZE, (const uint32_t*) (mapped + store_offset(frame, j, false)),
+			(const float*) (mapped + store_offset(frame, j, true)));
+	}
+	pending.clear();
+}
+
+void flush_tile_store(Init& init, TileCache& cache) {
+	for (size_t frame = 0; frame < cache.store_pending.size(); frame++)
+		save_pending(init, cache, frame);
+}
+
+int record_cached_view(Init& init, TileCache& cache, const ComputeEngine& compute, VkCommandBuffer cmd, size_t frame, const MandelParams& params, Precision precision_mode) {
+	if (!cache_covers(params)) {
+		std::cout << "view is past what the tile cache can address\n";
+		return -1;
+	}
+	int level = cache_level_for(params);
+	double step = ldexp(CACHE_LEVEL0_STEP, -level);
+	double tile_span = step * CACHE_TILE_SIZE;
+
+	MandelParams level_params = params;
+	level_params.step[0] = level_params.step[1] = step;
+	Precision precision = pick_precision(level_params, precision_mode, init.shader_float64);
+
+	// everything below is in level pixels relative to the first tile, small enough for compose.comp's floats
+	int64_t first[2] = { (int64_t) floor(params.edges[0] / tile_span), (int64_t) floor(params.edges[1] / tile_span) };
+	double offset[2], ratio[2];
+	uint32_t size[2];
+	for (int axis = 0; axis < 2; axis++) {
+		offset[axis] = params.edges[axis] / step - (double) first[axis] * CACHE_TILE_SIZE;
+		ratio[axis] = params.step[axis] / step;
+		double last = offset[axis] + ((double) params.extent[axis] - 0.5) * ratio[axis];
+		size[axis] = (uint32_t) floor(last / CACHE_TILE_SIZE) + 1;
+	}
+	if (size[0] * size[1] > cache.table_capacity) {
+		std::cout << "view needs " << size[0] * size[1] << " tiles, tile table holds " << cache.table_capacity << "\n";
+		return -1;
+	}
+
+	uint32_t base = (uint32_t) frame * cache.table_capacity;
+	uint32_t* table = cache.table_mapped + base;
+
+	auto key_at = [&](uint32_t t) {
+		return TileKey { level, first[0] + t % size[0], first[1] + t / size[0], params.max_iterations, precision };
+	};
+
+	// resident tiles are touched first, so the evictions below never reach a tile this view needs
+	std::vector<uint32_t> missing;
+	for (uint32_t t = 0; t < size[0] * size[1]; t++) {
+		auto it = cache.entries.find(key_at(t));
+		if (it == cache.entries.end()) {
+			missing.push_back(t);
+			continue;
+		}
+		cache.lru.splice(cache.lru.begin(), cache.lru, it->second.position);
+		table[t] = it->second.slot;
+	}
+	for (uint32_t t : missing)
+		table[t] = insert_tile(cache, key_at(t));
+	cache.hits += size[0] * size[1] - missing.size();
+	cache.misses += missing.size();
+
+	// what the store has is decoded from its file's mapping into this frame's part of the upload buffer, one copy
+	// the GPU then copies again into the slots; the rest is iterated
+	bool store = !cache.store.dir.empty();
+	auto stored_key = [&](const TileKey& key) {
+		return StoredTile { key.level, key.x, key.y, key.max_iterations, key.precision, compute.constants.escape_radius2 };
+	};
+	std::vector<uint32_t> loaded;
+	std::vector<uint32_t> iterate;
+	if (store) {
+		save_pending(init, cache, frame);
+		uint8_t* upload = (uint8_t*) cache.store_upload_memory.mapped;
+		for (uint32_t t : missing) {
+			uint32_t j = (uint32_t) loaded.size();
+			if (j < STORE_TILES && load_stored_tile(cache.store, stored_key(key_at(t)), CACHE_TILE_SIZE,
+					(uint32_t*) (upload + store_offset(frame, j, false)), (float*) (upload + store_offset(frame, j, true))))
+				loaded.push_back(t);
+			else
+				iterate.push_back(t);
+		}
+	} else {
+		iterate = missing;
+	}
+
+	// last frame's compose and colorize may still be reading slots that get refilled here, and earlier frames'
+	// loads and iterations writing them, or the tiles in the backlog copied back below
+	VkMemoryBarrier previous_access = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &previous_access, 0, nullptr, 0, nullptr);
+
+	if (!loaded.empty()) {
+		std::vector<VkBufferCopy> counts, magnitudes;
+		for (uint32_t j = 0; j < loaded.size(); j++) {
+			VkDeviceSize slot = (VkDeviceSize) table[loaded[j]] * TILE_BYTES;
+			counts.push_back({ store_offset(frame, j, false), slot, TILE_BYTES });
+			magnitudes.push_back({ store_offset(frame, j, true), slot, TILE_BYTES });
+		}
+		init.disp.cmdCopyBuffer(cmd, cache.store_upload, cache.iterations, (uint32_t) counts.size(), counts.data());
+		init.disp.cmdCopyBuffer(cmd, cache.store_upload, cache.magnitudes, (uint32_t) magnitudes.size(), magnitudes.data());
+	}
+
+	VkDescriptorSet set = cache.descriptor_sets[frame];
+	init.disp.cmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cache.pipeline_layout, 0, 1, &set, 0, nullptr);
+
+	if (!iterate.empty()) {
+		init.disp.cmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cache.tile_pipelines[precision]);
+
+		uint32_t groups_x = (CACHE_TILE_SIZE + compute.local_size[0] - 1) / compute.local_size[0];
+		uint32_t groups_y = (CACHE_TILE_SIZE + compute.local_size[1] - 1) / compute.local_size[1];
+		for (uint32_t t : iterate) {
+			CacheTilePush push = {};
+			TileKey key = key_at(t);
+			for (int axis = 0; axis < 2; axis++) {
+				double origin = (double) (axis == 0 ? key.x : key.y) * tile_span;
+				split_bits(origin, &push.origin_bits[axis * 2]);
+				split_ds(origin, &push.origin_ds[axis * 2]);
+			}
+			split_bits(step, push.step_bits);
+			split_ds(step, push.step_ds);
+			push.slot = table[t];
+			init.disp.cmdPushConstants(cmd, cache.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+			init.disp.cmdDispatch(cmd, groups_x, groups_y, 1);
+		}
+	}
+
+	if (!missing.empty()) {
+		VkMemoryBarrier tiles_ready = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+		};
+		init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &tiles_ready, 0, nullptr, 0, nullptr);
+	}
+
+	// iterated tiles go back to the host, to be saved the next time this frame comes round: the backlog's first,
+	// then this frame's, and what doesn't fit waits for the frames after
+	std::vector<TileKey> copy;
+	if (store) {
+		while (!cache.store_backlog.empty() && copy.size() < STORE_TILES) {
+			if (cache.entries.count(cache.store_backlog.front()))
+				copy.push_back(cache.store_backlog.front());
+			cache.store_backlog.pop_front();
+		}
+		for (uint32_t t : iterate) {
+			if (copy.size() < STORE_TILES)
+				copy.push_back(key_at(t));
+			else
+				cache.store_backlog.push_back(key_at(t));
+		}
+		// no more than the cache holds can still be resident
+		while (cache.store_backlog.size() > cache.capacity)
+			cache.store_backlog.pop_front();
+	}
+	if (!copy.empty()) {
+		std::vector<VkBufferCopy> counts, magnitudes;
+		for (uint32_t j = 0; j < copy.size(); j++) {
+			VkDeviceSize slot = (VkDeviceSize) cache.entries.find(copy[j])->second.slot * TILE_BYTES;
+			counts.push_back({ slot, store_offset(frame, j, false), TILE_BYTES });
+			magnitudes.push_back({ slot, store_offset(frame, j, true), TILE_BYTES });
+			cache.store_pending[frame].push_back(stored_key(copy[j]));
+		}
+		init.disp.cmdCopyBuffer(cmd, cache.iterations, cache.store_readback, (uint32_t) counts.size(), counts.data());
+		init.disp.cmdCopyBuffer(cmd, cache.magnitudes, cache.store_readback, (uint32_t) magnitudes.size(), magnitudes.data());
+
+		VkMemoryBarrier copied = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+		};
+		init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &copied, 0, nullptr, 0, nullptr);
+	}
+
+	ComposePush compose = {
+		.offset = { (float) offset[0], (float) offset[1] },
+		.ratio = { (float) ratio[0], (float) ratio[1] },
+		.table_size = { size[0], size[1] },
+		.extent = { params.extent[0], params.extent[1] },
+		.table_base = base,
+	};
+	init.disp.cmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cache.compose_pipeline);
+	init.disp.cmdPushConstants(cmd, cache.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(compose), &compose);
+	init.disp.cmdDispatch(cmd, (params.extent[0] + compute.local_size[0] - 1) / compute.local_size[0], (params.extent[1] + compute.local_size[1] - 1) / compute.local_size[1], 1);
+
+	VkMemoryBarrier outputs_ready = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+	};
+	init.disp.cmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &outputs_ready, 0, nullptr, 0, nullptr);
+	return 0;
+}
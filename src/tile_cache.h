@@ -0,0 +1,142 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan_core.h>
+
+#include "mandel.h"
+#include "allocator.h"
+#include "tile_store.h"
+
+struct Init;
+struct Options;
+struct ComputeEngine;
+
+// pixels along a tile's side
+const uint32_t CACHE_TILE_SIZE = 128;
+
+// level 0 pixels are this wide, and every level halves it, so tile corners are exact doubles
+const double CACHE_LEVEL0_STEP = 1.0 / 64;
+
+// tiles a frame loads from the --tile-store, and copies back to save to it, at most; the rest of its misses are
+// iterated, and the rest of what it iterated waits in store_backlog for later frames to copy back
+const uint32_t STORE_TILES = 32;
+
+// mirrors the CacheTile push constant block in mandel_tile.comp
+struct CacheTilePush {
+	uint32_t origin_bits[4];
+	float origin_ds[4];
+	uint32_t step_bits[2];
+	float step_ds[2];
+	uint32_t slot;
+};
+
+// mirrors the ComposeParams push constant block in compose.comp
+struct ComposePush {
+	float offset[2];
+	float ratio[2];
+	uint32_t table_size[2];
+	uint32_t extent[2];
+	uint32_t table_base;
+};
+
+struct TileKey {
+	int32_t level;
+	int64_t x;
+	int64_t y;
+	uint32_t max_iterations;
+	// tiers round differently, so tiles from one never stand in for another
+	Precision precision;
+
+	bool operator==(const TileKey& other) const {
+		return level == other.level && x == other.x && y == other.y &&
+			max_iterations == other.max_iterations && precision == other.precision;
+	}
+};
+
+struct TileKeyHash {
+	size_t operator()(const TileKey& key) const {
+		uint64_t h = (uint64_t) key.x * 0x9E3779B97F4A7C15ull;
+		h ^= (uint64_t) key.y + 0x7F4A7C159E3779B9ull + (h << 6) + (h >> 2);
+		h ^= ((uint64_t) (uint32_t) key.level << 40) ^ ((uint64_t) key.max_iterations << 8) ^ (uint64_t) key.precision;
+		return (size_t) h;
+	}
+};
+
+// iteration counts for square tiles on a quadtree of zoom levels, kept in GPU memory under an LRU
+// budget. A view is drawn from the finest level no coarser than its pixels, so pans only iterate the
+// tiles they newly expose and revisiting a view iterates nothing.
+struct TileCache {
+	// 0 when --cache-mb 0 turned it off
+	uint32_t capacity = 0;
+
+	// most recently used first
+	std::list<TileKey> lru;
+	struct Entry {
+		uint32_t slot;
+		std::list<TileKey>::iterator position;
+	};
+	std::unordered_map<TileKey, Entry, TileKeyHash> entries;
+	std::vector<uint32_t> free_slots;
+
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+
+	VkDescriptorSetLayout set_layout;
+	VkPipelineLayout pipeline_layout;
+	// one per precision tier, VK_NULL_HANDLE for f64 on devices without shaderFloat64
+	VkPipeline tile_pipelines[PRECISION_COUNT];
+	VkPipeline compose_pipeline;
+	VkDescriptorPool descriptor_pool;
+	std::vector<VkDescriptorSet> descriptor_sets;
+
+	VkBuffer iterations;
+	Allocation iterations_memory;
+	VkBuffer magnitudes;
+	Allocation magnitudes_memory;
+
+	// the slots of the tiles each frame in flight draws from, host visible
+	uint32_t table_capacity;
+	VkBuffer table;
+	Allocation table_memory;
+	uint32_t* table_mapped;
+
+	// --tile-store: misses come from disk when they're there, and tiles iterated here go back to it
+	TileStore store;
+	// per frame in flight, STORE_TILES tiles' counts then as many tiles' magnitudes: loaded tiles on their way
+	// to the GPU in store_upload, iterated ones on their way back in store_readback
+	VkBuffer store_upload = VK_NULL_HANDLE;
+	Allocation store_upload_memory;
+	VkBuffer store_readback = VK_NULL_HANDLE;
+	Allocation store_readback_memory;
+	// per frame in flight, the tiles in its part of store_readback, saved once the frame is done
+	std::vector<std::vector<StoredTile>> store_pending;
+	// iterated tiles no frame has had room to copy back yet, oldest first; those evicted meanwhile are dropped,
+	// and whatever is still here at exit goes unsaved
+	std::deque<TileKey> store_backlog;
+};
+
+// one descriptor set per uniform slot, so per frame in flight; does nothing when options.cache_mb is 0
+int create_tile_cache(Init& init, TileCache& cache, const Options& options, const ComputeEngine& compute, const UniformRing& uniforms);
+// sizes the tile tables for compute's current extent and binds its buffers as the compose target
+int bind_tile_cache_targets(Init& init, TileCache& cache, const ComputeEngine& compute);
+void destroy_tile_cache(Init& init, TileCache& cache);
+
+// the level whose pixels are the largest not larger than the view's
+int cache_level_for(const MandelParams& params);
+// whether the view's tile coordinates at that level fit an int64_t with room to spare; views past it, far out
+// or zoomed past what a double can step, are iterated uncached instead
+bool cache_covers(const MandelParams& params);
+
+// iterates whichever tiles of the view aren't resident, or loads them from the store, then composes the view into
+// compute's iteration and magnitude buffers, leaving them ready for record_colorize. frame picks the descriptor
+// set and tile table, and whatever last used it has to have finished: its iterated tiles get saved here.
+int record_cached_view(Init& init, TileCache& cache, const ComputeEngine& compute, VkCommandBuffer cmd, size_t frame, const MandelParams& params, Precision precision_mode);
+// saves the tiles every frame copied back for the store, once they've all finished
+void flush_tile_store(Init& init, TileCache& cache);
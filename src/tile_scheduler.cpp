@@ -0,0 +1,255 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <numeric>
+#include <thread>
+
+#include "tile_scheduler.h"
+
+// the CPUs this process may run on, by NUMA node
+struct Topology {
+	std::vector<cpu_set_t> nodes;
+	// the index into nodes of every one of those CPUs, a node's all together
+	std::vector<int> cpu_nodes;
+};
+
+// sysfs lists, eg "0-3,8,10-11"
+static std::vector<int> parse_list(const char* text) {
+	std::vector<int> items;
+	const char* p = text;
+	for (;;) {
+		char* end;
+		long first = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		long last = first;
+		p = end;
+		if (*p == '-') {
+			last = strtol(p + 1, &end, 10);
+			p = end;
+		}
+		for (long i = first; i <= last; i++)
+			items.push_back((int) i);
+		if (*p != ',')
+			break;
+		p++;
+	}
+	return items;
+}
+
+static bool read_list(const char* path, std::vector<int>& items) {
+	FILE* file = fopen(path, "r");
+	if (file == nullptr)
+		return false;
+	char text[4096] = {};
+	bool read = fgets(text, sizeof(text), file) != nullptr;
+	fclose(file);
+	if (read)
+		items = parse_list(text);
+	return read;
+}
+
+// machines without sysfs, or with one node, come back with at most one and nothing gets pinned
+static Topology read_topology() {
+	Topology topology;
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	std::vector<int> nodes;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || !read_list("/sys/devices/system/node/online", nodes))
+		return topology;
+
+	for (int node : nodes) {
+		char path[64];
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+		std::vector<int> cpus;
+		if (!read_list(path, cpus))
+			continue;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		size_t count = 0;
+		for (int cpu : cpus) {
+			if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+				CPU_SET(cpu, &set);
+				count++;
+			}
+		}
+		if (count == 0)
+			continue;
+		topology.cpu_nodes.insert(topology.cpu_nodes.end(), count, (int) topology.nodes.size());
+		topology.nodes.push_back(set);
+	}
+	return topology;
+}
+
+// read the first time it's needed, before any thread here is pinned
+static const Topology& topology() {
+	static const Topology topology = read_topology();
+	return topology;
+}
+
+// threads spread over the nodes like the CPUs are, so each node gets about one per CPU it has
+static int thread_node(const Topology& topology, unsigned thread, unsigned threads) {
+	if (topology.nodes.size() < 2)
+		return 0;
+	return topology.cpu_nodes[(size_t) thread * topology.cpu_nodes.size() / threads];
+}
+
+// a thread's tiles, on a cache line of its own so neighbouring threads' locks don't share one
+struct alignas(64) TileQueue {
+	std::mutex lock;
+	std::deque<TileRect> tiles;
+	// tiles.size(), for thieves to skip empty queues without taking the lock
+	std::atomic<size_t> size { 0 };
+	int node = 0;
+};
+
+void schedule_tiles(const TileSchedule& schedule, const std::vector<TileRect>& tiles, const std::function<void(const TileRect&)>& render) {
+	unsigned threads = std::max(1u, schedule.threads);
+	if (threads == 1) {
+		for (const TileRect& tile : tiles)
+			render(tile);
+		return;
+	}
+	if (tiles.empty())
+		return;
+
+	const Topology& nodes = topology();
+	std::vector<TileQueue> queues(threads);
+	for (unsigned t = 0; t < threads; t++)
+		queues[t].node = thread_node(nodes, t, threads);
+
+	// queued is what sits in the queues, pending what hasn't been rendered yet, queued or not
+	std::atomic<size_t> queued { 0 };
+	std::atomic<size_t> pending { tiles.size() };
+	auto deal = [&](const std::vector<size_t>& order) {
+		for (size_t i = 0; i < order.size(); i++)
+			queues[i % threads].tiles.push_back(tiles[order[i]]);
+		for (TileQueue& queue : queues)
+			queue.size = queue.tiles.size();
+		queued = order.size();
+	};
+
+	std::vector<uint64_t> costs(schedule.cost ? tiles.size() : 0);
+	std::atomic<size_t> next_cost { 0 };
+	std::vector<size_t> order(tiles.size());
+	std::iota(order.begin(), order.end(), 0);
+	// the last thread to finish estimating deals everyone's tiles out
+	std::barrier estimated(threads, [&]() noexcept {
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return costs[a] > costs[b]; });
+		deal(order);
+	});
+	if (!schedule.cost)
+		deal(order);
+
+	auto take_from = [&](TileQueue& queue, TileRect& tile) {
+		if (queue.size == 0)
+			return false;
+		std::lock_guard<std::mutex> guard(queue.lock);
+		if (queue.tiles.empty())
+			return false;
+		tile = queue.tiles.front();
+		queue.tiles.pop_front();
+		queue.size = queue.tiles.size();
+		queued--;
+		return true;
+	};
+	// its own queue, then its node's, then anyone's, each from the front where the costliest tiles are
+	auto take = [&](unsigned self, TileRect& tile) {
+		if (take_from(queues[self], tile))
+			return true;
+		for (int local = 1; local >= 0; local--) {
+			for (unsigned i = 1; i < threads; i++) {
+				TileQueue& victim = queues[(self + i) % threads];
+				if ((victim.node == queues[self].node) == (local == 1) && take_from(victim, tile))
+					return true;
+			}
+		}
+		return false;
+	};
+
+	// threads with nothing to take sleep here until tiles get split or the last one is done; taking the lock
+	// before notifying means a thread can't check, miss the change and then sleep through it
+	std::mutex idle_lock;
+	std::condition_variable idle;
+	auto wake = [&](unsigned count) {
+		{ std::lock_guard<std::mutex> guard(idle_lock); }
+		if (count >= threads) {
+			idle.notify_all();
+			return;
+		}
+		for (unsigned i = 0; i < count; i++)
+			idle.notify_one();
+	};
+
+	auto worker = [&](unsigned self) {
+		// the calling thread gets its own affinity back afterwards
+		cpu_set_t saved;
+		bool pinned = nodes.nodes.size() > 1 && pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) == 0 &&
+			pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &nodes.nodes[queues[self].node]) == 0;
+
+		if (schedule.cost) {
+			for (size_t i = next_cost++; i < tiles.size(); i = next_cost++)
+				costs[i] = schedule.cost(tiles[i]);
+			estimated.arrive_and_wait();
+		}
+
+		// tiles only ever get added by a thread that holds one, so nothing is left once pending reaches 0
+		while (pending > 0) {
+			TileRect tile;
+			if (!take(self, tile)) {
+				std::unique_lock<std::mutex> guard(idle_lock);
+				idle.wait(guard, [&]() { return queued > 0 || pending == 0; });
+				continue;
+			}
+			// running low: keep the top left quarter and put the rest where idle threads look first
+			while (schedule.split && queued < threads &&
+					tile.x1 - tile.x0 >= 2 * MIN_SPLIT_TILE && tile.y1 - tile.y0 >= 2 * MIN_SPLIT_TILE) {
+				uint32_t xm = (tile.x0 + tile.x1) / 2;
+				uint32_t ym = (tile.y0 + tile.y1) / 2;
+				pending += 3;
+				TileQueue& queue = queues[self];
+				{
+					// counted before they can be taken, or a thief's queued-- could wrap it below 0
+					std::lock_guard<std::mutex> guard(queue.lock);
+					queued += 3;
+					queue.tiles.push_front({ xm, ym, tile.x1, tile.y1 });
+					queue.tiles.push_front({ tile.x0, ym, xm, tile.y1 });
+					queue.tiles.push_front({ xm, tile.y0, tile.x1, ym });
+					queue.size = queue.tiles.size();
+				}
+				wake(3);
+				tile = { tile.x0, tile.y0, xm, ym };
+			}
+			render(tile);
+			if (--pending == 0)
+				wake(threads);
+		}
+
+		if (pinned)
+			pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned t = 1; t < threads; t++)
+		workers.emplace_back(worker, t);
+	worker(0);
+	for (auto& t : workers)
+		t.join();
+}
+
+std::vector<TileRect> grid_tiles(uint32_t width, uint32_t height, uint32_t size) {
+	std::vector<TileRect> tiles;
+	for (uint32_t y = 0; y < height; y += size) {
+		for (uint32_t x = 0; x < width; x += size)
+			tiles.push_back({ x, y, std::min(x + size, width), std::min(y + size, height) });
+	}
+	return tiles;
+}
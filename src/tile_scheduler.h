@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+// pixels [x0, x1) of rows [y0, y1)
+struct TileRect {
+	uint32_t x0, y0, x1, y1;
+};
+
+// tiles are quartered no further than this along a side, about where a row kernel's SIMD lanes stop filling
+const uint32_t MIN_SPLIT_TILE = 16;
+
+struct TileSchedule {
+	unsigned threads = 1;
+	// quarter a tile that comes up when fewer tiles are queued than there are threads, so the last costly ones
+	// spread over everyone rather than leaving all but one waiting; off for renders that need whole tiles
+	bool split = true;
+	// what a tile will roughly cost, in any unit, to deal tiles out most expensive first; the threads estimate
+	// every tile together before any renders. Empty keeps the order given.
+	std::function<uint64_t(const TileRect&)> cost;
+};
+
+// renders every tile once on schedule.threads threads, the calling one included. Each thread works through a
+// deque of its own, dealt from the ordered tiles in turn, and then steals from the front of the others', trying
+// the threads on its own NUMA node first, sleeping when there's nothing to take until a tile gets split or the
+// last one is done. On machines with more than one node every thread is pinned to one, in proportion to the
+// CPUs each has.
+void schedule_tiles(const TileSchedule& schedule, const std::vector<TileRect>& tiles, const std::function<void(const TileRect&)>& render);
+
+// a width by height image in size pixel squares, the last column and row cut short, in rows from the top
+std::vector<TileRect> grid_tiles(uint32_t width, uint32_t height, uint32_t size);
@@ -0,0 +1,239 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "tile_store.h"
+
+static const uint32_t TILE_FILE_MAGIC = 0x6c69746d;
+static const uint32_t TILE_FILE_VERSION = 1;
+
+// what the file claims to hold, checked against the key on every load
+struct TileFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	int32_t level;
+	uint32_t max_iterations;
+	int64_t x;
+	int64_t y;
+	uint32_t precision;
+	float escape_radius2;
+	uint32_t size;
+	// 2 or 4
+	uint32_t count_bytes;
+	// bytes of runs after the header, then this many magnitudes
+	uint32_t run_bytes;
+	uint32_t escaped;
+};
+
+// each run starts with a 16 bit word: with RUN_REPEAT set, the count after it stands for the low bits' worth of
+// pixels, otherwise that many counts follow one per pixel
+static const uint16_t RUN_REPEAT = 0x8000;
+static const uint32_t RUN_MAX = 0x7fff;
+// shorter runs of one count go in with the counts around them
+static const uint32_t RUN_MIN_REPEAT = 3;
+
+int open_tile_store(TileStore& store, const std::string& dir) {
+	if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+		std::cout << "can't create tile store " << dir << ": " << strerror(errno) << "\n";
+		return -1;
+	}
+	store.dir = dir;
+	return 0;
+}
+
+// a directory per cap, tier and radius, and one per level under that, so no directory gets too big to list
+static std::string tile_dir(const TileStore& store, const StoredTile& key, bool level) {
+	char name[96];
+	snprintf(name, sizeof(name), "/i%u-%s-r%g", key.max_iterations, precision_name(key.precision), key.escape_radius2);
+	std::string dir = store.dir + name;
+	if (level)
+		dir += "/l" + std::to_string(key.level);
+	return dir;
+}
+
+static std::string tile_path(const TileStore& store, const StoredTile& key) {
+	return tile_dir(store, key, true) + "/" + std::to_string(key.x) + "_" + std::to_string(key.y) + ".tile";
+}
+
+static void put(std::vector<uint8_t>& out, const void* data, size_t size) {
+	out.insert(out.end(), (const uint8_t*) data, (const uint8_t*) data + size);
+}
+
+static void put_count(std::vector<uint8_t>& out, uint32_t count, uint32_t count_bytes) {
+	if (count_bytes == 2) {
+		uint16_t narrow = (uint16_t) count;
+		put(out, &narrow, sizeof(narrow));
+	} else {
+		put(out, &count, sizeof(count));
+	}
+}
+
+static void encode_tile(const StoredTile& key, uint32_t size, const uint32_t* counts, const float* magnitudes, std::vector<uint8_t>& out) {
+	uint32_t pixels = size * size;
+	uint32_t count_bytes = key.max_iterations <= 0xffff ? 2 : 4;
+	TileFileHeader header = {
+		.magic = TILE_FILE_MAGIC,
+		.version = TILE_FILE_VERSION,
+		.level = key.level,
+		.max_iterations = key.max_iterations,
+		.x = key.x,
+		.y = key.y,
+		.precision = (uint32_t) key.precision,
+		.escape_radius2 = key.escape_radius2,
+		.size = size,
+		.count_bytes = count_bytes,
+	};
+	out.assign(sizeof(header), 0);
+
+	// counts since the last run of one count, not written yet
+	uint32_t literal = 0;
+	auto flush_literal = [&](uint32_t end) {
+		while (literal > 0) {
+			uint16_t n = (uint16_t) std::min(literal, RUN_MAX);
+			put(out, &n, sizeof(n));
+			for (uint32_t i = end - literal; i < end - literal + n; i++)
+				put_count(out, counts[i], count_bytes);
+			literal -= n;
+		}
+	};
+	for (uint32_t i = 0; i < pixels;) {
+		uint32_t run = 1;
+		while (i + run < pixels && run < RUN_MAX && counts[i + run] == counts[i])
+			run++;
+		if (run < RUN_MIN_REPEAT) {
+			literal += run;
+			i += run;
+			continue;
+		}
+		flush_literal(i);
+		uint16_t n = (uint16_t) (RUN_REPEAT | run);
+		put(out, &n, sizeof(n));
+		put_count(out, counts[i], count_bytes);
+		i += run;
+	}
+	flush_literal(pixels);
+	header.run_bytes = (uint32_t) (out.size() - sizeof(header));
+
+	// inside the set there's no |z| at escape to keep
+	for (uint32_t i = 0; i < pixels; i++) {
+		if (counts[i] < key.max_iterations) {
+			put(out, &magnitudes[i], sizeof(float));
+			header.escaped++;
+		}
+	}
+	memcpy(out.data(), &header, sizeof(header));
+}
+
+static bool decode_tile(const StoredTile& key, uint32_t size, const uint8_t* data, size_t bytes, uint32_t* counts, float* magnitudes) {
+	TileFileHeader header;
+	if (bytes < sizeof(header))
+		return false;
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != TILE_FILE_MAGIC || header.version != TILE_FILE_VERSION || header.level != key.level ||
+			header.x != key.x || header.y != key.y || header.max_iterations != key.max_iterations ||
+			header.precision != (uint32_t) key.precision || header.escape_radius2 != key.escape_radius2 || header.size != size ||
+			(header.count_bytes != 2 && header.count_bytes != 4))
+		return false;
+	if ((uint64_t) sizeof(header) + header.run_bytes + (uint64_t) header.escaped * sizeof(float) != bytes)
+		return false;
+
+	uint32_t pixels = size * size;
+	const uint8_t* p = data + sizeof(header);
+	const uint8_t* end = p + header.run_bytes;
+	auto count_at = [&](const uint8_t* at) {
+		if (header.count_bytes == 2) {
+			uint16_t narrow;
+			memcpy(&narrow, at, sizeof(narrow));
+			return (uint32_t) narrow;
+		}
+		uint32_t count;
+		memcpy(&count, at, sizeof(count));
+		return count;
+	};
+	uint32_t filled = 0;
+	while (p < end) {
+		uint16_t n;
+		if (end - p < (ptrdiff_t) sizeof(n))
+			return false;
+		memcpy(&n, p, sizeof(n));
+		p += sizeof(n);
+		uint32_t run = n & RUN_MAX;
+		uint32_t stored = (n & RUN_REPEAT) ? 1 : run;
+		if (run > pixels - filled || end - p < (ptrdiff_t) (stored * header.count_bytes))
+			return false;
+		for (uint32_t i = 0; i < run; i++)
+			counts[filled + i] = count_at(p + (stored == 1 ? 0 : i * header.count_bytes));
+		p += stored * header.count_bytes;
+		filled += run;
+	}
+	if (filled != pixels)
+		return false;
+
+	uint32_t escaped = 0;
+	for (uint32_t i = 0; i < pixels; i++) {
+		if (counts[i] > key.max_iterations)
+			return false;
+		if (counts[i] == key.max_iterations) {
+			magnitudes[i] = 0;
+		} else {
+			if (escaped == header.escaped)
+				return false;
+			memcpy(&magnitudes[i], end + (size_t) escaped * sizeof(float), sizeof(float));
+			escaped++;
+		}
+	}
+	return escaped == header.escaped;
+}
+
+bool load_stored_tile(TileStore& store, const StoredTile& key, uint32_t size, uint32_t* counts, float* magnitudes) {
+	int fd = open(tile_path(store, key).c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	void* data = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		data = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+
+	bool loaded = decode_tile(key, size, (const uint8_t*) data, (size_t) st.st_size, counts, magnitudes);
+	munmap(data, (size_t) st.st_size);
+	if (loaded)
+		store.loads++;
+	return loaded;
+}
+
+bool save_stored_tile(TileStore& store, const StoredTile& key, uint32_t size, const uint32_t* counts, const float* magnitudes) {
+	std::vector<uint8_t> encoded;
+	encode_tile(key, size, counts, magnitudes, encoded);
+
+	std::string dir = tile_dir(store, key, true);
+	if (mkdir(tile_dir(store, key, false).c_str(), 0777) != 0 && errno != EEXIST)
+		return false;
+	if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+		return false;
+
+	// another process may be writing the same tile, so each writes a file of its own
+	std::string path = tile_path(store, key);
+	std::string temporary = path + "." + std::to_string(getpid()) + ".tmp";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+	bool written = fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+	written = fclose(file) == 0 && written;
+	if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+		unlink(temporary.c_str());
+		return false;
+	}
+	store.saves++;
+	return true;
+}
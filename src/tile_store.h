@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+
+#include "mandel.h"
+
+// everything a tile cache tile's counts and magnitudes depend on; the early outs and unrolling change neither
+struct StoredTile {
+	int32_t level;
+	int64_t x;
+	int64_t y;
+	uint32_t max_iterations;
+	Precision precision;
+	float escape_radius2;
+};
+
+// tile cache tiles kept on disk between runs, one small file each under dir, which any number of processes can
+// share: a tile is written under a name of its own and renamed into place, so readers see all of it or none.
+// Counts are 16 bit when the cap allows, runs of one count are stored once, and only escaped pixels keep a
+// magnitude. Files are in the machine's own byte order.
+struct TileStore {
+	// empty for none
+	std::string dir;
+	uint64_t loads = 0;
+	uint64_t saves = 0;
+};
+
+// creates dir when it's missing
+int open_tile_store(TileStore& store, const std::string& dir);
+
+// maps the tile's file and decodes it into size * size counts and magnitudes, which is a copy: the runs and
+// narrow counts have to be expanded, so nothing uploads from the mapping itself. False when there is no file, or
+// it doesn't hold what it should.
+bool load_stored_tile(TileStore& store, const StoredTile& key, uint32_t size, uint32_t* counts, float* magnitudes);
+// false when it couldn't be written, which only costs iterating the tile again next time
+bool save_stored_tile(TileStore& store, const StoredTile& key, uint32_t size, const uint32_t* counts, const float* magnitudes);
@@ -0,0 +1,23 @@
+#include <stdio.h>
+
+#include "timing.h"
+
+void timer_start(PhaseTimer& timer) {
+	timer.start = timer.last = std::chrono::steady_clock::now();
+	timer.phases.clear();
+}
+
+void timer_mark(PhaseTimer& timer, const char* phase) {
+	auto now = std::chrono::steady_clock::now();
+	std::chrono::duration<double, std::milli> elapsed = now - timer.last;
+	timer.phases.emplace_back(phase, elapsed.count());
+	timer.last = now;
+}
+
+void timer_report(const PhaseTimer& timer, const char* title) {
+	printf("%s:", title);
+	for (auto& phase : timer.phases)
+		printf(" %s %.1fms,", phase.first, phase.second);
+	std::chrono::duration<double, std::milli> total = timer.last - timer.start;
+	printf(" total %.1fms\n", total.count());
+}